@@ -3,19 +3,32 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
+layout (location = 3) in mat4 aInstanceModel; // Takes locations 3-6
+layout (location = 7) in mat3 aInstanceNormal; // Takes locations 7-9, aInstanceModel's normal matrix
 
 out vec3 Normal;
 out vec2 TexCoord;
 out vec3 FragPos;
 
+layout (std140) uniform Camera { // Shared by every program, see CameraBuffer
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPos;
+    vec4 viewport;
+};
+
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform mat3 normalMatrix; // Inverse transpose of model, computed on the CPU
+uniform bool instanced; // Use aInstanceModel and aInstanceNormal instead of model and normalMatrix
 
 void main() {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    mat4 modelMatrix = instanced ? aInstanceModel : model;
+
+    vec4 worldPos = modelMatrix * vec4(aPos, 1.0);
+    gl_Position = viewProjection * worldPos;
 
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    FragPos = vec3(worldPos);
+    Normal = (instanced ? aInstanceNormal : normalMatrix) * aNormal;
     TexCoord = aTexCoord; // Use "1.0 - coord" to reverse the flip image
-}
\ No newline at end of file
+}
@@ -0,0 +1,507 @@
+#include <bullet/LinearMath/btConvexHullComputer.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cmath>
+
+#include "include/ColliderCooker.h"
+#include "include/Collision.h"
+
+namespace {
+	const char COOKED_MAGIC[4] = { 'O', 'G', 'C', 'C' };
+	const uint32_t COOKED_VERSION = 1;
+
+	const char BVH_MAGIC[4] = { 'O', 'G', 'B', 'V' };
+	const uint32_t BVH_VERSION = 1;
+
+	/// @brief Triangle mesh shape using a BVH deserialized in place, which lives inside `bvhBuffer`
+	class SerializedBvhTriangleMeshShape : public btBvhTriangleMeshShape {
+		public:
+			SerializedBvhTriangleMeshShape(btStridingMeshInterface* mesh, btOptimizedBvh* bvh, void* bvhBuffer)
+				: btBvhTriangleMeshShape(mesh, true, false), bvhBuffer(bvhBuffer) {
+					setOptimizedBvh(bvh);
+				}
+			/// @note The base class doesn't own the BVH, so freeing the buffer is the only cleanup
+			~SerializedBvhTriangleMeshShape() {
+				btAlignedFree(bvhBuffer);
+			}
+		private:
+			void* bvhBuffer;
+	};
+
+	struct Triangle {
+		glm::vec3 a;
+		glm::vec3 b;
+		glm::vec3 c;
+
+		glm::vec3 centroid() const { return (a + b + c) / 3.f; }
+	};
+
+	/// @brief A piece of the mesh and the hull around it
+	struct Part {
+		std::vector<Triangle> triangles;
+		std::vector<glm::vec3> hull;
+		float concavity = 0.f;	// Deepest distance from a triangle to the hull's surface
+	};
+
+	template<class T> uint64_t hashValue(uint64_t hash, const T value) {
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+		for(size_t i = 0; i < sizeof(T); i++) {
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+
+		return hash;
+	}
+
+	uint64_t hashCookingInput(const std::vector<Vertex>& verticies, const CookingSettings& settings) {
+		uint64_t hash = hashVertexPositions(verticies);
+		hash = hashValue(hash, COOKED_VERSION);
+		hash = hashValue(hash, settings.maxHullVertices);
+		hash = hashValue(hash, settings.maxHulls);
+		hash = hashValue(hash, settings.concavityThreshold);
+		hash = hashValue(hash, settings.decompose);
+
+		return hash;
+	}
+
+	/// @brief Returns how many bytes are left after the read position, so counts read from a file can be checked before allocating
+	std::streamoff remainingBytes(std::ifstream& file) {
+		const std::streampos current = file.tellg();
+		file.seekg(0, std::ios::end);
+		const std::streampos end = file.tellg();
+		file.seekg(current);
+
+		return end - current;
+	}
+
+	/// @brief Builds a triangle mesh from every 3 vertices
+	btTriangleMesh* createTriangleMesh(const std::vector<glm::vec3>& points) {
+		btTriangleMesh* mesh = new btTriangleMesh();
+		for(size_t i = 0; i + 2 < points.size(); i += 3) {
+			mesh->addTriangle(
+				btVector3(points[i].x, points[i].y, points[i].z),
+				btVector3(points[i+1].x, points[i+1].y, points[i+1].z),
+				btVector3(points[i+2].x, points[i+2].y, points[i+2].z)
+			);
+		}
+
+		return mesh;
+	}
+
+	/// @brief Writes the triangles and the shape's BVH to a file
+	bool saveTriangleMesh(const std::string& path, const uint64_t hash, const std::vector<glm::vec3>& points, btBvhTriangleMeshShape* shape) {
+		std::ofstream file(path, std::ios::binary);
+		if(!file.is_open())
+			return false;
+
+		const btOptimizedBvh* bvh = shape->getOptimizedBvh();
+		const uint32_t bvhSize = bvh->calculateSerializeBufferSize();
+		void* bvhBuffer = btAlignedAlloc(bvhSize, 16);
+		bvh->serialize(bvhBuffer, bvhSize, false);
+
+		const int32_t bulletVersion = BT_BULLET_VERSION;
+		const uint32_t scalarSize = sizeof(btScalar);
+		const uint32_t pointCount = points.size();
+		file.write(BVH_MAGIC, sizeof(BVH_MAGIC));
+		file.write(reinterpret_cast<const char*>(&BVH_VERSION), sizeof(BVH_VERSION));
+		file.write(reinterpret_cast<const char*>(&bulletVersion), sizeof(bulletVersion));
+		file.write(reinterpret_cast<const char*>(&scalarSize), sizeof(scalarSize));
+		file.write(reinterpret_cast<const char*>(&hash), sizeof(hash));
+		file.write(reinterpret_cast<const char*>(&pointCount), sizeof(pointCount));
+		file.write(reinterpret_cast<const char*>(points.data()), pointCount * sizeof(glm::vec3));
+		file.write(reinterpret_cast<const char*>(&bvhSize), sizeof(bvhSize));
+		file.write(reinterpret_cast<const char*>(bvhBuffer), bvhSize);
+
+		btAlignedFree(bvhBuffer);
+
+		return file.good();
+	}
+
+	/// @brief Reads the triangles and BVH from a file and creates the shape without building the BVH
+	/// @returns The shape, or nullptr if the file is missing, corrupt or from another version
+	btBvhTriangleMeshShape* loadTriangleMesh(const std::string& path, const uint64_t hash) {
+		std::ifstream file(path, std::ios::binary);
+		if(!file.is_open())
+			return nullptr;
+
+		char magic[4];
+		uint32_t version;
+		int32_t bulletVersion;
+		uint32_t scalarSize;
+		uint64_t fileHash;
+		uint32_t pointCount;
+		file.read(magic, sizeof(magic));
+		file.read(reinterpret_cast<char*>(&version), sizeof(version));
+		file.read(reinterpret_cast<char*>(&bulletVersion), sizeof(bulletVersion));
+		file.read(reinterpret_cast<char*>(&scalarSize), sizeof(scalarSize));
+		file.read(reinterpret_cast<char*>(&fileHash), sizeof(fileHash));
+		file.read(reinterpret_cast<char*>(&pointCount), sizeof(pointCount));
+
+		if(!file || std::memcmp(magic, BVH_MAGIC, sizeof(magic)) != 0 || version != BVH_VERSION
+			|| bulletVersion != BT_BULLET_VERSION || scalarSize != sizeof(btScalar) || fileHash != hash)
+			return nullptr;
+
+		// Both sizes come from the file, so they're checked against what's left of it before anything is allocated
+		const std::streamoff pointsSize = (std::streamoff)pointCount * (std::streamoff)sizeof(glm::vec3);
+		if(pointsSize + (std::streamoff)sizeof(uint32_t) > remainingBytes(file))
+			return nullptr;
+
+		std::vector<glm::vec3> points(pointCount);
+		file.read(reinterpret_cast<char*>(points.data()), pointsSize);
+
+		uint32_t bvhSize;
+		file.read(reinterpret_cast<char*>(&bvhSize), sizeof(bvhSize));
+		if(!file || bvhSize == 0 || (std::streamoff)bvhSize != remainingBytes(file))
+			return nullptr;
+
+		void* bvhBuffer = btAlignedAlloc(bvhSize, 16);
+		file.read(reinterpret_cast<char*>(bvhBuffer), bvhSize);
+
+		btQuantizedBvh* bvh = file ? btQuantizedBvh::deSerializeInPlace(bvhBuffer, bvhSize, false) : nullptr;
+		if(!bvh){
+			btAlignedFree(bvhBuffer);
+			return nullptr;
+		}
+
+		return new SerializedBvhTriangleMeshShape(createTriangleMesh(points), static_cast<btOptimizedBvh*>(bvh), bvhBuffer);
+	}
+
+	/// @brief Keeps the support point of the hull for `maxVertices` directions evenly spread over a sphere(fibonacci)
+	std::vector<glm::vec3> sampleSupportPoints(const btAlignedObjectArray<btVector3>& hullVertices, const unsigned int maxVertices) {
+		std::vector<glm::vec3> result;
+
+		if((unsigned int)hullVertices.size() <= maxVertices){
+			for(int i = 0; i < hullVertices.size(); i++) {
+				result.push_back(glm::vec3(hullVertices[i].getX(), hullVertices[i].getY(), hullVertices[i].getZ()));
+			}
+			return result;
+		}
+
+		std::vector<bool> used(hullVertices.size(), false);
+		for(unsigned int i = 0; i < maxVertices; i++) {
+			const float y = 1.f - 2.f * (i + 0.5f) / maxVertices;
+			const float radius = std::sqrt(1.f - y * y);
+			const float phi = i * 2.39996323f;	// Golden angle
+			const btVector3 dir(std::cos(phi) * radius, y, std::sin(phi) * radius);
+
+			btScalar dot;
+			const long support = dir.maxDot(&hullVertices[0], hullVertices.size(), dot);
+			if(support >= 0 && !used[support]){
+				used[support] = true;
+				result.push_back(glm::vec3(hullVertices[support].getX(), hullVertices[support].getY(), hullVertices[support].getZ()));
+			}
+		}
+
+		return result;
+	}
+
+	/// @brief Computes the deepest distance from any triangle's centroid to the surface of the hull
+	float measureConcavity(const std::vector<Triangle>& triangles, const btConvexHullComputer& hull) {
+		struct Plane {
+			btVector3 normal;
+			btScalar dist;
+		};
+
+		btVector3 center(0.f, 0.f, 0.f);
+		for(int i = 0; i < hull.vertices.size(); i++) {
+			center += hull.vertices[i];
+		}
+		center /= btScalar(hull.vertices.size());
+
+		std::vector<Plane> planes;
+		for(int i = 0; i < hull.faces.size(); i++) {
+			const btConvexHullComputer::Edge* edge = &hull.edges[hull.faces[i]];
+			const btVector3& a = hull.vertices[edge->getSourceVertex()];
+			edge = edge->getNextEdgeOfFace();
+			const btVector3& b = hull.vertices[edge->getSourceVertex()];
+			edge = edge->getNextEdgeOfFace();
+			const btVector3& c = hull.vertices[edge->getSourceVertex()];
+
+			btVector3 normal = (b - a).cross(c - a);
+			if(normal.length2() < SIMD_EPSILON)
+				continue;
+			normal.normalize();
+
+			// Point outwards
+			if(normal.dot(center - a) > 0.f)
+				normal = -normal;
+			planes.push_back({ normal, normal.dot(a) });
+		}
+
+		// Flat hulls have no depth
+		if(planes.size() < 4)
+			return 0.f;
+
+		float concavity = 0.f;
+		for(const Triangle& triangle : triangles) {
+			const glm::vec3 c = triangle.centroid();
+			const btVector3 point(c.x, c.y, c.z);
+
+			btScalar depth = BT_LARGE_FLOAT;
+			for(const Plane& plane : planes) {
+				depth = btMin(depth, plane.dist - plane.normal.dot(point));
+			}
+			concavity = std::max(concavity, (float)depth);
+		}
+
+		return concavity;
+	}
+
+	/// @brief Computes the part's simplified hull and concavity
+	void evaluatePart(Part& part, const CookingSettings& settings) {
+		std::vector<glm::vec3> points;
+		points.reserve(part.triangles.size() * 3);
+		for(const Triangle& triangle : part.triangles) {
+			points.push_back(triangle.a);
+			points.push_back(triangle.b);
+			points.push_back(triangle.c);
+		}
+
+		btConvexHullComputer computer;
+		computer.compute(&points[0].x, sizeof(glm::vec3), (int)points.size(), 0.f, 0.f);
+		if(computer.vertices.size() == 0){
+			part.hull.clear();
+			part.concavity = 0.f;
+			return;
+		}
+
+		part.concavity = measureConcavity(part.triangles, computer);
+		part.hull = sampleSupportPoints(computer.vertices, settings.maxHullVertices);
+	}
+
+	/// @brief Splits a part in half along the longest axis of its triangles' centroids
+	void splitPart(Part& part, Part& left, Part& right) {
+		glm::vec3 min = part.triangles[0].centroid();
+		glm::vec3 max = min;
+		for(const Triangle& triangle : part.triangles) {
+			min = glm::min(min, triangle.centroid());
+			max = glm::max(max, triangle.centroid());
+		}
+
+		const glm::vec3 extent = max - min;
+		int axis = 0;
+		if(extent.y > extent[axis])
+			axis = 1;
+		if(extent.z > extent[axis])
+			axis = 2;
+
+		std::sort(part.triangles.begin(), part.triangles.end(), [axis](const Triangle& a, const Triangle& b) {
+			return a.centroid()[axis] < b.centroid()[axis];
+		});
+
+		const size_t half = part.triangles.size() / 2;
+		left.triangles.assign(part.triangles.begin(), part.triangles.begin() + half);
+		right.triangles.assign(part.triangles.begin() + half, part.triangles.end());
+	}
+}
+
+uint64_t hashVertexPositions(const std::vector<Vertex>& verticies, uint64_t hash) {
+	hash = hashValue(hash, (uint64_t)verticies.size());
+	for(const Vertex& vertex : verticies) {
+		hash = hashValue(hash, vertex.pos.x);
+		hash = hashValue(hash, vertex.pos.y);
+		hash = hashValue(hash, vertex.pos.z);
+	}
+
+	return hash;
+}
+
+std::vector<glm::vec3> simplifyHull(const std::vector<glm::vec3>& points, const unsigned int maxVertices) {
+	if(points.empty())
+		return {};
+
+	btConvexHullComputer computer;
+	computer.compute(&points[0].x, sizeof(glm::vec3), (int)points.size(), 0.f, 0.f);
+
+	return sampleSupportPoints(computer.vertices, maxVertices);
+}
+
+CookedCollider cookCollider(const std::vector<Vertex>& verticies, const CookingSettings& settings) {
+	CookedCollider cooked;
+	cooked.hash = hashCookingInput(verticies, settings);
+
+	if(verticies.empty())
+		return cooked;
+
+	if(!settings.decompose || verticies.size() < 3){
+		std::vector<glm::vec3> points;
+		points.reserve(verticies.size());
+		for(const Vertex& vertex : verticies) {
+			points.push_back(vertex.pos);
+		}
+
+		cooked.hulls.push_back(simplifyHull(points, settings.maxHullVertices));
+		return cooked;
+	}
+
+	// Concavity is relative to the size of the mesh
+	glm::vec3 min = verticies[0].pos;
+	glm::vec3 max = min;
+	for(const Vertex& vertex : verticies) {
+		min = glm::min(min, vertex.pos);
+		max = glm::max(max, vertex.pos);
+	}
+	const float maxConcavity = settings.concavityThreshold * std::max(glm::length(max - min), 1e-6f);
+
+	std::vector<Part> parts(1);
+	for(size_t i = 0; i + 2 < verticies.size(); i += 3) {
+		parts[0].triangles.push_back({ verticies[i].pos, verticies[i+1].pos, verticies[i+2].pos });
+	}
+	evaluatePart(parts[0], settings);
+
+	// Split the most concave part until everything is "convex enough" or out of hulls
+	while(parts.size() < settings.maxHulls) {
+		size_t worst = 0;
+		for(size_t i = 1; i < parts.size(); i++) {
+			if(parts[i].concavity > parts[worst].concavity)
+				worst = i;
+		}
+
+		if(parts[worst].concavity <= maxConcavity || parts[worst].triangles.size() < 2)
+			break;
+
+		Part left;
+		Part right;
+		splitPart(parts[worst], left, right);
+		evaluatePart(left, settings);
+		evaluatePart(right, settings);
+
+		parts[worst] = std::move(left);
+		parts.push_back(std::move(right));
+	}
+
+	for(Part& part : parts) {
+		if(!part.hull.empty())
+			cooked.hulls.push_back(std::move(part.hull));
+	}
+
+	return cooked;
+}
+
+CookedCollider cookCollider(const std::vector<Vertex>& verticies, const CookingSettings& settings, const std::string& cachePath) {
+	CookedCollider cooked;
+	if(loadCookedCollider(cachePath, hashCookingInput(verticies, settings), cooked))
+		return cooked;
+
+	cooked = cookCollider(verticies, settings);
+	if(!saveCookedCollider(cachePath, cooked))
+		std::cerr << "cookCollider(): Unable to write cooked collider to \"" << cachePath << "\"\n";
+
+	return cooked;
+}
+
+bool saveCookedCollider(const std::string& path, const CookedCollider& cooked) {
+	std::ofstream file(path, std::ios::binary);
+	if(!file.is_open())
+		return false;
+
+	const uint32_t hullCount = cooked.hulls.size();
+	file.write(COOKED_MAGIC, sizeof(COOKED_MAGIC));
+	file.write(reinterpret_cast<const char*>(&COOKED_VERSION), sizeof(COOKED_VERSION));
+	file.write(reinterpret_cast<const char*>(&cooked.hash), sizeof(cooked.hash));
+	file.write(reinterpret_cast<const char*>(&hullCount), sizeof(hullCount));
+
+	for(const std::vector<glm::vec3>& hull : cooked.hulls) {
+		const uint32_t pointCount = hull.size();
+		file.write(reinterpret_cast<const char*>(&pointCount), sizeof(pointCount));
+		file.write(reinterpret_cast<const char*>(hull.data()), pointCount * sizeof(glm::vec3));
+	}
+
+	return file.good();
+}
+
+bool loadCookedCollider(const std::string& path, const uint64_t hash, CookedCollider& cooked) {
+	std::ifstream file(path, std::ios::binary);
+	if(!file.is_open())
+		return false;
+
+	char magic[4];
+	uint32_t version;
+	uint64_t fileHash;
+	uint32_t hullCount;
+	file.read(magic, sizeof(magic));
+	file.read(reinterpret_cast<char*>(&version), sizeof(version));
+	file.read(reinterpret_cast<char*>(&fileHash), sizeof(fileHash));
+	file.read(reinterpret_cast<char*>(&hullCount), sizeof(hullCount));
+
+	if(!file || std::memcmp(magic, COOKED_MAGIC, sizeof(magic)) != 0 || version != COOKED_VERSION || fileHash != hash)
+		return false;
+
+	// Every hull needs at least its point count, so a truncated or corrupt file can't size the allocations
+	std::streamoff remaining = remainingBytes(file);
+	if((std::streamoff)hullCount * (std::streamoff)sizeof(uint32_t) > remaining)
+		return false;
+
+	std::vector<std::vector<glm::vec3>> hulls(hullCount);
+	for(std::vector<glm::vec3>& hull : hulls) {
+		uint32_t pointCount;
+		file.read(reinterpret_cast<char*>(&pointCount), sizeof(pointCount));
+		if(!file)
+			return false;
+
+		remaining -= sizeof(pointCount);
+		const std::streamoff hullSize = (std::streamoff)pointCount * (std::streamoff)sizeof(glm::vec3);
+		if(hullSize > remaining)
+			return false;
+		remaining -= hullSize;
+
+		hull.resize(pointCount);
+		file.read(reinterpret_cast<char*>(hull.data()), pointCount * sizeof(glm::vec3));
+		if(!file)
+			return false;
+	}
+
+	cooked.hash = fileHash;
+	cooked.hulls = std::move(hulls);
+
+	return true;
+}
+
+btCollisionShape* createCookedShape(const CookedCollider& cooked) {
+	if(cooked.hulls.empty())
+		throw std::runtime_error("createCookedShape(): Cooked collider has no hulls");
+
+	std::vector<btCollisionShape*> shapes;
+	std::vector<btTransform> transforms;
+	for(const std::vector<glm::vec3>& hull : cooked.hulls) {
+		btConvexHullShape* shape = new btConvexHullShape();
+		for(const glm::vec3& point : hull) {
+			shape->addPoint(btVector3(point.x, point.y, point.z), false);
+		}
+		shape->recalcLocalAabb();
+
+		shapes.push_back(shape);
+		transforms.push_back(btTransform::getIdentity());
+	}
+
+	if(shapes.size() == 1)
+		return shapes[0];
+
+	return createCollisionShapeCompound(shapes, transforms, shapes.size(), true);
+}
+
+btBvhTriangleMeshShape* createCachedTriangleMesh(const std::vector<Vertex>& verticies, const std::string& cachePath) {
+	const uint64_t hash = hashValue(hashVertexPositions(verticies), BVH_VERSION);
+
+	btBvhTriangleMeshShape* shape = loadTriangleMesh(cachePath, hash);
+	if(shape)
+		return shape;
+
+	std::vector<glm::vec3> points;
+	points.reserve(verticies.size());
+	for(const Vertex& vertex : verticies) {
+		points.push_back(vertex.pos);
+	}
+
+	shape = new btBvhTriangleMeshShape(createTriangleMesh(points), true);
+	if(!saveTriangleMesh(cachePath, hash, points, shape))
+		std::cerr << "createCachedTriangleMesh(): Unable to write cooked BVH to \"" << cachePath << "\"\n";
+
+	return shape;
+}
@@ -1,15 +1,8 @@
+#include <stdexcept>
 #include <iostream>
 
 #include "include/Collision.h"
-
-Collider* createMeshCollider(const std::vector<Vertex>& verticies, const bool& convex, const short& tag) {
-	Collider* collider = new Collider();
-	collider->collider = createCollisionMesh(verticies, convex);
-	collider->mesh = new Mesh(verticies, {}, {}, "collider");
-	collider->tag = tag;
-
-	return collider;
-}
+#include "include/ColliderCooker.h"
 
 Collider* createShapeCollider(std::vector<btCollisionShape*> shapes, std::vector<btTransform> shapeTransforms, int count, bool dynamicAABBTree, const short& tag) {
 	Collider* collider = new Collider();
@@ -49,12 +42,18 @@ btCollisionShape* createCollisionMesh(const std::vector<Vertex>& verticies, cons
 	btCollisionShape* shape;
 
 	if(convex){
+		// Narrowphase cost grows with the hull's vertex count, so only its bounded support points are kept
+		std::vector<glm::vec3> points;
+		points.reserve(verticies.size());
+		for(const Vertex& vertex : verticies) {
+			points.push_back(vertex.pos);
+		}
+
 		shape = new btConvexHullShape();
-		for(int i = 0; i < verticies.size(); i++) {
-			Vertex vertex = verticies[i];
-			btVector3 pos = btVector3(vertex.pos.x, vertex.pos.y, vertex.pos.z);
-			((btConvexHullShape*)shape)->addPoint(pos);
+		for(const glm::vec3& point : simplifyHull(points, CookingSettings().maxHullVertices)) {
+			((btConvexHullShape*)shape)->addPoint(btVector3(point.x, point.y, point.z), false);
 		}
+		((btConvexHullShape*)shape)->recalcLocalAabb();
 	} else {
 		btTriangleMesh* mesh = new btTriangleMesh();
 		for(int i = 0; i < verticies.size(); i+=3) {
@@ -0,0 +1,36 @@
+#include "include/PhysicsRender.h"
+#include "include/PhysicsProfiler.hpp"
+#include "include/PhysicsDrawer.hpp"
+#include "include/CameraBuffer.hpp"
+#include "include/Collision.h"
+#include "include/Mesh.hpp"
+#include "include/UI.hpp"
+
+btIDebugDraw* createPhysicsDrawer() {
+	return new PhysicsDrawer();
+}
+
+void drawPhysicsWorld(btIDebugDraw* drawer, btDiscreteDynamicsWorld* world, const CameraData& camera) {
+	static_cast<PhysicsDrawer*>(drawer)->drawWorld(world, camera);
+}
+
+void PhysicsProfiler::attachOverlay(UI& ui, const glm::vec2& pos, const float scale) {
+	std::unique_ptr<Text> text = std::make_unique<Text>(getSummary(), pos, glm::vec3(1.f, 1.f, 0.f), scale);
+	Text* element = text.get();
+	if(ui.addTextElement(std::move(text)))
+		overlayText = &element->text;
+}
+
+Collider::~Collider() {
+	delete collider;
+	delete mesh;
+}
+
+Collider* createMeshCollider(const std::vector<Vertex>& verticies, const bool& convex, const short& tag) {
+	Collider* collider = new Collider();
+	collider->collider = createCollisionMesh(verticies, convex);
+	collider->mesh = new Mesh(verticies, {}, {}, "collider");
+	collider->tag = tag;
+
+	return collider;
+}
@@ -0,0 +1,332 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../include/SceneBVH.hpp"
+#include "../include/OcclusionCuller.hpp"
+#include "../include/Frustum.hpp"
+#include "../include/Bounds.hpp"
+#include "../include/Util.hpp"
+
+///
+/// Headless culling benchmark, times frustum and occlusion culling of a large scene without a window or GL context
+///
+/// Usage: culling_bench [--count N] [--frames N] [--moving F] [--size F] [--seed N]
+///
+/// Boxes are scattered over a `size` square with a camera turning in the middle. Each frame `moving` of them
+/// (a fraction) drift, then the scene is culled two ways:
+///   linear  every box is re-added to a FrustumCuller and tested 4 at a time, what RenderQueue does per mesh
+///   bvh     moved boxes are refit in a SceneBVH and the tree is culled hierarchically, what GraphicsSystem does
+///   occl    the bvh path with a hilly terrain mesh rasterized into an OcclusionCuller and every box in the frustum
+///           tested against it, what GraphicsSystem does with occlusion on. Its time includes rasterizing the hills
+/// The bvh path counts a few more boxes visible, its leaves are enlarged by the tree's margin
+/// Without --count, it runs 10k and 100k boxes
+/// Before timing, it checks the occlusion culler hides a box behind a ridge and keeps one above it visible, and exits
+/// with 1 if it doesn't
+///
+
+struct BenchSettings {
+	std::vector<int> counts = { 10000, 100000 };
+	int frames = 300;
+	float moving = 0.1f;	// Fraction of boxes that move each frame
+	float size = 2000.f;	// Side of the square the boxes are scattered over
+	unsigned int seed = 1;
+};
+
+struct FrameStats {
+	double mean = 0.0;
+	double p50 = 0.0;
+	double p99 = 0.0;
+	double max = 0.0;
+};
+
+BenchSettings parseCmdArgs(int& argc, char** argv) {
+	Util::CMDParser cmdArgs(argc, argv);
+	BenchSettings settings;
+
+	std::string_view option = cmdArgs.getOption(std::pair(std::string_view("--count"), std::string_view("-n")));
+	if(option.compare("") != 0)
+		settings.counts = { std::max(std::stoi(option.data()), 1) };
+
+	option = cmdArgs.getOption("--frames");
+	if(option.compare("") != 0)
+		settings.frames = std::max(std::stoi(option.data()), 1);
+
+	option = cmdArgs.getOption("--moving");
+	if(option.compare("") != 0)
+		settings.moving = std::clamp(std::stof(option.data()), 0.f, 1.f);
+
+	option = cmdArgs.getOption("--size");
+	if(option.compare("") != 0)
+		settings.size = std::max(std::stof(option.data()), 1.f);
+
+	option = cmdArgs.getOption("--seed");
+	if(option.compare("") != 0)
+		settings.seed = std::stoul(option.data());
+
+	return settings;
+}
+
+FrameStats computeStats(std::vector<double> times) {
+	FrameStats stats;
+	if(times.empty())
+		return stats;
+
+	std::sort(times.begin(), times.end());
+	auto percentile = [&](const double p) {
+		return times[std::min((size_t)(p * (times.size() - 1) + 0.5), times.size() - 1)];
+	};
+
+	for(const double time : times) {
+		stats.mean += time;
+	}
+	stats.mean /= times.size();
+	stats.p50 = percentile(0.5);
+	stats.p99 = percentile(0.99);
+	stats.max = times.back();
+
+	return stats;
+}
+
+/**
+ * @brief A box drifting in a straight line
+*/
+struct Object {
+	glm::vec3 center;
+	glm::vec3 extents;
+	glm::vec3 velocity;
+
+	BoundingBox bounds() const {
+		return BoundingBox(center - extents, center + extents);
+	}
+};
+
+/**
+ * @brief Returns the view projection of a camera in the middle of the scene, turning a little every frame
+*/
+glm::mat4 cameraViewProjection(const int frame) {
+	const float yaw = glm::radians(frame * 1.5f);
+	const glm::vec3 eye = glm::vec3(0.f, 20.f, 0.f);
+	const glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(std::cos(yaw), -0.1f, std::sin(yaw)), glm::vec3(0.f, 1.f, 0.f));
+	const glm::mat4 projection = glm::perspective(glm::radians(60.f), 640.f / 480.f, 0.1f, 1000.f);
+
+	return projection * view;
+}
+/**
+ * @brief Returns the frustum of cameraViewProjection()
+*/
+Frustum cameraFrustum(const int frame) {
+	return Frustum(cameraViewProjection(frame));
+}
+
+/**
+ * @brief An occluder mesh of rolling hills over a `size` square, low around the camera so it starts above them
+*/
+struct Hills {
+	static const int RESOLUTION = 64;	// Quads along each side
+
+	std::vector<glm::vec3> vertices;
+	std::vector<uint32_t> indices;
+
+	Hills(const float size) {
+		for(int z = 0; z <= RESOLUTION; z++) {
+			for(int x = 0; x <= RESOLUTION; x++) {
+				const float positionX = (x / (float)RESOLUTION - 0.5f) * size;
+				const float positionZ = (z / (float)RESOLUTION - 0.5f) * size;
+				vertices.push_back(glm::vec3(positionX, 30.f * std::sin(positionX / 90.f) * std::sin(positionZ / 110.f), positionZ));
+			}
+		}
+
+		const uint32_t row = RESOLUTION + 1;
+		for(uint32_t z = 0; z < RESOLUTION; z++) {
+			for(uint32_t x = 0; x < RESOLUTION; x++) {
+				const uint32_t corner = z * row + x;
+				indices.insert(indices.end(), { corner, corner + row, corner + 1, corner + 1, corner + row, corner + row + 1 });
+			}
+		}
+	}
+};
+
+/**
+ * @brief Checks the occlusion culler against a ridge in front of the camera
+ * @return If a box behind the ridge is hidden while boxes above and in front of it are visible
+*/
+bool checkOcclusion() {
+	// A ridge across the view, its crest 40 high and 50 in front of the camera
+	const std::vector<glm::vec3> ridge = {
+		glm::vec3(-200.f, 0.f, -40.f), glm::vec3(200.f, 0.f, -40.f),
+		glm::vec3(-200.f, 40.f, -50.f), glm::vec3(200.f, 40.f, -50.f),
+		glm::vec3(-200.f, 0.f, -60.f), glm::vec3(200.f, 0.f, -60.f)
+	};
+	const std::vector<uint32_t> indices = { 0, 1, 2, 2, 1, 3, 2, 3, 4, 4, 3, 5 };
+
+	const glm::vec3 eye = glm::vec3(0.f, 5.f, 0.f);
+	const glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(0.f, 0.f, -1.f), glm::vec3(0.f, 1.f, 0.f));
+	const glm::mat4 projection = glm::perspective(glm::radians(60.f), 640.f / 480.f, 0.1f, 1000.f);
+
+	OcclusionCuller occlusion;
+	occlusion.begin(projection * view);
+	occlusion.addOccluder(ridge.data(), sizeof(glm::vec3), ridge.size(), indices.data(), indices.size());
+
+	struct Case {
+		const char* name;
+		BoundingBox box;
+		bool visible;
+	};
+	const Case cases[] = {
+		{ "behind the ridge", BoundingBox(glm::vec3(-2.f, 2.f, -82.f), glm::vec3(2.f, 6.f, -78.f)), false },
+		{ "above the ridge", BoundingBox(glm::vec3(-2.f, 80.f, -82.f), glm::vec3(2.f, 84.f, -78.f)), true },
+		{ "in front of the ridge", BoundingBox(glm::vec3(-2.f, 2.f, -22.f), glm::vec3(2.f, 6.f, -18.f)), true }
+	};
+
+	bool passed = true;
+	for(const Case& test : cases) {
+		if(occlusion.isVisible(test.box) != test.visible){
+			std::cerr << "culling_bench: occlusion check failed, the box " << test.name << " is " << (test.visible ? "hidden" : "visible") << '\n';
+			passed = false;
+		}
+	}
+
+	return passed;
+}
+
+void printResult(const std::string& name, const FrameStats& stats, const double visible) {
+	std::cout
+		<< "  " << std::left << std::setw(8) << name
+		<< " ms mean " << stats.mean
+		<< " p50 " << stats.p50
+		<< " p99 " << stats.p99
+		<< " max " << stats.max
+		<< " | visible " << visible;
+}
+
+/**
+ * @brief Builds a scene of `count` boxes and times both culling paths over it
+*/
+void runScene(const int count, const BenchSettings& settings) {
+	std::mt19937 random(settings.seed);
+	std::uniform_real_distribution<float> position(-settings.size / 2.f, settings.size / 2.f);
+	std::uniform_real_distribution<float> height(0.f, 50.f);
+	std::uniform_real_distribution<float> extent(0.25f, 2.f);
+	std::uniform_real_distribution<float> speed(-0.2f, 0.2f);
+
+	std::vector<Object> objects(count);
+	for(Object& object : objects) {
+		object.center = glm::vec3(position(random), height(random), position(random));
+		object.extents = glm::vec3(extent(random), extent(random), extent(random));
+		object.velocity = glm::vec3(speed(random), 0.f, speed(random));
+	}
+	const int moving = (int)(count * settings.moving);
+
+	// Both paths see the same motion, so they're run on copies
+	std::vector<Object> linearObjects = objects;
+	std::vector<Object> bvhObjects = objects;
+
+	// Linear
+	FrustumCuller culler;
+	std::vector<double> linearTimes;
+	double linearVisible = 0.0;
+	for(int frame = 0; frame < settings.frames; frame++) {
+		for(int i = 0; i < moving; i++) {
+			linearObjects[i].center += linearObjects[i].velocity;
+		}
+		const Frustum frustum = cameraFrustum(frame);
+
+		const auto start = std::chrono::steady_clock::now();
+		culler.clear();
+		for(const Object& object : linearObjects) {
+			culler.add(object.bounds());
+		}
+		const uint32_t visible = culler.cull(frustum);
+		linearTimes.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+		linearVisible += visible;
+	}
+
+	// BVH
+	SceneBVH bvh;
+	std::vector<int32_t> proxies(count);
+	const auto buildStart = std::chrono::steady_clock::now();
+	for(int i = 0; i < count; i++) {
+		proxies[i] = bvh.insert(bvhObjects[i].bounds(), i);
+	}
+	const double buildTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+
+	std::vector<double> bvhTimes;
+	double bvhVisible = 0.0;
+	double reinserts = 0.0;
+	for(int frame = 0; frame < settings.frames; frame++) {
+		for(int i = 0; i < moving; i++) {
+			bvhObjects[i].center += bvhObjects[i].velocity;
+		}
+		const Frustum frustum = cameraFrustum(frame);
+
+		const auto start = std::chrono::steady_clock::now();
+		for(int i = 0; i < moving; i++) {
+			reinserts += bvh.move(proxies[i], bvhObjects[i].bounds());
+		}
+		uint32_t visible = 0;
+		bvh.cull(frustum, [&](const uint32_t) { visible++; });
+		bvhTimes.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+		bvhVisible += visible;
+	}
+
+	// BVH with occlusion, on the bvh path's final positions so only the culling is timed
+	const Hills hills(settings.size);
+	OcclusionCuller occlusion;
+	std::vector<double> occlusionTimes;
+	double occlusionVisible = 0.0;
+	double rasterized = 0.0;
+	for(int frame = 0; frame < settings.frames; frame++) {
+		const auto start = std::chrono::steady_clock::now();
+		occlusion.begin(cameraViewProjection(frame));
+		occlusion.addOccluder(hills.vertices.data(), sizeof(glm::vec3), hills.vertices.size(), hills.indices.data(), hills.indices.size());
+		uint32_t visible = 0;
+		bvh.cull(cameraFrustum(frame), [&](const uint32_t object) {
+			visible += occlusion.isVisible(bvhObjects[object].bounds());
+		});
+		occlusionTimes.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+		occlusionVisible += visible;
+		rasterized += occlusion.getStats().rasterizedTriangles;
+	}
+
+	std::cout << std::fixed << std::setprecision(3)
+		<< count << " boxes, " << moving << " moving, " << settings.frames << " frames\n";
+	printResult("linear", computeStats(linearTimes), linearVisible / settings.frames);
+	std::cout << '\n';
+	printResult("bvh", computeStats(bvhTimes), bvhVisible / settings.frames);
+	std::cout
+		<< " | build ms " << buildTime
+		<< " height " << bvh.getHeight()
+		<< " reinserts/frame " << reinserts / settings.frames
+		<< '\n';
+	printResult("occl", computeStats(occlusionTimes), occlusionVisible / settings.frames);
+	std::cout
+		<< " | " << occlusion.getWidth() << "x" << occlusion.getHeight()
+		<< " triangles/frame " << rasterized / settings.frames << "/" << hills.indices.size() / 3
+		<< '\n';
+}
+
+int main(int argc, char** argv) {
+	const BenchSettings settings = parseCmdArgs(argc, argv);
+
+	if(!checkOcclusion())
+		return 1;
+	std::cout << "culling_bench: occlusion check passed\n";
+
+	std::cout << "culling_bench: " << settings.frames << " frames, " << settings.moving * 100.f << "% moving\n";
+	for(const int count : settings.counts) {
+		runScene(count, settings);
+	}
+
+	return 0;
+}
@@ -0,0 +1,498 @@
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <memory>
+#include <deque>
+
+#include "../include/PhysicsEngine.hpp"
+#include "../include/VehicleBatch.hpp"
+#include "../include/Heightmap.hpp"
+#include "../include/FileHandler.hpp"
+#include "../include/Util.hpp"
+
+///
+/// Headless physics benchmark, builds a scene and times fixed steps without a window or GL context
+///
+/// Usage: physics_bench [--scene spheres|boxes|stack|vehicles|spread|static|debris|all] [--count N] [--steps N]
+///                      [--heightmap path] [--warmup N] [--lod] [--profile [path]] [--no-pool]
+///                      [--broadphase dbvt|sweep|grid|all] [--cell-size F]
+///
+/// Each scene is run once per broadphase, the sweep broadphase is bounded by the scene's terrain
+///
+/// The debris scene replaces its oldest bodies every step, --no-pool allocates them on the heap instead of from
+/// the engine's BodyPool
+///
+/// --profile prints the average time of each physics phase, and logs every step to `path`(CSV, or JSON
+/// if it ends in ".json") with the scene and broadphase appended, eg. "profile.csv" -> "profile_boxes_dbvt.csv"
+///
+
+struct BenchSettings {
+	std::string scene = "all";
+	std::string heightmapPath = "../assets/heightmap.png";
+	int count = 500;	// Bodies(or vehicles) per scene
+	int steps = 600;	// Timed steps
+	int warmup = 60;	// Untimed steps before timing, lets bodies settle onto the terrain
+	bool lod = false;	// Simulate dynamic bodies with PhysicsLOD, viewed from the origin
+	bool pool = true;	// Spawn debris from the engine's BodyPool
+	bool profile = false;	// Break the timed steps down into phases with PhysicsProfiler
+	std::string profileLog = "";
+	std::vector<BroadphaseType> broadphases = { BroadphaseType::DBVT };
+	float cellSize = BroadphaseSettings().cellSize;	// Grid broadphase cell size
+};
+
+struct StepStats {
+	double mean = 0.0;
+	double p50 = 0.0;
+	double p90 = 0.0;
+	double p99 = 0.0;
+	double max = 0.0;
+};
+
+BenchSettings parseCmdArgs(int& argc, char** argv) {
+	Util::CMDParser cmdArgs(argc, argv);
+	BenchSettings settings;
+
+	std::string_view option = cmdArgs.getOption(std::pair(std::string_view("--scene"), std::string_view("-s")));
+	if(option.compare("") != 0)
+		settings.scene = std::string(option);
+
+	option = cmdArgs.getOption(std::pair(std::string_view("--count"), std::string_view("-n")));
+	if(option.compare("") != 0)
+		settings.count = std::max(std::stoi(option.data()), 1);
+
+	option = cmdArgs.getOption("--steps");
+	if(option.compare("") != 0)
+		settings.steps = std::max(std::stoi(option.data()), 1);
+
+	option = cmdArgs.getOption("--warmup");
+	if(option.compare("") != 0)
+		settings.warmup = std::max(std::stoi(option.data()), 0);
+
+	settings.lod = cmdArgs.hasOption("--lod");
+	settings.pool = !cmdArgs.hasOption("--no-pool");
+
+	// The log path is optional, a following option isn't one
+	settings.profile = cmdArgs.hasOption("--profile");
+	option = cmdArgs.getOption("--profile");
+	if(option.compare("") != 0 && option[0] != '-')
+		settings.profileLog = std::string(option);
+
+	option = cmdArgs.getOption("--broadphase");
+	if(option.compare("") != 0){
+		BroadphaseType type;
+		if(option.compare("all") == 0)
+			settings.broadphases = { BroadphaseType::DBVT, BroadphaseType::AXIS_SWEEP, BroadphaseType::GRID };
+		else if(parseBroadphaseType(std::string(option), type))
+			settings.broadphases = { type };
+		else
+			std::cerr << "Unknown broadphase \"" << option << "\", using dbvt\n";
+	}
+
+	option = cmdArgs.getOption("--cell-size");
+	if(option.compare("") != 0)
+		settings.cellSize = std::max(std::stof(option.data()), 0.01f);
+
+	option = cmdArgs.getOption("--heightmap");
+	if(option.compare("") != 0)
+		settings.heightmapPath = std::string(option);
+
+	return settings;
+}
+
+/**
+ * @brief Loads the heightmap's samples and builds its physics tiles, skipping the GL mesh and texture
+*/
+void loadHeightfield(Heightmap& heightmap, const std::string& path) {
+	int width;
+	int height;
+	int channels;
+	unsigned char* data = FileHandler::getRawImage(path, width, height, channels);
+	if(!data)
+		throw std::runtime_error("loadHeightfield(): Unable to load heightmap at \"" + path + "\"");
+
+	std::vector<unsigned char> samples(width * height);
+	for(int i = 0; i < width * height; i++) {
+		samples[i] = data[i * channels];
+	}
+	FileHandler::freeImage(data);
+
+	heightmap.setupPhysics(samples.data(), width, height, Heightmap::HEIGHT_SCALE, Heightmap::HEIGHT_OFFSET);
+}
+
+/**
+ * @brief Drops `count` bodies in a grid above the terrain
+*/
+void addBodies(PhysicsEngine& engine, const int count, const bool boxes) {
+	const int side = (int)std::ceil(std::sqrt((float)count));
+	for(int i = 0; i < count; i++) {
+		btCollisionShape* shape = boxes ?
+			engine.getShapeCache().getBox(btVector3(0.5f, 0.5f, 0.5f)) :
+			engine.getShapeCache().getSphere(0.5f);
+
+		btTransform transform;
+		transform.setIdentity();
+		transform.setOrigin(btVector3((i % side - side / 2) * 2.5f, 32.f + (i / (side * side)) * 2.5f, (i / side % side - side / 2) * 2.5f));
+
+		engine.addRigidBody(createRigidBody(shape, transform, 1.f), CollisionLayers::DYNAMIC);
+	}
+}
+
+/**
+ * @brief Gets the bounds of every heightfield tile
+*/
+void getTerrainExtent(Heightmap& heightmap, btVector3& extentMin, btVector3& extentMax) {
+	// Tiles are centered on the origin
+	extentMin.setValue(0.f, 0.f, 0.f);
+	extentMax.setValue(0.f, 0.f, 0.f);
+	for(const HeightfieldTile& tile : heightmap.getTiles()) {
+		btVector3 aabbMin;
+		btVector3 aabbMax;
+		tile.rigidBody->getAabb(aabbMin, aabbMax);
+		extentMin.setMin(aabbMin);
+		extentMax.setMax(aabbMax);
+	}
+}
+
+/**
+ * @brief Scatters `count` bodies over the whole heightfield, most of them far from the origin
+ * @param mass 0 for static props
+*/
+void addSpread(PhysicsEngine& engine, Heightmap& heightmap, const int count, const float mass = 1.f) {
+	btVector3 extentMin;
+	btVector3 extentMax;
+	getTerrainExtent(heightmap, extentMin, extentMax);
+
+	const int side = (int)std::ceil(std::sqrt((float)count));
+	const btVector3 spacing = (extentMax - extentMin) / (float)side;
+	for(int i = 0; i < count; i++) {
+		btCollisionShape* shape = (i % 2) ?
+			engine.getShapeCache().getBox(btVector3(0.5f, 0.5f, 0.5f)) :
+			engine.getShapeCache().getSphere(0.5f);
+
+		btTransform transform;
+		transform.setIdentity();
+		transform.setOrigin(btVector3(
+			extentMin.getX() + (i % side + 0.5f) * spacing.getX(),
+			extentMax.getY() + 4.f,
+			extentMin.getZ() + (i / side + 0.5f) * spacing.getZ()
+		));
+
+		engine.addRigidBody(createRigidBody(shape, transform, mass), (mass == 0.f) ? CollisionLayers::STATIC : CollisionLayers::DYNAMIC);
+	}
+}
+
+/**
+ * @brief Keeps `count` short lived bodies falling onto the terrain, replacing the oldest every step
+ * @details Every body lives for about a second, the same churn as debris from explosions or breakables
+*/
+class DebrisSpawner {
+	public:
+		DebrisSpawner(PhysicsEngine& engine, const int count, const bool pooled)
+			: engine(engine), count(count), perStep(std::max(count / 60, 1)), pooled(pooled) {}
+
+		void fill() {
+			while((int)live.size() < count) {
+				spawn();
+			}
+		}
+		/**
+		 * @brief Destroys the oldest bodies and spawns their replacements
+		*/
+		void step() {
+			for(int i = 0; i < perStep && !live.empty(); i++) {
+				engine.destroyRigidBody(live.front());
+				live.pop_front();
+			}
+
+			fill();
+		}
+	private:
+		void spawn() {
+			btCollisionShape* shape = (spawned % 2) ?
+				engine.getShapeCache().getBox(btVector3(0.25f, 0.25f, 0.25f)) :
+				engine.getShapeCache().getSphere(0.25f);
+
+			// Scattered over a 32x32 area, so bodies don't spawn inside the last few
+			btTransform transform;
+			transform.setIdentity();
+			transform.setOrigin(btVector3((float)(spawned * 7 % 64) * 0.5f - 16.f, 24.f, (float)(spawned * 13 % 64) * 0.5f - 16.f));
+
+			btRigidBody* body = pooled ? engine.getPool().createRigidBody(shape, transform, 0.1f) : createRigidBody(shape, transform, 0.1f);
+			engine.addRigidBody(body, CollisionLayers::DYNAMIC);
+			live.push_back(body);
+			spawned++;
+		}
+
+		PhysicsEngine& engine;
+		const int count;
+		const int perStep;
+		const bool pooled;
+
+		std::deque<btRigidBody*> live;	// Oldest first
+		uint64_t spawned = 0;
+};
+
+/**
+ * @brief Stacks boxes into 10 high towers on a static floor
+*/
+void addStacks(PhysicsEngine& engine, const int count) {
+	{	// Flat floor, so the towers start at rest
+		btTransform transform;
+		transform.setIdentity();
+		transform.setOrigin(btVector3(0.f, -1.f, 0.f));
+
+		engine.addRigidBody(createRigidBody(engine.getShapeCache().getBox(btVector3(100.f, 1.f, 100.f)), transform, 0.f), CollisionLayers::STATIC);
+	}
+
+	const int towerHeight = 10;
+	const int towers = (count + towerHeight - 1) / towerHeight;
+	const int side = (int)std::ceil(std::sqrt((float)towers));
+	for(int i = 0; i < count; i++) {
+		const int tower = i / towerHeight;
+
+		btTransform transform;
+		transform.setIdentity();
+		transform.setOrigin(btVector3((tower % side - side / 2) * 3.f, 0.5f + (i % towerHeight) * 1.001f, (tower / side - side / 2) * 3.f));
+
+		engine.addRigidBody(createRigidBody(engine.getShapeCache().getBox(btVector3(0.5f, 0.5f, 0.5f)), transform, 1.f), CollisionLayers::DYNAMIC);
+	}
+}
+
+/**
+ * @brief Adds `count` four wheeled raycast vehicles driving across the terrain
+ * @note The chassis are owned by `engine`, the vehicles by the caller
+*/
+void addVehicles(PhysicsEngine& engine, VehicleBatch& batch, const int count) {
+	const int side = (int)std::ceil(std::sqrt((float)count));
+	for(int i = 0; i < count; i++) {
+		btTransform transform;
+		transform.setIdentity();
+		transform.setOrigin(btVector3((i % side - side / 2) * 6.f, 24.f, (i / side - side / 2) * 8.f));
+
+		btRigidBody* chassis = createRigidBody(engine.getShapeCache().getBox(btVector3(1.f, 0.5f, 2.f)), transform, 800.f);
+		chassis->setActivationState(DISABLE_DEACTIVATION);
+		engine.addRigidBody(chassis, CollisionLayers::DYNAMIC);
+
+		btRaycastVehicle::btVehicleTuning tuning;
+		btRaycastVehicle* vehicle = new btRaycastVehicle(tuning, chassis, batch.getRaycaster());
+		vehicle->setCoordinateSystem(0, 1, 2);
+
+		for(int wheel = 0; wheel < 4; wheel++) {
+			const btVector3 connection((wheel % 2) ? 1.f : -1.f, 0.f, (wheel < 2) ? 1.5f : -1.5f);
+			vehicle->addWheel(connection, btVector3(0.f, -1.f, 0.f), btVector3(-1.f, 0.f, 0.f), 0.6f, 0.5f, tuning, wheel < 2);
+		}
+		for(int wheel = 0; wheel < 4; wheel++) {
+			vehicle->applyEngineForce(1000.f, wheel);
+		}
+
+		batch.add(vehicle);
+	}
+}
+
+int countActiveBodies(btDiscreteDynamicsWorld* world) {
+	int active = 0;
+	for(int i = 0; i < world->getNumCollisionObjects(); i++) {
+		const btCollisionObject* obj = world->getCollisionObjectArray()[i];
+		if(!obj->isStaticObject() && obj->isActive())
+			active++;
+	}
+
+	return active;
+}
+
+StepStats computeStats(std::vector<double> times) {
+	StepStats stats;
+	if(times.empty())
+		return stats;
+
+	std::sort(times.begin(), times.end());
+	auto percentile = [&](const double p) {
+		return times[std::min((size_t)(p * (times.size() - 1) + 0.5), times.size() - 1)];
+	};
+
+	for(const double time : times) {
+		stats.mean += time;
+	}
+	stats.mean /= times.size();
+	stats.p50 = percentile(0.5);
+	stats.p90 = percentile(0.9);
+	stats.p99 = percentile(0.99);
+	stats.max = times.back();
+
+	return stats;
+}
+
+/**
+ * @brief Builds a scene in a fresh world, steps it and prints the results
+*/
+void runScene(const std::string& scene, const BroadphaseType broadphaseType, const BenchSettings& settings) {
+	// Declared before the engine, the tiles reference its samples until the engine deletes them
+	Heightmap heightmap;
+
+	const bool onTerrain = scene != "stack";
+	BroadphaseSettings broadphase;
+	broadphase.type = broadphaseType;
+	broadphase.cellSize = settings.cellSize;
+	if(onTerrain){
+		loadHeightfield(heightmap, settings.heightmapPath);
+
+		// Bodies are dropped from above the terrain
+		getTerrainExtent(heightmap, broadphase.worldMin, broadphase.worldMax);
+		broadphase.worldMin -= btVector3(8.f, 8.f, 8.f);
+		broadphase.worldMax += btVector3(8.f, 64.f, 8.f);
+	} else {
+		broadphase.worldMin = btVector3(-128.f, -8.f, -128.f);
+		broadphase.worldMax = btVector3(128.f, 128.f, 128.f);
+	}
+
+	PhysicsEngine engine(broadphase);
+	engine.init(false);
+
+	engine.getLOD().setViewer(glm::vec3(0.f, 0.f, 0.f));
+	if(onTerrain){
+		for(HeightfieldTile& tile : heightmap.getTiles()) {
+			engine.addRigidBody(tile.rigidBody, CollisionLayers::STATIC);
+		}
+	}
+
+	VehicleBatch vehicles(engine.getDynamicsWorld());
+	engine.getDynamicsWorld()->addAction(&vehicles);
+
+	std::unique_ptr<DebrisSpawner> debris;
+	if(scene == "spheres")
+		addBodies(engine, settings.count, false);
+	else if(scene == "boxes")
+		addBodies(engine, settings.count, true);
+	else if(scene == "stack")
+		addStacks(engine, settings.count);
+	else if(scene == "vehicles")
+		addVehicles(engine, vehicles, settings.count);
+	else if(scene == "spread")
+		addSpread(engine, heightmap, settings.count);
+	else if(scene == "static"){
+		// Mostly static world, a few bodies falling between the props
+		addSpread(engine, heightmap, settings.count, 0.f);
+		addBodies(engine, std::max(settings.count / 20, 1), false);
+	}
+	else if(scene == "debris")
+		debris = std::make_unique<DebrisSpawner>(engine, settings.count, settings.pool);
+	else
+		throw std::runtime_error("runScene(): Unknown scene \"" + scene + "\"");
+
+	btDiscreteDynamicsWorld* world = engine.getDynamicsWorld();
+	if(settings.lod){
+		for(int i = 0; i < world->getNumCollisionObjects(); i++) {
+			engine.getLOD().add(btRigidBody::upcast(world->getCollisionObjectArray()[i]));
+		}
+	}
+
+	const float timeStep = 1.f / 60.f;
+
+	if(debris)
+		debris->fill();
+
+	for(int i = 0; i < settings.warmup; i++) {
+		if(debris)
+			debris->step();
+		world->stepSimulation(timeStep, 0);
+	}
+
+	// Profiling only covers the timed steps
+	PhysicsProfiler& profiler = engine.getProfiler();
+	if(settings.profile){
+		profiler.setEnabled(true);
+		if(settings.profileLog.compare("") != 0){
+			std::string path = settings.profileLog;
+			const size_t extension = path.find_last_of('.');
+			const size_t insertAt = (extension == std::string::npos || extension < path.find_last_of("/\\") + 1) ? path.size() : extension;
+			profiler.openLog(path.insert(insertAt, "_" + scene + "_" + toString(broadphaseType)));
+		}
+	}
+
+	std::vector<double> times;
+	PhysicsProfileSample phaseSum;
+	times.reserve(settings.steps);
+	for(int i = 0; i < settings.steps; i++) {
+		profiler.beginTick();
+		const auto start = std::chrono::steady_clock::now();
+		if(debris)
+			debris->step();	// Timed with the step, churn is what the scene measures
+		world->stepSimulation(timeStep, 0);	// Exactly one substep, so each sample is one simulation step
+		times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		profiler.endTick(world, 1);	// Counting bodies and pairs is left out of the timed step
+
+		if(settings.profile){
+			for(size_t phase = 0; phase < phaseSum.phases.size(); phase++) {
+				phaseSum.phases[phase] += profiler.getLast().phases[phase];
+			}
+		}
+	}
+	profiler.closeLog();
+
+	const StepStats stats = computeStats(times);
+	std::cout
+		<< std::fixed << std::setprecision(3)
+		<< std::left << std::setw(10) << scene
+		<< std::setw(6) << toString(broadphaseType)
+		<< " bodies " << world->getNumCollisionObjects()
+		<< " active " << countActiveBodies(world)
+		<< " islands " << PhysicsProfiler::countIslands(world)
+		<< " manifolds " << world->getDispatcher()->getNumManifolds()
+		<< " | step ms mean " << stats.mean
+		<< " p50 " << stats.p50
+		<< " p90 " << stats.p90
+		<< " p99 " << stats.p99
+		<< " max " << stats.max;
+	if(settings.lod){
+		std::cout
+			<< " | tiers full " << engine.getLOD().count(PhysicsTier::FULL)
+			<< " reduced " << engine.getLOD().count(PhysicsTier::REDUCED)
+			<< " frozen " << engine.getLOD().count(PhysicsTier::FROZEN);
+	}
+	if(settings.profile){
+		const auto& phases = phaseSum.phases;
+		std::cout
+			<< "\n                 phase ms mean"
+			<< " broadphase " << phases[(size_t)PhysicsPhase::BROADPHASE] / settings.steps
+			<< " narrowphase " << phases[(size_t)PhysicsPhase::NARROWPHASE] / settings.steps
+			<< " solver " << phases[(size_t)PhysicsPhase::SOLVER] / settings.steps
+			<< " integration " << phases[(size_t)PhysicsPhase::INTEGRATION] / settings.steps
+			<< " sync " << phases[(size_t)PhysicsPhase::SYNC] / settings.steps
+			<< " actions " << phases[(size_t)PhysicsPhase::ACTIONS] / settings.steps;
+	}
+	std::cout << '\n';
+
+	// Vehicles aren't owned by the engine
+	world->removeAction(&vehicles);
+	for(btRaycastVehicle* vehicle : vehicles.getVehicles()) {
+		delete vehicle;
+	}
+}
+
+int main(int argc, char** argv) {
+	const BenchSettings settings = parseCmdArgs(argc, argv);
+
+	std::vector<std::string> scenes;
+	if(settings.scene == "all")
+		scenes = { "spheres", "boxes", "stack", "vehicles", "spread", "static", "debris" };
+	else
+		scenes = { settings.scene };
+
+	std::cout << "physics_bench: " << settings.count << " per scene, " << settings.steps << " steps(" << settings.warmup << " warmup)" << (settings.lod ? ", LOD on" : "") << (settings.pool ? "" : ", heap debris") << '\n';
+	try {
+		for(const std::string& scene : scenes) {
+			for(const BroadphaseType broadphase : settings.broadphases) {
+				runScene(scene, broadphase, settings);
+			}
+		}
+	} catch(const std::exception& e) {
+		std::cerr << e.what() << '\n';
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <limits>
+
+/**
+ * @brief Axis aligned bounding box, empty until a point is added
+*/
+struct BoundingBox {
+	glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+	glm::vec3 max = glm::vec3(std::numeric_limits<float>::lowest());
+
+	BoundingBox() = default;
+	BoundingBox(const glm::vec3& min, const glm::vec3& max) : min(min), max(max) {}
+
+	void expand(const glm::vec3& point) {
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+	void expand(const BoundingBox& box) {
+		if(!box.valid())
+			return;
+
+		min = glm::min(min, box.min);
+		max = glm::max(max, box.max);
+	}
+	/**
+	 * @brief Returns if anything was added
+	*/
+	bool valid() const {
+		return min.x <= max.x && min.y <= max.y && min.z <= max.z;
+	}
+	glm::vec3 center() const {
+		return (min + max) * 0.5f;
+	}
+	/**
+	 * @brief Returns the half size on each axis
+	*/
+	glm::vec3 extents() const {
+		return (max - min) * 0.5f;
+	}
+	/**
+	 * @brief Returns the box enclosing this box after a transform(Arvo), exact for rotations of the box, loose otherwise
+	*/
+	BoundingBox transformed(const glm::mat4& transform) const {
+		if(!valid())
+			return BoundingBox();
+
+		const glm::vec3 center = glm::vec3(transform * glm::vec4(this->center(), 1.f));
+		const glm::vec3 extents = this->extents();
+
+		// Each world axis' extent is the box's extents projected onto it
+		glm::vec3 worldExtents(0.f);
+		for(int column = 0; column < 3; column++) {
+			worldExtents += glm::abs(glm::vec3(transform[column])) * extents[column];
+		}
+
+		return BoundingBox(center - worldExtents, center + worldExtents);
+	}
+};
+
+struct BoundingSphere {
+	glm::vec3 center = glm::vec3(0.f);
+	float radius = 0.f;
+};
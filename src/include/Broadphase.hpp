@@ -0,0 +1,352 @@
+#pragma once
+
+#include <bullet/btBulletDynamicsCommon.h>
+#include <bullet/BulletCollision/BroadphaseCollision/btAxisSweep3.h>
+#include <bullet/LinearMath/btAabbUtil2.h>
+
+#include <unordered_map>
+#include <algorithm>
+#include <iostream>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <cmath>
+
+/**
+ * @brief Broadphase algorithms the physics world can be created with
+*/
+enum class BroadphaseType : uint8_t {
+	DBVT,		// Dynamic AABB trees, good all round and the default
+	AXIS_SWEEP,	// Sweep and prune inside fixed world bounds, good for mostly static worlds
+	GRID		// Uniform grid, good for dense crowds of similarly sized bodies
+};
+
+/**
+ * @brief Broadphase configuration, pick per level with physics_bench
+*/
+struct BroadphaseSettings {
+	BroadphaseType type = BroadphaseType::DBVT;
+
+	// AXIS_SWEEP: Bodies outside of the bounds still collide, but are all clamped to the edge and tested together
+	btVector3 worldMin = btVector3(-1024.f, -256.f, -1024.f);
+	btVector3 worldMax = btVector3(1024.f, 512.f, 1024.f);
+	unsigned int maxProxies = 16384;	// AXIS_SWEEP: Over 16384 uses 32 bit handles
+
+	// GRID
+	float cellSize = 4.f;				// Should be a little larger than the typical dynamic body
+	unsigned int maxCellsPerProxy = 64;	// Bodies covering more cells(eg. terrain) are tested against everything instead
+};
+
+/**
+ * @brief Uniform grid broadphase, each proxy is stored in every cell its AABB covers
+ * @details Only proxies whose AABB changed are tested, against the proxies sharing their cells. Proxies covering more than
+ * @details `maxCellsPerProxy` cells are kept in a separate list tested against every moved proxy, so a few large
+ * @details static bodies don't fill thousands of cells
+ * @note Rays and AABB queries test every proxy's AABB, the grid only accelerates pair finding
+*/
+class GridBroadphase : public btBroadphaseInterface {
+	public:
+		GridBroadphase(const float cellSize = 4.f, const unsigned int maxCellsPerProxy = 64)
+			: cellSize(std::max(cellSize, 0.01f)), maxCellsPerProxy(std::max(maxCellsPerProxy, 1u)), pairCache(new btHashedOverlappingPairCache()) {}
+		~GridBroadphase() {
+			for(GridProxy* proxy : proxies) {
+				delete proxy;
+			}
+			delete pairCache;
+		}
+		GridBroadphase(const GridBroadphase&) = delete;
+		GridBroadphase& operator=(const GridBroadphase&) = delete;
+
+		btBroadphaseProxy* createProxy(const btVector3& aabbMin, const btVector3& aabbMax, int shapeType, void* userPtr, int collisionFilterGroup, int collisionFilterMask, btDispatcher* dispatcher) override {
+			GridProxy* proxy = new GridProxy(aabbMin, aabbMax, userPtr, collisionFilterGroup, collisionFilterMask);
+			proxy->m_uniqueId = nextId++;
+			proxy->index = proxies.size();
+			proxies.push_back(proxy);
+
+			computeCells(proxy, proxy->cellMin, proxy->cellMax);
+			insert(proxy);
+			markMoved(proxy);
+
+			return proxy;
+		}
+		void destroyProxy(btBroadphaseProxy* proxyOrg, btDispatcher* dispatcher) override {
+			GridProxy* proxy = static_cast<GridProxy*>(proxyOrg);
+
+			erase(proxy);
+			pairCache->removeOverlappingPairsContainingProxy(proxy, dispatcher);
+			if(proxy->moved)
+				moved.erase(std::find(moved.begin(), moved.end(), proxy));
+
+			// Swap and pop
+			proxies[proxy->index] = proxies.back();
+			proxies[proxy->index]->index = proxy->index;
+			proxies.pop_back();
+
+			delete proxy;
+		}
+		void setAabb(btBroadphaseProxy* proxyOrg, const btVector3& aabbMin, const btVector3& aabbMax, btDispatcher* dispatcher) override {
+			GridProxy* proxy = static_cast<GridProxy*>(proxyOrg);
+			if(proxy->m_aabbMin == aabbMin && proxy->m_aabbMax == aabbMax)
+				return;	// The world updates every AABB each step, even sleeping ones
+
+			proxy->m_aabbMin = aabbMin;
+			proxy->m_aabbMax = aabbMax;
+			markMoved(proxy);
+
+			int cellMin[3];
+			int cellMax[3];
+			computeCells(proxy, cellMin, cellMax);
+			if(std::equal(cellMin, cellMin + 3, proxy->cellMin) && std::equal(cellMax, cellMax + 3, proxy->cellMax))
+				return;
+
+			erase(proxy);
+			std::copy(cellMin, cellMin + 3, proxy->cellMin);
+			std::copy(cellMax, cellMax + 3, proxy->cellMax);
+			insert(proxy);
+		}
+		void getAabb(btBroadphaseProxy* proxy, btVector3& aabbMin, btVector3& aabbMax) const override {
+			aabbMin = proxy->m_aabbMin;
+			aabbMax = proxy->m_aabbMax;
+		}
+		void rayTest(const btVector3& rayFrom, const btVector3& rayTo, btBroadphaseRayCallback& rayCallback, const btVector3& aabbMin = btVector3(0, 0, 0), const btVector3& aabbMax = btVector3(0, 0, 0)) override {
+			// Bounds of the ray, grown by the swept shape's AABB for convex casts
+			btVector3 rayMin = rayFrom;
+			btVector3 rayMax = rayFrom;
+			rayMin.setMin(rayTo);
+			rayMax.setMax(rayTo);
+			rayMin += aabbMin;
+			rayMax += aabbMax;
+
+			for(GridProxy* proxy : proxies) {
+				if(TestAabbAgainstAabb2(rayMin, rayMax, proxy->m_aabbMin, proxy->m_aabbMax))
+					rayCallback.process(proxy);
+			}
+		}
+		void aabbTest(const btVector3& aabbMin, const btVector3& aabbMax, btBroadphaseAabbCallback& callback) override {
+			for(GridProxy* proxy : proxies) {
+				if(TestAabbAgainstAabb2(aabbMin, aabbMax, proxy->m_aabbMin, proxy->m_aabbMax))
+					callback.process(proxy);
+			}
+		}
+		/**
+		 * @brief Removes pairs of moved proxies that stopped overlapping, then adds pairs for every moved proxy
+		*/
+		void calculateOverlappingPairs(btDispatcher* dispatcher) override {
+			btBroadphasePairArray& pairs = pairCache->getOverlappingPairArray();
+			for(int i = pairs.size() - 1; i >= 0; i--) {	// Backwards, removing swaps the last pair in
+				const btBroadphasePair& pair = pairs[i];
+				GridProxy* proxy0 = static_cast<GridProxy*>(pair.m_pProxy0);
+				GridProxy* proxy1 = static_cast<GridProxy*>(pair.m_pProxy1);
+
+				if((proxy0->moved || proxy1->moved) && !TestAabbAgainstAabb2(proxy0->m_aabbMin, proxy0->m_aabbMax, proxy1->m_aabbMin, proxy1->m_aabbMax))
+					pairCache->removeOverlappingPair(proxy0, proxy1, dispatcher);
+			}
+
+			for(GridProxy* proxy : moved) {
+				if(proxy->large){
+					// Tested against everything, including other large proxies
+					for(GridProxy* other : proxies) {
+						addPair(proxy, other);
+					}
+					continue;
+				}
+
+				forEachCell(proxy->cellMin, proxy->cellMax, [&](const uint64_t key) {
+					auto cell = cells.find(key);
+					if(cell == cells.end())
+						return;
+
+					for(GridProxy* other : cell->second) {
+						addPair(proxy, other);
+					}
+				});
+				for(GridProxy* other : large) {
+					addPair(proxy, other);
+				}
+			}
+
+			for(GridProxy* proxy : moved) {
+				proxy->moved = false;
+			}
+			moved.clear();
+		}
+		btOverlappingPairCache* getOverlappingPairCache() override {
+			return pairCache;
+		}
+		const btOverlappingPairCache* getOverlappingPairCache() const override {
+			return pairCache;
+		}
+		void getBroadphaseAabb(btVector3& aabbMin, btVector3& aabbMax) const override {
+			if(proxies.empty()){
+				aabbMin.setValue(-BT_LARGE_FLOAT, -BT_LARGE_FLOAT, -BT_LARGE_FLOAT);
+				aabbMax.setValue(BT_LARGE_FLOAT, BT_LARGE_FLOAT, BT_LARGE_FLOAT);
+				return;
+			}
+
+			aabbMin = proxies[0]->m_aabbMin;
+			aabbMax = proxies[0]->m_aabbMax;
+			for(const GridProxy* proxy : proxies) {
+				aabbMin.setMin(proxy->m_aabbMin);
+				aabbMax.setMax(proxy->m_aabbMax);
+			}
+		}
+		void printStats() override {
+			std::cout << "GridBroadphase: " << proxies.size() << " proxies, " << large.size() << " large, " << cells.size() << " cells\n";
+		}
+	private:
+		struct GridProxy : public btBroadphaseProxy {
+			GridProxy(const btVector3& aabbMin, const btVector3& aabbMax, void* userPtr, int collisionFilterGroup, int collisionFilterMask)
+				: btBroadphaseProxy(aabbMin, aabbMax, userPtr, collisionFilterGroup, collisionFilterMask) {}
+
+			int cellMin[3];
+			int cellMax[3];
+			size_t index = 0;		// Index in `proxies`
+			bool large = false;		// In `large` instead of the cells
+			bool moved = false;		// In `moved`
+		};
+
+		void markMoved(GridProxy* proxy) {
+			if(!proxy->moved){
+				proxy->moved = true;
+				moved.push_back(proxy);
+			}
+		}
+		void computeCells(const GridProxy* proxy, int* cellMin, int* cellMax) const {
+			for(int axis = 0; axis < 3; axis++) {
+				cellMin[axis] = toCell(proxy->m_aabbMin[axis]);
+				cellMax[axis] = toCell(proxy->m_aabbMax[axis]);
+			}
+		}
+		/**
+		 * @brief Returns the cell a coordinate is in, clamped to the range cellKey() keeps unique
+		 * @note Clamped before the cast, huge(eg. BT_LARGE_FLOAT) or NaN bounds would be undefined behaviour, those proxies end up in `large`
+		*/
+		int toCell(const btScalar value) const {
+			const double cell = std::floor((double)value / cellSize);
+			return (int)std::fmin(std::fmax(cell, -MAX_CELL), MAX_CELL);
+		}
+		/**
+		 * @brief Adds a proxy to every cell it covers, or to `large` if that's too many
+		*/
+		void insert(GridProxy* proxy) {
+			uint64_t cellCount = 1;
+			for(int axis = 0; axis < 3; axis++) {
+				cellCount *= (uint64_t)(proxy->cellMax[axis] - proxy->cellMin[axis] + 1);
+			}
+
+			proxy->large = cellCount > maxCellsPerProxy;
+			if(proxy->large){
+				large.push_back(proxy);
+				return;
+			}
+
+			forEachCell(proxy->cellMin, proxy->cellMax, [&](const uint64_t key) {
+				cells[key].push_back(proxy);
+			});
+		}
+		void erase(GridProxy* proxy) {
+			if(proxy->large){
+				large.erase(std::find(large.begin(), large.end(), proxy));
+				return;
+			}
+
+			forEachCell(proxy->cellMin, proxy->cellMax, [&](const uint64_t key) {
+				auto cell = cells.find(key);
+				if(cell == cells.end())
+					return;
+
+				std::vector<GridProxy*>& occupants = cell->second;
+				auto iter = std::find(occupants.begin(), occupants.end(), proxy);
+				if(iter != occupants.end()){
+					*iter = occupants.back();
+					occupants.pop_back();
+				}
+				if(occupants.empty())
+					cells.erase(cell);
+			});
+		}
+		template<class Func> void forEachCell(const int* cellMin, const int* cellMax, Func func) const {
+			for(int x = cellMin[0]; x <= cellMax[0]; x++) {
+				for(int y = cellMin[1]; y <= cellMax[1]; y++) {
+					for(int z = cellMin[2]; z <= cellMax[2]; z++) {
+						func(cellKey(x, y, z));
+					}
+				}
+			}
+		}
+		/**
+		 * @brief Packs a cell's coordinates into a key, unique within ±2^20 cells on each axis
+		*/
+		static uint64_t cellKey(const int x, const int y, const int z) {
+			const uint64_t mask = (1ull << 21) - 1;
+			return (((uint64_t)x & mask) << 42) | (((uint64_t)y & mask) << 21) | ((uint64_t)z & mask);
+		}
+		/**
+		 * @brief Adds a pair if the proxies overlap, the pair cache ignores pairs it already has or that are filtered out
+		*/
+		void addPair(GridProxy* proxy, GridProxy* other) {
+			if(proxy == other || !TestAabbAgainstAabb2(proxy->m_aabbMin, proxy->m_aabbMax, other->m_aabbMin, other->m_aabbMax))
+				return;
+
+			pairCache->addOverlappingPair(proxy, other);
+		}
+
+		static constexpr double MAX_CELL = (1 << 20) - 1;	// Furthest cell from the origin on each axis
+
+		float cellSize;
+		unsigned int maxCellsPerProxy;
+
+		btOverlappingPairCache* pairCache;
+		std::vector<GridProxy*> proxies;
+		std::vector<GridProxy*> large;	// Proxies covering too many cells
+		std::vector<GridProxy*> moved;	// Proxies whose AABB changed since the last pair update
+		std::unordered_map<uint64_t, std::vector<GridProxy*>> cells;
+
+		int nextId = 1;
+};
+
+/**
+ * @brief Creates the broadphase described by `settings`, the caller owns it
+*/
+inline btBroadphaseInterface* createBroadphase(const BroadphaseSettings& settings) {
+	switch(settings.type) {
+		case BroadphaseType::AXIS_SWEEP:
+			if(settings.maxProxies > 16384)
+				return new bt32BitAxisSweep3(settings.worldMin, settings.worldMax, settings.maxProxies);
+			return new btAxisSweep3(settings.worldMin, settings.worldMax, (unsigned short)settings.maxProxies);
+		case BroadphaseType::GRID:
+			return new GridBroadphase(settings.cellSize, settings.maxCellsPerProxy);
+		case BroadphaseType::DBVT:
+		default:
+			return new btDbvtBroadphase();
+	}
+}
+
+inline const char* toString(const BroadphaseType type) {
+	switch(type) {
+		case BroadphaseType::AXIS_SWEEP:
+			return "sweep";
+		case BroadphaseType::GRID:
+			return "grid";
+		case BroadphaseType::DBVT:
+		default:
+			return "dbvt";
+	}
+}
+
+/**
+ * @brief Parses "dbvt", "sweep" or "grid"
+ * @return If `name` is a broadphase type
+*/
+inline bool parseBroadphaseType(const std::string& name, BroadphaseType& type) {
+	if(name == "dbvt")
+		type = BroadphaseType::DBVT;
+	else if(name == "sweep")
+		type = BroadphaseType::AXIS_SWEEP;
+	else if(name == "grid")
+		type = BroadphaseType::GRID;
+	else
+		return false;
+
+	return true;
+}
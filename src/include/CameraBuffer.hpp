@@ -0,0 +1,95 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "Camera.hpp"
+
+/**
+ * @brief The camera's per-frame state, laid out as the std140 `Camera` uniform block
+ * @details Every member is 16 byte aligned, so the struct matches std140 without padding:
+ * @details layout(std140) uniform Camera { mat4 view; mat4 projection; mat4 viewProjection; vec4 position; vec4 viewport; };
+*/
+struct CameraData {
+	glm::mat4 view = glm::mat4(1.f);
+	glm::mat4 projection = glm::mat4(1.f);
+	glm::mat4 viewProjection = glm::mat4(1.f);
+	glm::vec4 position = glm::vec4(0.f, 0.f, 0.f, 1.f);	// World space, w is 1
+	glm::vec4 viewport = glm::vec4(0.f, 0.f, 640.f, 480.f);	// x, y, width, height in pixels
+};
+static_assert(sizeof(CameraData) == 3 * sizeof(glm::mat4) + 2 * sizeof(glm::vec4), "CameraData must match the std140 Camera block");
+
+/**
+ * @brief Uniform buffer holding the camera, computed once a frame and shared by every program
+ * @details Programs that declare the `Camera` block have it bound to BINDING when they're linked(BaseShader does this),
+ * @details so switching programs never re-uploads the camera, only the model matrix is set per draw
+ * @note The buffer is created on the first update, so it can be declared before the context exists
+*/
+class CameraBuffer {
+	public:
+		static const GLuint BINDING = 0;	// Uniform buffer binding point of the `Camera` block
+		static constexpr const char* BLOCK_NAME = "Camera";
+		static constexpr float NEAR_PLANE = 0.1f;
+		static constexpr float FAR_PLANE = 1000.f;
+
+		CameraBuffer() {}
+		~CameraBuffer() {
+			release();
+		}
+		CameraBuffer(const CameraBuffer&) = delete;
+		CameraBuffer& operator=(const CameraBuffer&) = delete;
+
+		/**
+		 * @brief Computes the camera's matrices for this frame and uploads them
+		 * @param camera The camera to view from
+		 * @param dimensions The window's size in pixels, sets the aspect ratio
+		*/
+		void update(Camera& camera, const glm::vec2& dimensions) {
+			const float aspect = (dimensions.y > 0.f) ? dimensions.x / dimensions.y : 1.f;
+
+			data.view = camera.calcCameraView();
+			data.projection = glm::perspective(glm::radians(camera.getFOV()), aspect, NEAR_PLANE, FAR_PLANE);
+			data.viewProjection = data.projection * data.view;
+			data.position = glm::vec4(camera.getPos(), 1.f);
+			data.viewport = glm::vec4(0.f, 0.f, dimensions.x, dimensions.y);
+
+			upload();
+		}
+		/**
+		 * @brief Uploads the current data and binds the buffer to BINDING
+		*/
+		void upload() {
+			if(ubo == 0){
+				glGenBuffers(1, &ubo);
+				glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+				glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraData), nullptr, GL_DYNAMIC_DRAW);
+			} else {
+				glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+			}
+
+			glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraData), &data);
+			glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, ubo);
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		}
+		/**
+		 * @brief Deletes the buffer
+		*/
+		void release() {
+			if(ubo == 0)
+				return;
+
+			glDeleteBuffers(1, &ubo);
+			ubo = 0;
+		}
+		/**
+		 * @brief Gets this frame's camera, valid on the CPU even before the first upload
+		*/
+		const CameraData& getData() const {
+			return data;
+		}
+	private:
+		CameraData data;
+		GLuint ubo = 0;
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <bullet/btBulletDynamicsCommon.h>
+#include <glm/vec3.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Vertex.hpp"
+
+/**
+ * @brief Settings used when cooking a collider
+ * @note Changing any of these changes the cooked collider's hash, invalidating cached files
+*/
+struct CookingSettings {
+	unsigned int maxHullVertices = 32;	// Upper bound on the number of vertices per hull
+	unsigned int maxHulls = 16;			// Upper bound on the number of hulls in a decomposition
+	float concavityThreshold = 0.02f;	// Parts deeper than this(relative to the mesh's size) are split further
+	bool decompose = true;				// If false, the whole mesh is reduced to a single hull
+};
+
+/**
+ * @brief Result of cooking a mesh, a set of convex hulls approximating it
+*/
+struct CookedCollider {
+	uint64_t hash = 0;	// Hash of the source vertices and settings
+	std::vector<std::vector<glm::vec3>> hulls;
+};
+
+/**
+ * @brief Hashes the positions of every vertex(FNV-1a)
+ * @param verticies The vertices to hash
+ * @param hash The starting hash, use to chain hashes together
+ * @return The 64 bit hash
+*/
+uint64_t hashVertexPositions(const std::vector<Vertex>& verticies, uint64_t hash = 14695981039346656037ull);
+
+/**
+ * @brief Reduces a point cloud to at most `maxVertices` points on its convex hull
+ * @details Computes the hull, then keeps the support point for `maxVertices` directions spread over a sphere
+ * @return The hull's vertices
+*/
+std::vector<glm::vec3> simplifyHull(const std::vector<glm::vec3>& points, const unsigned int maxVertices);
+
+/**
+ * @brief Cooks a mesh into a set of simplified convex hulls
+ * @param verticies Vector of Vertex structs, every 3 forming a triangle
+ * @param settings The cooking settings
+ * @details Recursively splits the part with the deepest concavity along its longest axis until every part is
+ * @details within `settings.concavityThreshold` or `settings.maxHulls` is reached
+*/
+CookedCollider cookCollider(const std::vector<Vertex>& verticies, const CookingSettings& settings = CookingSettings());
+
+/**
+ * @brief Cooks a mesh, using the cached file at `cachePath` if it matches the mesh and settings
+ * @note Writes the newly cooked collider to `cachePath` on a cache miss
+*/
+CookedCollider cookCollider(const std::vector<Vertex>& verticies, const CookingSettings& settings, const std::string& cachePath);
+
+/**
+ * @brief Writes a cooked collider to a file
+ * @return If writing succeeded
+*/
+bool saveCookedCollider(const std::string& path, const CookedCollider& cooked);
+
+/**
+ * @brief Reads a cooked collider from a file
+ * @param hash The expected hash, the file is rejected if it doesn't match
+ * @return If the file was read and matched `hash` and the current format version
+*/
+bool loadCookedCollider(const std::string& path, const uint64_t hash, CookedCollider& cooked);
+
+/**
+ * @brief Creates a collision shape from a cooked collider
+ * @return A btConvexHullShape for a single hull, otherwise a btCompoundShape of them
+ * @note Usable on dynamic bodies, unlike createCollisionMesh(..., false)
+*/
+btCollisionShape* createCookedShape(const CookedCollider& cooked);
+
+/**
+ * @brief Creates a static triangle mesh shape, loading its quantized BVH from `cachePath` instead of building it
+ * @param verticies Vector of Vertex structs, every 3 forming a triangle
+ * @param cachePath The cooked BVH file, usually next to the model
+ * @details On a cache miss, or a file from another format/Bullet version, the BVH is built and written to `cachePath`
+ * @note Same as createCollisionMesh(verticies, false), the shape must be static
+ * @note The triangle mesh isn't owned by the shape, delete `getMeshInterface()` after the shape
+*/
+btBvhTriangleMeshShape* createCachedTriangleMesh(const std::vector<Vertex>& verticies, const std::string& cachePath);
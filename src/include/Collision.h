@@ -4,10 +4,13 @@
 
 #include <vector>
 
-#include "Mesh.hpp"
+#include "Vertex.hpp"
+
+class Mesh;
 
 /**
  * @brief Collider struct, holds a rigidbody pointer and tag
+ * @note The destructor is in PhysicsRender.cpp, since it deletes the mesh
 */
 struct Collider {
 	btCollisionShape* collider;
@@ -15,10 +18,7 @@ struct Collider {
 
 	short tag;	// Can be used to determine the type of objects colliding
 
-	~Collider() {
-		delete collider;
-		delete mesh;
-	}
+	~Collider();
 };
 
 /**
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <btBulletCollisionCommon.h>
+#include <BulletWorldImporter/btBulletWorldImporter.h>
+
+#include <initializer_list>
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <array>
+
+/**
+ * @brief Named collision layers and a symmetric matrix of which layers collide with each other
+ * @details Each layer is one bit of Bullet's collision filter group and its row of the matrix is its filter mask,
+ * @details so pairs of layers that don't collide are rejected by the broadphase and never reach the narrowphase
+ * @details Bodies keep their layer in their second user index(see tag()), the first is the ECS entity
+*/
+class CollisionLayers {
+	public:
+		using Layer = uint8_t;
+
+		static const unsigned int MAX_LAYERS = 32;
+		static const Layer INVALID = 255;
+		static const int ALL = -1;	// Query mask hitting every layer
+
+		// Built-in layers
+		static const Layer DEFAULT = 0;
+		static const Layer STATIC = 1;
+		static const Layer DYNAMIC = 2;
+		static const Layer DEBRIS = 3;
+		static const Layer TRIGGER = 4;
+
+		/**
+		 * @brief Creates the built-in layers
+		 * @details Every layer collides except static-static, debris-debris, trigger-static and trigger-trigger
+		*/
+		CollisionLayers() {
+			collideMatrix.fill(0);
+
+			add("default");
+			add("static");
+			add("dynamic");
+			add("debris");
+			add("trigger");
+
+			setCollides(STATIC, STATIC, false);
+			setCollides(DEBRIS, DEBRIS, false);
+			setCollides(TRIGGER, STATIC, false);
+			setCollides(TRIGGER, TRIGGER, false);
+		}
+		/**
+		 * @brief Adds a new layer, which collides with every layer
+		 * @return The layer, the existing one if the name is taken, or INVALID if out of layers
+		*/
+		Layer add(const std::string& name) {
+			Layer existing = get(name);
+			if(existing != INVALID)
+				return existing;
+
+			if(count >= MAX_LAYERS){
+				std::cerr << "CollisionLayers::add(): Unable to add \"" << name << "\", reached maximum number of layers\n";
+				return INVALID;
+			}
+
+			const Layer layer = count++;
+			names[layer] = name;
+			for(Layer i = 0; i <= layer; i++) {
+				setCollides(layer, i, true);
+			}
+
+			return layer;
+		}
+		/**
+		 * @brief Gets a layer by name
+		 * @return The layer or INVALID if there is none with that name
+		*/
+		Layer get(const std::string& name) const {
+			for(Layer i = 0; i < count; i++) {
+				if(names[i] == name)
+					return i;
+			}
+
+			return INVALID;
+		}
+		const std::string& getName(const Layer layer) const {
+			return names.at(layer);
+		}
+		/**
+		 * @brief Sets if two layers collide, in both directions
+		*/
+		void setCollides(const Layer a, const Layer b, const bool collides) {
+			if(a >= count || b >= count){
+				std::cerr << "CollisionLayers::setCollides(): Invalid layer\n";
+				return;
+			}
+
+			if(collides){
+				collideMatrix[a] |= (1u << b);
+				collideMatrix[b] |= (1u << a);
+			} else {
+				collideMatrix[a] &= ~(1u << b);
+				collideMatrix[b] &= ~(1u << a);
+			}
+		}
+		bool collides(const Layer a, const Layer b) const {
+			return (collideMatrix.at(a) & (1u << b)) != 0;
+		}
+		/**
+		 * @brief Gets the Bullet collision filter group of a layer
+		*/
+		int getGroup(const Layer layer) const {
+			return (int)(1u << layer);
+		}
+		/**
+		 * @brief Gets the Bullet collision filter mask of a layer, the layers it collides with
+		*/
+		int getMask(const Layer layer) const {
+			return (int)collideMatrix.at(layer);
+		}
+		/**
+		 * @brief Builds a query mask(eg. for raycasts) which hits only the given layers
+		*/
+		int getQueryMask(const std::initializer_list<Layer> layers) const {
+			uint32_t mask = 0;
+			for(const Layer layer : layers) {
+				mask |= (1u << layer);
+			}
+
+			return (int)mask;
+		}
+		unsigned int size() const {
+			return count;
+		}
+		/**
+		 * @brief Records a body's layer on it, call when it's added to the world
+		*/
+		static void tag(btCollisionObject* obj, const Layer layer) {
+			obj->setUserIndex2(layer);
+		}
+		/**
+		 * @brief Gets the layer recorded by tag(), DEFAULT if there is none
+		*/
+		static Layer getTag(const btCollisionObject* obj) {
+			const int layer = obj->getUserIndex2();
+			return (layer >= 0 && layer < (int)MAX_LAYERS) ? (Layer)layer : DEFAULT;
+		}
+		/**
+		 * @brief Names every object in the world after its layer, so btCollisionWorld::serialize() writes the layers
+		 * @return The names, keep them until the world is serialized
+		*/
+		static std::vector<std::string> nameObjects(btCollisionWorld* world, btSerializer* serializer) {
+			std::vector<std::string> names(world->getNumCollisionObjects());
+			for(int i = 0; i < world->getNumCollisionObjects(); i++) {
+				const btCollisionObject* obj = world->getCollisionObjectArray()[i];
+				names[i] = LAYER_NAME_PREFIX + std::to_string(getTag(obj));
+				serializer->registerNameForPointer(obj, names[i].c_str());
+			}
+
+			return names;
+		}
+		/**
+		 * @brief Moves every imported object back onto the layer it was saved with, see nameObjects()
+		 * @details btWorldImporter adds objects with the default group and mask, so each is tagged and its proxy recreated
+		 * @details with its layer's. Objects saved without a layer are left as imported
+		*/
+		void restore(btCollisionWorld* world, btWorldImporter& importer) const {
+			const size_t prefixLength = std::strlen(LAYER_NAME_PREFIX);
+			for(int i = 0; i < world->getNumCollisionObjects(); i++) {
+				btCollisionObject* obj = world->getCollisionObjectArray()[i];
+				const char* name = importer.getNameForPointer(obj);
+				btBroadphaseProxy* proxy = obj->getBroadphaseHandle();
+				if(name == nullptr || proxy == nullptr || std::strncmp(name, LAYER_NAME_PREFIX, prefixLength) != 0)
+					continue;
+
+				const int layer = std::atoi(name + prefixLength);
+				if(layer < 0 || layer >= (int)count){
+					std::cerr << "CollisionLayers::restore(): Unknown layer " << layer << ", keeping the default filter\n";
+					continue;
+				}
+
+				tag(obj, (Layer)layer);
+				proxy->m_collisionFilterGroup = getGroup((Layer)layer);
+				proxy->m_collisionFilterMask = getMask((Layer)layer);
+				world->refreshBroadphaseProxy(obj);	// Drops pairs found with the default filter
+			}
+		}
+	private:
+		static constexpr const char* LAYER_NAME_PREFIX = "layer:";	// Serialized object names, followed by the layer
+
+		unsigned int count = 0;
+		std::array<std::string, MAX_LAYERS> names;
+		std::array<uint32_t, MAX_LAYERS> collideMatrix;	// Row N is the bitmask of layers N collides with
+};
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64)
+	#include <emmintrin.h>
+	#define FRUSTUM_SSE
+#endif
+
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <array>
+
+#include "Bounds.hpp"
+
+/**
+ * @brief The six planes of a view frustum, used to cull bounding volumes
+ * @note Planes point inwards, a point is inside when its distance to every plane is positive
+*/
+struct Frustum {
+	std::array<glm::vec4, 6> planes;	// Left, right, bottom, top, near, far as (normal, distance)
+
+	Frustum() {
+		planes.fill(glm::vec4(0.f, 0.f, 0.f, 1.f));	// Contains everything
+	}
+	/**
+	 * @brief Extracts the planes from a combined projection * view matrix(Gribb-Hartmann)
+	 * @details Each plane is a row of the matrix added to/subtracted from the last row
+	*/
+	explicit Frustum(const glm::mat4& viewProjection) {
+		for(int i = 0; i < 3; i++) {
+			for(int side = 0; side < 2; side++) {
+				glm::vec4& plane = planes[i * 2 + side];
+				for(int column = 0; column < 4; column++) {
+					plane[column] = viewProjection[column][3] + (side ? -1.f : 1.f) * viewProjection[column][i];
+				}
+				plane /= glm::length(glm::vec3(plane));
+			}
+		}
+	}
+	/**
+	 * @brief Tests a sphere against the frustum
+	 * @return -1 if it's outside, 1 if it's fully inside and 0 if it straddles a plane
+	*/
+	int classifySphere(const glm::vec3& center, const float radius) const {
+		int result = 1;
+		for(const glm::vec4& plane : planes) {
+			const float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+			if(distance < -radius)
+				return -1;
+			if(distance < radius)
+				result = 0;
+		}
+
+		return result;
+	}
+	bool containsSphere(const glm::vec3& center, const float radius) const {
+		for(const glm::vec4& plane : planes) {
+			if(glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+				return false;
+		}
+
+		return true;
+	}
+	/**
+	 * @brief Tests an axis aligned box against the frustum
+	 * @note Conservative, boxes near a corner of the frustum may pass while outside
+	*/
+	bool intersectsAabb(const glm::vec3& aabbMin, const glm::vec3& aabbMax) const {
+		for(const glm::vec4& plane : planes) {
+			// Corner furthest along the plane's normal
+			const glm::vec3 positive(
+				(plane.x >= 0.f) ? aabbMax.x : aabbMin.x,
+				(plane.y >= 0.f) ? aabbMax.y : aabbMin.y,
+				(plane.z >= 0.f) ? aabbMax.z : aabbMin.z
+			);
+			if(glm::dot(glm::vec3(plane), positive) + plane.w < 0.f)
+				return false;
+		}
+
+		return true;
+	}
+	bool intersectsAabb(const BoundingBox& box) const {
+		return intersectsAabb(box.min, box.max);
+	}
+};
+
+/**
+ * @brief Culls many boxes against a frustum at once
+ * @details Boxes are stored as centers and extents in separate arrays per axis, so 4 are tested per plane with SSE
+ * @details A box is outside when it's entirely behind any plane, the same test as Frustum::intersectsAabb()
+ * @note Without SSE2 it falls back to testing one box at a time
+*/
+class FrustumCuller {
+	public:
+		/**
+		 * @brief Removes every box, keeping the memory
+		*/
+		void clear() {
+			centerX.clear();
+			centerY.clear();
+			centerZ.clear();
+			extentX.clear();
+			extentY.clear();
+			extentZ.clear();
+			count = 0;
+		}
+		/**
+		 * @brief Adds a world space box
+		 * @return Its index for isVisible()
+		*/
+		uint32_t add(const BoundingBox& box) {
+			const glm::vec3 center = box.center();
+			const glm::vec3 extents = box.extents();
+
+			centerX.push_back(center.x);
+			centerY.push_back(center.y);
+			centerZ.push_back(center.z);
+			extentX.push_back(extents.x);
+			extentY.push_back(extents.y);
+			extentZ.push_back(extents.z);
+
+			return count++;
+		}
+		/**
+		 * @brief Tests every box against the frustum
+		 * @return The number of visible boxes
+		*/
+		uint32_t cull(const Frustum& frustum) {
+			// Pad to a multiple of 4 with boxes that are never read back
+			const size_t padded = (count + 3) & ~(size_t)3;
+			for(std::vector<float>* axis : { &centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ }) {
+				axis->resize(padded, 0.f);
+			}
+			visible.resize(padded);
+
+			#ifdef FRUSTUM_SSE
+				for(size_t i = 0; i < padded; i += 4) {
+					const __m128 cx = _mm_loadu_ps(&centerX[i]);
+					const __m128 cy = _mm_loadu_ps(&centerY[i]);
+					const __m128 cz = _mm_loadu_ps(&centerZ[i]);
+					const __m128 ex = _mm_loadu_ps(&extentX[i]);
+					const __m128 ey = _mm_loadu_ps(&extentY[i]);
+					const __m128 ez = _mm_loadu_ps(&extentZ[i]);
+
+					__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+					for(const glm::vec4& plane : frustum.planes) {
+						// Signed distance of the center, plus the box's radius along the plane's normal
+						__m128 distance = _mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(plane.x)), _mm_set1_ps(plane.w));
+						distance = _mm_add_ps(distance, _mm_mul_ps(cy, _mm_set1_ps(plane.y)));
+						distance = _mm_add_ps(distance, _mm_mul_ps(cz, _mm_set1_ps(plane.z)));
+
+						__m128 radius = _mm_mul_ps(ex, _mm_set1_ps(std::abs(plane.x)));
+						radius = _mm_add_ps(radius, _mm_mul_ps(ey, _mm_set1_ps(std::abs(plane.y))));
+						radius = _mm_add_ps(radius, _mm_mul_ps(ez, _mm_set1_ps(std::abs(plane.z))));
+
+						inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+					}
+
+					const int mask = _mm_movemask_ps(inside);
+					for(int lane = 0; lane < 4; lane++) {
+						visible[i + lane] = (mask >> lane) & 1;
+					}
+				}
+			#else
+				for(size_t i = 0; i < padded; i++) {
+					visible[i] = 1;
+					for(const glm::vec4& plane : frustum.planes) {
+						const float distance = centerX[i] * plane.x + centerY[i] * plane.y + centerZ[i] * plane.z + plane.w;
+						const float radius = extentX[i] * std::abs(plane.x) + extentY[i] * std::abs(plane.y) + extentZ[i] * std::abs(plane.z);
+						if(distance + radius < 0.f){
+							visible[i] = 0;
+							break;
+						}
+					}
+				}
+			#endif
+
+			// Drop the padding, so add() appends after the real boxes
+			for(std::vector<float>* axis : { &centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ }) {
+				axis->resize(count);
+			}
+
+			uint32_t visibleCount = 0;
+			for(uint32_t i = 0; i < count; i++) {
+				visibleCount += visible[i];
+			}
+			return visibleCount;
+		}
+		/**
+		 * @brief Returns if a box passed the last cull()
+		*/
+		bool isVisible(const uint32_t index) const {
+			return visible[index];
+		}
+		uint32_t size() const {
+			return count;
+		}
+	private:
+		std::vector<float> centerX, centerY, centerZ;
+		std::vector<float> extentX, extentY, extentZ;
+		std::vector<uint8_t> visible;
+		uint32_t count = 0;
+};
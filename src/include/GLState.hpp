@@ -0,0 +1,166 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <iostream>
+#include <cstdint>
+
+/**
+ * @brief Counts of the state changes GLState issued and skipped since the last resetStats()
+*/
+struct GLStateStats {
+	uint32_t issued = 0;	// Calls that reached OpenGL
+	uint32_t skipped = 0;	// Calls that would have set what was already set
+};
+
+/**
+ * @brief Tracks the context's program, VAO, texture, blend and polygon mode bindings and skips redundant changes
+ * @details Every change of tracked state has to go through here, a direct glUseProgram or glBindVertexArray
+ * @details leaves the cache stale. Starts from OpenGL's defaults, draws set the state they need instead of restoring it
+ * @details Errors are reported by a KHR_debug callback in debug builds, see enableDebugOutput(), so nothing polls glGetError
+ * @note There's one context, so the state is static
+*/
+class GLState {
+	public:
+		static const GLuint MAX_TEXTURE_UNITS = 32;
+
+		static void useProgram(const GLuint program) {
+			if(program == current().program){
+				stats.skipped++;
+				return;
+			}
+
+			glUseProgram(program);
+			current().program = program;
+			stats.issued++;
+		}
+		static void bindVertexArray(const GLuint vao) {
+			if(vao == current().vao){
+				stats.skipped++;
+				return;
+			}
+
+			glBindVertexArray(vao);
+			current().vao = vao;
+			stats.issued++;
+		}
+		/**
+		 * @brief Binds a texture to a texture unit, only switching the active unit if the binding changes
+		 * @note Only GL_TEXTURE_2D bindings are cached, other targets are always bound
+		*/
+		static void bindTexture(const GLuint unit, const GLuint texture, const GLenum target = GL_TEXTURE_2D) {
+			const bool cached = target == GL_TEXTURE_2D && unit < MAX_TEXTURE_UNITS;
+			if(cached && texture == current().textures[unit]){
+				stats.skipped++;
+				return;
+			}
+
+			activeTexture(unit);
+			glBindTexture(target, texture);
+			if(cached)
+				current().textures[unit] = texture;
+			stats.issued++;
+		}
+		static void setBlend(const bool enabled) {
+			if(enabled == current().blend){
+				stats.skipped++;
+				return;
+			}
+
+			if(enabled)
+				glEnable(GL_BLEND);
+			else
+				glDisable(GL_BLEND);
+			current().blend = enabled;
+			stats.issued++;
+		}
+		/**
+		 * @brief Sets the polygon mode of both faces, GL_FILL or GL_LINE
+		*/
+		static void setPolygonMode(const GLenum mode) {
+			if(mode == current().polygonMode){
+				stats.skipped++;
+				return;
+			}
+
+			glPolygonMode(GL_FRONT_AND_BACK, mode);
+			current().polygonMode = mode;
+			stats.issued++;
+		}
+		/**
+		 * @brief Deletes a program, forgetting it if it's current so its name can be reused
+		*/
+		static void deleteProgram(const GLuint program) {
+			if(program == current().program)
+				current().program = 0;
+			glDeleteProgram(program);
+		}
+		/**
+		 * @brief Deletes a VAO, forgetting it if it's bound so its name can be reused
+		*/
+		static void deleteVertexArray(const GLuint vao) {
+			if(vao == current().vao)
+				current().vao = 0;
+			glDeleteVertexArrays(1, &vao);
+		}
+		static const GLStateStats& getStats() {
+			return stats;
+		}
+		/**
+		 * @brief Starts counting again, call once a frame
+		*/
+		static void resetStats() {
+			stats = GLStateStats();
+		}
+		/**
+		 * @brief Reports OpenGL errors and warnings through a KHR_debug callback, only in debug builds
+		 * @note Needs a debug context, returns if the callback was installed
+		*/
+		static bool enableDebugOutput() {
+			#ifdef DEBUG
+				if(!(GLEW_VERSION_4_3 || GLEW_KHR_debug))
+					return false;
+
+				glEnable(GL_DEBUG_OUTPUT);
+				glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);	// Report on the call that caused it
+				glDebugMessageCallback(debugCallback, nullptr);
+				glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
+				return true;
+			#else
+				return false;
+			#endif
+		}
+	private:
+		struct State {
+			GLuint program = 0;
+			GLuint vao = 0;
+			GLuint activeUnit = 0;
+			GLuint textures[MAX_TEXTURE_UNITS] = { };
+			GLenum polygonMode = GL_FILL;
+			bool blend = false;
+		};
+
+		static void activeTexture(const GLuint unit) {
+			if(unit == current().activeUnit)
+				return;
+
+			glActiveTexture(GL_TEXTURE0 + unit);
+			current().activeUnit = unit;
+			stats.issued++;
+		}
+		#ifdef DEBUG
+			static void GLAPIENTRY debugCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* userParam) {
+				std::cerr << "OpenGL " << ((type == GL_DEBUG_TYPE_ERROR) ? "error" : "message") << " 0x" << std::hex << id << std::dec << ": " << message << '\n';
+			}
+		#endif
+
+		/**
+		 * @brief The bindings last set, a function static since a nested class can't be an inline static member yet
+		*/
+		static State& current() {
+			static State state;
+			return state;
+		}
+
+		inline static GLStateStats stats;
+};
@@ -6,6 +6,7 @@
 #include <iostream>
 #include <string>
 
+#include "Frustum.hpp"
 #include "Model.hpp"
 #include "shader/BaseShader.hpp"
 
@@ -81,8 +82,12 @@ class GameObject {
 		 * @param shader The shader used to draw
 		 * @param cameraView The view matrix of the camera
 		 * @param cameraFOV The FOV of the camera
+		 * @param frustum If set, the object isn't drawn when its bounds are outside it
 		*/
-		void draw(BaseShader &shader, const glm::mat4 &cameraView, const float &cameraFOV) {
+		void draw(BaseShader &shader, const glm::mat4 &cameraView, const float &cameraFOV, const Frustum* frustum = nullptr) {
+			if(frustum && !frustum->intersectsAabb(getWorldBounds()))
+				return;
+
 			shader.bind();
 			shader.setRotation(pos.rotation, pos.rotationAxis);
 			shader.setScale(scale, scale, scale);
@@ -91,6 +96,26 @@ class GameObject {
 
 			model.draw(shader);
 		}
+		/**
+		 * @brief Queues the object to be drawn, with the same transform as draw()
+		*/
+		void submit(RenderQueue& queue, BaseShader& shader) {
+			model.submit(queue, shader, getTransform());
+		}
+		/**
+		 * @brief Returns the model matrix draw() uses
+		*/
+		glm::mat4 getTransform() const {
+			glm::mat4 transform = glm::translate(glm::mat4(1.f), pos.pos);
+			transform = glm::scale(transform, glm::vec3(scale));
+			return glm::rotate(transform, pos.rotation, pos.rotationAxis);
+		}
+		/**
+		 * @brief Returns the box around the model, in world space
+		*/
+		BoundingBox getWorldBounds() const {
+			return model.getBounds().transformed(getTransform());
+		}
 		/**
 		 * @brief The update function for the object
 		 * @param deltaTime Miliseconds since last update
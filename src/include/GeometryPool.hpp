@@ -0,0 +1,284 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <cstddef>
+#include <vector>
+
+#include "Transform.hpp"
+#include "GLState.hpp"
+#include "Vertex.hpp"
+
+/**
+ * @brief Where a mesh lives in a GeometryPool
+*/
+struct GeometryRange {
+	GLint baseVertex = 0;	// Added to every index
+	GLuint firstIndex = 0;
+	GLsizei indexCount = 0;
+};
+
+/**
+ * @brief Layout glMultiDrawElementsIndirect reads commands in
+*/
+struct DrawElementsIndirectCommand {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+/**
+ * @brief Shared vertex and index buffers static meshes are sub-allocated from, with one VAO for all of them
+ * @details Meshes in the same pool never rebind a VAO between each other, and a whole batch of them(one command per
+ * @details mesh, each instanced) is submitted with one glMultiDrawElementsIndirect call on GL 4.3 or with
+ * @details ARB_multi_draw_indirect. On GL 4.1 each command is drawn with glDrawElementsInstancedBaseVertex instead
+ * @details Allocations are never freed on their own, the buffers double when full and clear() empties the pool
+ * @details Per-instance transforms come from the pool's own instance buffer, at the same locations as Mesh's
+ * @note GL objects are created on the first allocation, so the pool can be declared before the context exists
+*/
+class GeometryPool {
+	public:
+		/**
+		 * @param vertexCapacity Vertices allocated up front
+		 * @param indexCapacity Indices allocated up front
+		*/
+		GeometryPool(const GLsizei vertexCapacity = 1 << 18, const GLsizei indexCapacity = 1 << 20)
+			: vertexCapacity(std::max(vertexCapacity, 1)), indexCapacity(std::max(indexCapacity, 1)) {}
+		~GeometryPool() {
+			release();
+		}
+		GeometryPool(const GeometryPool&) = delete;
+		GeometryPool& operator=(const GeometryPool&) = delete;
+
+		/**
+		 * @brief Copies a mesh into the pool
+		 * @return Where it was placed, indices are relative to its first vertex
+		*/
+		GeometryRange allocate(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices) {
+			if(vao == 0)
+				initOpenGL();
+
+			reserve(vertexCount + vertices.size(), indexCount + indices.size());
+
+			GeometryRange range;
+			range.baseVertex = vertexCount;
+			range.firstIndex = indexCount;
+			range.indexCount = indices.size();
+
+			glBindBuffer(GL_ARRAY_BUFFER, vbo);
+			glBufferSubData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertices.size() * sizeof(Vertex), vertices.data());
+			glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);	// Binding the element buffer outside a VAO would change the bound VAO's
+			glBufferSubData(GL_COPY_WRITE_BUFFER, indexCount * sizeof(GLuint), indices.size() * sizeof(GLuint), indices.data());
+
+			vertexCount += vertices.size();
+			indexCount += indices.size();
+
+			return range;
+		}
+		/**
+		 * @brief Streams instance transforms into the instance buffer, orphaning the last storage so the upload doesn't stall
+		*/
+		void uploadInstances(const InstanceTransform* transforms, const GLsizei count) {
+			glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+			if(count > instanceCapacity){
+				instanceCapacity = std::max(count, instanceCapacity * 2);
+			}
+			glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(InstanceTransform), nullptr, GL_STREAM_DRAW);
+			glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(InstanceTransform), transforms);
+		}
+		/**
+		 * @brief Draws a batch of commands, their `baseInstance` indexes the uploaded instances
+		 * @note The pool's VAO must be bound
+		 * @return The number of API draw calls issued, 1 with multi-draw indirect
+		*/
+		GLsizei drawIndirect(const std::vector<DrawElementsIndirectCommand>& commands) {
+			if(commands.empty())
+				return 0;
+
+			if(multiDrawIndirect){
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+				glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STREAM_DRAW);
+				glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, commands.size(), 0);
+				return 1;
+			}
+
+			// GL 4.1 has no base instance, so the instance attributes are pointed at each command's first instance
+			for(const DrawElementsIndirectCommand& command : commands) {
+				pointInstances(command.baseInstance);
+				glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT, (void*)(command.firstIndex * sizeof(GLuint)), command.instanceCount, command.baseVertex);
+			}
+			pointInstances(0);
+
+			return commands.size();
+		}
+		/**
+		 * @brief Empties the pool, every range allocated from it is invalid afterwards
+		*/
+		void clear() {
+			vertexCount = 0;
+			indexCount = 0;
+		}
+		/**
+		 * @brief Deletes the GL objects
+		*/
+		void release() {
+			if(vao == 0)
+				return;
+
+			GLState::deleteVertexArray(vao);
+			glDeleteBuffers(1, &vbo);
+			glDeleteBuffers(1, &ebo);
+			glDeleteBuffers(1, &instanceVBO);
+			glDeleteBuffers(1, &indirectBuffer);
+			vao = vbo = ebo = instanceVBO = indirectBuffer = 0;
+
+			clear();
+		}
+		GLuint getVAO() const {
+			return vao;
+		}
+		/**
+		 * @brief Returns if batches are drawn with one glMultiDrawElementsIndirect call
+		*/
+		bool hasMultiDrawIndirect() const {
+			return multiDrawIndirect;
+		}
+		GLsizei getVertexCount() const {
+			return vertexCount;
+		}
+		GLsizei getIndexCount() const {
+			return indexCount;
+		}
+	private:
+		static const GLuint INSTANCE_ATTRIB = 3;	// The same as Mesh::INSTANCE_ATTRIB
+		static const GLuint INSTANCE_ATTRIB_COUNT = 7;	// A mat4 and a mat3, one location per column
+
+		void initOpenGL() {
+			// Multi-draw indirect is core in 4.3, base instance(needed for the instance attributes) in 4.2
+			multiDrawIndirect = GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance);
+
+			glGenVertexArrays(1, &vao);
+			glGenBuffers(1, &vbo);
+			glGenBuffers(1, &ebo);
+			glGenBuffers(1, &instanceVBO);
+			glGenBuffers(1, &indirectBuffer);
+
+			GLState::bindVertexArray(vao);
+
+			glBindBuffer(GL_ARRAY_BUFFER, vbo);
+			glBufferData(GL_ARRAY_BUFFER, vertexCapacity * sizeof(Vertex), nullptr, GL_STATIC_DRAW);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCapacity * sizeof(GLuint), nullptr, GL_STATIC_DRAW);
+			pointVertices();
+
+			// One identity so non-instanced draws read valid data
+			const InstanceTransform identity;
+			glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(InstanceTransform), &identity, GL_STREAM_DRAW);
+			instanceCapacity = 1;
+			for(GLuint i = 0; i < INSTANCE_ATTRIB_COUNT; i++) {
+				glEnableVertexAttribArray(INSTANCE_ATTRIB + i);
+				glVertexAttribDivisor(INSTANCE_ATTRIB + i, 1);
+			}
+			pointInstances(0);
+
+			GLState::bindVertexArray(0);
+		}
+		/**
+		 * @brief Grows the vertex and index buffers to fit at least the given counts, copying their contents
+		*/
+		void reserve(const GLsizei vertices, const GLsizei indices) {
+			if(vertices > vertexCapacity){
+				GLsizei capacity = vertexCapacity;
+				while(capacity < vertices) {
+					capacity *= 2;
+				}
+
+				vbo = growBuffer(vbo, vertexCount * sizeof(Vertex), capacity * sizeof(Vertex));
+				vertexCapacity = capacity;
+
+				GLState::bindVertexArray(vao);
+				glBindBuffer(GL_ARRAY_BUFFER, vbo);
+				pointVertices();
+				GLState::bindVertexArray(0);
+			}
+			if(indices > indexCapacity){
+				GLsizei capacity = indexCapacity;
+				while(capacity < indices) {
+					capacity *= 2;
+				}
+
+				ebo = growBuffer(ebo, indexCount * sizeof(GLuint), capacity * sizeof(GLuint));
+				indexCapacity = capacity;
+
+				GLState::bindVertexArray(vao);
+				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+				GLState::bindVertexArray(0);
+			}
+		}
+		/**
+		 * @brief Replaces a buffer with a larger one holding the same first `usedSize` bytes
+		 * @return The new buffer
+		*/
+		static GLuint growBuffer(const GLuint buffer, const GLsizeiptr usedSize, const GLsizeiptr newSize) {
+			GLuint grown;
+			glGenBuffers(1, &grown);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+			glBufferData(GL_COPY_WRITE_BUFFER, newSize, nullptr, GL_STATIC_DRAW);
+
+			glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedSize);
+			glDeleteBuffers(1, &buffer);
+
+			#ifdef DEBUG
+				std::cout << "GeometryPool: Grew buffer to " << newSize << " bytes\n";
+			#endif
+
+			return grown;
+		}
+		/**
+		 * @brief Points the vertex attributes at `vbo`, which must be bound to GL_ARRAY_BUFFER with the VAO
+		*/
+		void pointVertices() {
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoord));
+		}
+		/**
+		 * @brief Points the instance attributes at the `first`th instance, the VAO must be bound
+		*/
+		void pointInstances(const GLuint first) {
+			const size_t offset = first * sizeof(InstanceTransform);
+
+			glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+			for(GLuint i = 0; i < 4; i++) {
+				glVertexAttribPointer(INSTANCE_ATTRIB + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), (void*)(offset + offsetof(InstanceTransform, model) + sizeof(glm::vec4) * i));
+			}
+			for(GLuint i = 0; i < 3; i++) {
+				glVertexAttribPointer(INSTANCE_ATTRIB + 4 + i, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), (void*)(offset + offsetof(InstanceTransform, normal) + sizeof(glm::vec3) * i));
+			}
+		}
+
+		GLuint vao = 0;
+		GLuint vbo = 0;
+		GLuint ebo = 0;
+		GLuint instanceVBO = 0;
+		GLuint indirectBuffer = 0;
+
+		GLsizei vertexCapacity;
+		GLsizei indexCapacity;
+		GLsizei instanceCapacity = 0;	// In instances
+		GLsizei vertexCount = 0;
+		GLsizei indexCount = 0;
+
+		bool multiDrawIndirect = false;
+};
@@ -7,12 +7,16 @@
 #include <bullet/btBulletDynamicsCommon.h>
 #include <bullet/BulletCollision/CollisionShapes/btHeightfieldTerrainShape.h>
 
+#include <algorithm>
 #include <iostream>
+#include <cstdint>
 #include <vector>
 
 #include "FileHandler.hpp"
 #include "Collision.h"
 #include "shader/BaseShader.hpp"
+#include "RenderQueue.hpp"
+#include "OcclusionCuller.hpp"
 
 struct HeightmapDimensions {
 	int width;
@@ -22,17 +26,47 @@ struct HeightmapDimensions {
 	float maxHeight;
 };
 
+/**
+ * @brief A rectangular section of the heightfield with its own physics shape and accelerator
+ * @note Neighbouring tiles share their edge samples
+*/
+struct HeightfieldTile {
+	int x;		// First sample along the X axis
+	int z;		// First sample along the Z axis
+	int width;	// Number of samples along the X axis
+	int length;	// Number of samples along the Z axis
+
+	std::vector<unsigned char> samples;	// Raw 8 or 16 bit samples, referenced(not copied) by `shape`
+	btHeightfieldTerrainShape* shape = nullptr;
+	btRigidBody* rigidBody = nullptr;
+};
+
 class Heightmap {
 	public:
+		// Sample to world height mapping, see heightmap.tese
+		static constexpr float HEIGHT_SCALE = 64.f / 256.f;
+		static constexpr float HEIGHT_OFFSET = -16.f;
+		// Coarse occluder mesh, see addOccluder()
+		static const int OCCLUDER_STEP = 8;				// Samples between occluder vertices
+		static constexpr float OCCLUDER_BIAS = 1.f;		// World units the occluder is lowered by
+
 		Heightmap() {
 			pos = glm::vec3(0.f);
 		}
-		Heightmap(const std::string path) {
+		/**
+		 * @param path The path to the heightmap image
+		 * @param tileSize Samples per tile edge, each tile is a seperate physics shape
+		*/
+		Heightmap(const std::string path, const int tileSize = 257) : tileSize(std::max(tileSize, 2)) {
 			pos = glm::vec3(0.f);
 
 			HeightmapDimensions dimensions = generateMesh(path);
 			std::cout << dimensions.width << "x" << dimensions.height << "px [" << dimensions.minHeight << "," << dimensions.maxHeight << "]\n";
-			setupPhysics(dimensions);
+			setupPhysics(sourceSamples.data(), dimensions.width, dimensions.height, HEIGHT_SCALE, HEIGHT_OFFSET);
+
+			// Tiles hold their own copies
+			sourceSamples.clear();
+			sourceSamples.shrink_to_fit();
 		}
 		~Heightmap() {}
 		HeightmapDimensions generateMesh(const std::string path) {
@@ -44,9 +78,7 @@ class Heightmap {
 				throw std::runtime_error("Heightmap::generateMesh(): Unable to load heightmap at \"" + path + "\"");
 
 			glGenTextures(1, &texture);
-			glActiveTexture(GL_TEXTURE0);
-
-			glBindTexture(GL_TEXTURE_2D, texture);
+			GLState::bindTexture(0, texture);
 
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -64,22 +96,18 @@ class Heightmap {
 			glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
 			glGenerateMipmap(GL_TEXTURE_2D);
 
-			// Get heightdata for physics heightfield
-			heightData.clear();
-			float minHeight = data[0]/256.f*4;
-			float maxHeight = minHeight;
-			for(int y = 0; y < height; y++) {
-				for(int x = 0; x < width; x++) {
-					float val = data[(y * width + x) * channels] / 256.f * 64.f - 16.f;
-					heightData.push_back(val);
-
-					if(val < minHeight)
-						minHeight = val;
-					else if(val > maxHeight)
-						maxHeight = val;
-				}
-				//std::cout << data[y * width]
+			// Keep the first channel for the physics heightfield, heights are scaled when the tiles are built
+			sourceSamples.resize(width * height);
+			unsigned char minSample = data[0];
+			unsigned char maxSample = minSample;
+			for(int i = 0; i < width * height; i++) {
+				sourceSamples[i] = data[i * channels];
+
+				minSample = std::min(minSample, sourceSamples[i]);
+				maxSample = std::max(maxSample, sourceSamples[i]);
 			}
+			const float minHeight = minSample * HEIGHT_SCALE + HEIGHT_OFFSET;
+			const float maxHeight = maxSample * HEIGHT_SCALE + HEIGHT_OFFSET;
 
 			FileHandler::freeImage(data);
 
@@ -124,7 +152,7 @@ class Heightmap {
 			#endif
 
 			glGenVertexArrays(1, &vao);
-			glBindVertexArray(vao);
+			GLState::bindVertexArray(vao);
 
 			glGenBuffers(1, &vbo);
 			glBindBuffer(GL_ARRAY_BUFFER, vbo);
@@ -136,39 +164,31 @@ class Heightmap {
 			glEnableVertexAttribArray(1);
 
 			glPatchParameteri(GL_PATCH_VERTICES, 4);
-			glBindVertexArray(0);
+			GLState::bindVertexArray(0);
 
 			return { width, height, minHeight, maxHeight };
 		}
-		// TODO Fully implement physics
-		void setupPhysics(const HeightmapDimensions dimensions) {
-			// Create rigidbody
-			bool flipQuadEdges = false;
-
-			btHeightfieldTerrainShape* heightfieldShape = new btHeightfieldTerrainShape(
-				dimensions.width, 
-				dimensions.height, 
-				heightData.data(), 
-				dimensions.minHeight, 
-				dimensions.maxHeight, 
-				1, 
-				flipQuadEdges
-			);
-
-			heightfieldShape->buildAccelerator();
-
-			btTransform transform;
-			transform.setIdentity();
-			transform.setOrigin(
-				btVector3(
-					0.f, 
-					(std::abs(dimensions.minHeight) + dimensions.maxHeight) / 2 -16, 
-					0.f
-				)
-			);
+		/**
+		 * @brief Splits 8 bit samples into tiles and creates their physics shapes
+		 * @param samples Row-major samples, `width` along X by `height` along Z
+		 * @param heightScale World units per sample step
+		 * @param heightOffset World height of a sample of 0
+		 * @note The samples are copied, `samples` can be freed afterwards
+		*/
+		void setupPhysics(const unsigned char* samples, const int width, const int height, const float heightScale, const float heightOffset) {
+			buildTiles(samples, width, height, heightScale, heightOffset, PHY_UCHAR);
+		}
+		/**
+		 * @brief Splits 16 bit samples into tiles and creates their physics shapes
+		 * @note Bullet only supports signed shorts, so samples are shifted by -32768 and the offset adjusted to match
+		*/
+		void setupPhysics(const uint16_t* samples, const int width, const int height, const float heightScale, const float heightOffset) {
+			std::vector<int16_t> shifted(width * height);
+			for(int i = 0; i < width * height; i++) {
+				shifted[i] = (int16_t)((int)samples[i] - 32768);
+			}
 
-			rigidBody = createRigidBody(heightfieldShape, transform, 0.f);
-			rigidBody->setCollisionFlags(rigidBody->getCollisionFlags() | btCollisionObject::CF_STATIC_OBJECT);
+			buildTiles(shifted.data(), width, height, heightScale, heightOffset + 32768.f * heightScale, PHY_SHORT);
 		}
 		void draw(BaseShader& shader, const glm::mat4& view, const float& fov, const bool wireframe) {
 			shader.bind();
@@ -178,35 +198,206 @@ class Heightmap {
 			shader.perspective(view, fov);
 
 
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, texture);
+			GLState::bindTexture(0, texture);
 			shader.setInt("heightmap", 0);
 
-			glDisable(GL_BLEND);
-			if(wireframe)
-				glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-			
-			glBindVertexArray(vao);
-			glDrawArrays(GL_PATCHES, 0, 4 * res * res);
+			GLState::setBlend(false);
+			GLState::setPolygonMode(wireframe ? GL_LINE : GL_FILL);
 
-			if(wireframe)
-				glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-			glEnable(GL_BLEND);
+			GLState::bindVertexArray(vao);
+			glDrawArrays(GL_PATCHES, 0, 4 * res * res);
+		}
+		/**
+		 * @brief Queues the terrain to be drawn before everything else
+		 * @param shader The tessellation shader, the same as draw()
+		*/
+		void submit(RenderQueue& queue, BaseShader& shader, const bool wireframe) {
+			this->wireframe = wireframe;
+			queue.addCustom(shader, this, drawQueued, vao, glm::translate(glm::mat4(1.f), pos), RenderLayer::BACKGROUND);
+		}
+		/**
+		 * @brief Rasterizes the coarse occluder mesh, so hills hide what's behind them
+		 * @details Each vertex takes the lowest sample within OCCLUDER_STEP of it, lowered by OCCLUDER_BIAS,
+		 * @details so the mesh stays under the tessellated surface and never hides what pokes over a ridge
+		*/
+		void addOccluder(OcclusionCuller& culler) const {
+			if(occluderIndices.empty())
+				return;
+
+			culler.addOccluder(
+				occluderVertices.data(),
+				sizeof(glm::vec3),
+				occluderVertices.size(),
+				occluderIndices.data(),
+				occluderIndices.size(),
+				glm::translate(glm::mat4(1.f), pos)
+			);
 		}
 		void setPos(const glm::vec3 pos) {
 			this->pos = pos;
 		}
-		btRigidBody* getRigidBody() {
-			return rigidBody;
+		/**
+		 * @brief Gets the physics tiles
+		 * @note Add each tile's rigidbody to the world, or only the ones near the player to stream them
+		*/
+		std::vector<HeightfieldTile>& getTiles() {
+			return tiles;
 		}
 	private:
+		/**
+		 * @brief Copies each tile's samples out of `samples` and creates its shape and rigidbody
+		 * @details Each tile's shape is bounded by its own min/max height, so its AABB and accelerator stay tight
+		*/
+		template<class T> void buildTiles(const T* samples, const int width, const int height, const float heightScale, const float heightOffset, const PHY_ScalarType type) {
+			tiles.clear();
+
+			const int step = tileSize - 1;	// Tiles overlap by one sample so there are no gaps
+			tiles.reserve(((width - 2) / step + 1) * ((height - 2) / step + 1));
+			for(int z = 0; z < height - 1; z += step) {
+				for(int x = 0; x < width - 1; x += step) {
+					HeightfieldTile tile;
+					tile.x = x;
+					tile.z = z;
+					tile.width = std::min(tileSize, width - x);
+					tile.length = std::min(tileSize, height - z);
+					tile.samples.resize(tile.width * tile.length * sizeof(T));
+
+					T* tileSamples = reinterpret_cast<T*>(tile.samples.data());
+					T minSample = samples[z * width + x];
+					T maxSample = minSample;
+					for(int j = 0; j < tile.length; j++) {
+						for(int i = 0; i < tile.width; i++) {
+							const T sample = samples[(z + j) * width + (x + i)];
+							tileSamples[j * tile.width + i] = sample;
+
+							minSample = std::min(minSample, sample);
+							maxSample = std::max(maxSample, sample);
+						}
+					}
+
+					const float minHeight = minSample * heightScale;
+					const float maxHeight = maxSample * heightScale;
+					tile.shape = new btHeightfieldTerrainShape(
+						tile.width,
+						tile.length,
+						tile.samples.data(),
+						heightScale,
+						minHeight,
+						maxHeight,
+						1,
+						type,
+						false
+					);
+					tile.shape->buildAccelerator();
+
+					// Bullet centers the shape on its bounds, move it back to where it sits in the full heightfield
+					btTransform transform;
+					transform.setIdentity();
+					transform.setOrigin(
+						btVector3(
+							x + (tile.width - 1) / 2.f - (width - 1) / 2.f,
+							(minHeight + maxHeight) / 2.f + heightOffset,
+							z + (tile.length - 1) / 2.f - (height - 1) / 2.f
+						)
+					);
+
+					tile.rigidBody = createRigidBody(tile.shape, transform, 0.f);
+					tile.rigidBody->setCollisionFlags(tile.rigidBody->getCollisionFlags() | btCollisionObject::CF_STATIC_OBJECT);
+
+					tiles.push_back(std::move(tile));
+				}
+			}
+
+			buildOccluder(samples, width, height, heightScale, heightOffset);
+
+			#ifdef DEBUG
+				std::cout << "Created " << tiles.size() << " heightfield tiles\n";
+			#endif
+		}
+		/**
+		 * @brief Builds the coarse occluder mesh, a vertex every OCCLUDER_STEP samples in the physics shapes' space
+		*/
+		template<class T> void buildOccluder(const T* samples, const int width, const int height, const float heightScale, const float heightOffset) {
+			occluderVertices.clear();
+			occluderIndices.clear();
+			if(width < 2 || height < 2)
+				return;
+
+			// Sample indices of each column and row, always ending on the last sample
+			std::vector<int> columns;
+			std::vector<int> rows;
+			for(int x = 0; x < width - 1; x += OCCLUDER_STEP) {
+				columns.push_back(x);
+			}
+			columns.push_back(width - 1);
+			for(int z = 0; z < height - 1; z += OCCLUDER_STEP) {
+				rows.push_back(z);
+			}
+			rows.push_back(height - 1);
+
+			occluderVertices.reserve(columns.size() * rows.size());
+			for(const int z : rows) {
+				for(const int x : columns) {
+					// Lowest sample around the vertex, covering every cell it's a corner of
+					T lowest = samples[z * width + x];
+					for(int j = std::max(z - OCCLUDER_STEP, 0); j <= std::min(z + OCCLUDER_STEP, height - 1); j++) {
+						for(int i = std::max(x - OCCLUDER_STEP, 0); i <= std::min(x + OCCLUDER_STEP, width - 1); i++) {
+							lowest = std::min(lowest, samples[j * width + i]);
+						}
+					}
+
+					occluderVertices.push_back(
+						glm::vec3(
+							x - (width - 1) / 2.f,
+							lowest * heightScale + heightOffset - OCCLUDER_BIAS,
+							z - (height - 1) / 2.f
+						)
+					);
+				}
+			}
+
+			const uint32_t rowLength = columns.size();
+			occluderIndices.reserve((columns.size() - 1) * (rows.size() - 1) * 6);
+			for(uint32_t j = 0; j + 1 < rows.size(); j++) {
+				for(uint32_t i = 0; i + 1 < rowLength; i++) {
+					const uint32_t corner = j * rowLength + i;
+					occluderIndices.insert(occluderIndices.end(), {
+						corner, corner + rowLength, corner + 1,
+						corner + 1, corner + rowLength, corner + rowLength + 1
+					});
+				}
+			}
+		}
+
+		/**
+		 * @brief RenderQueue callback, draw() without the shader setup
+		*/
+		static void drawQueued(void* object, BaseShader& shader) {
+			Heightmap* heightmap = static_cast<Heightmap*>(object);
+
+			GLState::bindTexture(0, heightmap->texture);
+			shader.setInt("heightmap", 0);
+
+			GLState::setBlend(false);
+			GLState::setPolygonMode(heightmap->wireframe ? GL_LINE : GL_FILL);
+
+			GLState::bindVertexArray(heightmap->vao);
+			glDrawArrays(GL_PATCHES, 0, 4 * heightmap->res * heightmap->res);
+		}
+
 		unsigned int res;	// Resolution of terrain
 		glm::vec3 pos;
+		bool wireframe = false;	// For the queued draw
 
 		GLuint vao;
 		GLuint vbo;
 		GLuint texture;
 
-		std::vector<btScalar> heightData;
-		btRigidBody* rigidBody;
+		int tileSize = 257;	// Samples per tile edge
+
+		std::vector<unsigned char> sourceSamples;	// Full resolution samples, only kept until the tiles are built
+		std::vector<HeightfieldTile> tiles;
+
+		std::vector<glm::vec3> occluderVertices;	// Coarse mesh under the terrain, relative to `pos`
+		std::vector<uint32_t> occluderIndices;
 };
\ No newline at end of file
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <unordered_map>
+#include <string>
+#include <vector>
+
+#include "shader/BaseShader.hpp"
+
+struct Texture {
+	GLuint id;
+
+	std::string type;
+	std::string path;
+};
+
+/**
+ * @brief A mesh's textures with their texture units and sampler uniforms, prepared once at load
+ * @details Texture i is bound to unit i and sampled by "<type>N"(eg. diffuseTexture1, the Nth texture of that type),
+ * @details or "material.<type>" if the shader doesn't have the former
+ * @details Sampler handles are resolved on the first bind with each shader program, later binds do no string work
+*/
+class Material {
+	public:
+		Material() = default;
+		Material(const std::vector<Texture>& textures) {
+			std::unordered_map<std::string, int> typeCounts;
+			for(GLuint i = 0; i < textures.size(); i++) {
+				const Texture& texture = textures[i];
+
+				Slot slot;
+				slot.unit = i;
+				slot.textureID = texture.id;
+				slot.name = texture.type + std::to_string(++typeCounts[texture.type]);
+				slot.fallbackName = "material." + texture.type;
+
+				slots.push_back(slot);
+			}
+		}
+		/**
+		 * @brief Points the shader's samplers at the material's units and binds its textures
+		 * @note The shader must be bound
+		*/
+		void bind(BaseShader& shader) {
+			if(shader.getGeneration() != shaderGeneration)
+				resolve(shader);
+
+			for(const Slot& slot : slots) {
+				shader.set(slot.sampler, (int)slot.unit);
+				GLState::bindTexture(slot.unit, slot.textureID);
+			}
+		}
+		/**
+		 * @brief Returns the number of textures
+		*/
+		size_t size() const {
+			return slots.size();
+		}
+	private:
+		struct Slot {
+			GLuint unit;
+			GLuint textureID;
+			Uniform<int> sampler;	// Resolved for `shaderGeneration`
+
+			std::string name;
+			std::string fallbackName;
+		};
+
+		/**
+		 * @brief Resolves every sampler handle for the shader's current program
+		*/
+		void resolve(BaseShader& shader) {
+			for(Slot& slot : slots) {
+				slot.sampler = shader.getUniform<int>(slot.name);
+				if(!slot.sampler.valid())
+					slot.sampler = shader.getUniform<int>(slot.fallbackName);
+			}
+
+			shaderGeneration = shader.getGeneration();
+		}
+
+		std::vector<Slot> slots;
+		uint64_t shaderGeneration = 0;	// Program the handles were resolved for, 0 for none
+};
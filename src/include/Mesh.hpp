@@ -6,38 +6,50 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "shader/BaseShader.hpp"
-
-struct Vertex {
-	glm::vec3 pos;
-	glm::vec3 normal;
-	glm::vec2 texCoord;
-};
-
-struct Texture {
-	GLuint id;
-	
-	std::string type;
-	std::string path;
-};
+#include "Material.hpp"
+#include "Bounds.hpp"
+#include "GeometryPool.hpp"
 
 class Mesh {
 	public:
-		Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures, const std::string name) {
+		static const GLuint INSTANCE_ATTRIB = 3;	// First location of the per-instance model matrix(3 to 6), then its normal matrix(7 to 9)
+
+		/**
+		 * @param pool If set, the mesh is placed in the pool's buffers instead of its own, and shares its VAO
+		 * @param material Shared with other meshes with the same textures so they're batched together, built from `textures` if not set
+		*/
+		Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures, const std::string name, GeometryPool* pool = nullptr, std::shared_ptr<Material> material = nullptr) {
 			this->name     = name;
 			this->vertices = vertices;
 			this->indices  = indices;
 			this->textures = textures;
+			this->material = material ? material : std::make_shared<Material>(textures);
+			computeBounds();
+
+			if(pool){
+				this->pool = pool;
+				range = pool->allocate(vertices, indices);
+				vao = pool->getVAO();
+				vbo = 0;
+				ebo = 0;
+				instanceVBO = 0;
+				instanceCapacity = 0;
+				return;
+			}
+			range.indexCount = indices.size();
 
 			// Setup
 			glGenVertexArrays(1, &vao);
 			glGenBuffers(1, &vbo);
 			glGenBuffers(1, &ebo);
 		
-			glBindVertexArray(vao);
+			GLState::bindVertexArray(vao);
 			glBindBuffer(GL_ARRAY_BUFFER, vbo);
 
 			glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
@@ -55,36 +67,85 @@ class Mesh {
 			glEnableVertexAttribArray(2);	
 			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoord));
 
-			glBindVertexArray(0);
+			// Set per-instance transforms, a mat4 takes 4 locations and a mat3 3. Starts with one identity so non-instanced draws read valid data
+			const InstanceTransform identity;
+			glGenBuffers(1, &instanceVBO);
+			glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(InstanceTransform), &identity, GL_STREAM_DRAW);
+			instanceCapacity = 1;
+			for(GLuint i = 0; i < 4; i++) {
+				glEnableVertexAttribArray(INSTANCE_ATTRIB + i);
+				glVertexAttribPointer(INSTANCE_ATTRIB + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), (void*)(offsetof(InstanceTransform, model) + sizeof(glm::vec4) * i));
+				glVertexAttribDivisor(INSTANCE_ATTRIB + i, 1);
+			}
+			for(GLuint i = 0; i < 3; i++) {
+				glEnableVertexAttribArray(INSTANCE_ATTRIB + 4 + i);
+				glVertexAttribPointer(INSTANCE_ATTRIB + 4 + i, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), (void*)(offsetof(InstanceTransform, normal) + sizeof(glm::vec3) * i));
+				glVertexAttribDivisor(INSTANCE_ATTRIB + 4 + i, 1);
+			}
+
+			GLState::bindVertexArray(0);
 		}
+		/**
+		 * @brief Binds the mesh's material and draws it
+		 * @note Leaves its VAO and textures bound, whatever draws next binds its own
+		*/
 		void draw(BaseShader &shader) {
-			GLuint diffuseNr = 1;
-			GLuint specularNr = 1;
-			
-			for(GLuint i = 0; i < textures.size(); i++) {
-				glActiveTexture(GL_TEXTURE0 + i);
-
-				std::string name = textures[i].type;
-				std::string number;	// The texture number(N in diffuseTextureN)
-				
-				// Compare type
-				if(name == "diffuseTexture"){
-					number = std::to_string(diffuseNr);
-					diffuseNr++;
-				} else if(name == "specMap"){
-					number = std::to_string(specularNr);
-					specularNr++;
-				}
-				
-				shader.setInt(("material." + name).c_str(), i);
-				glBindTexture(GL_TEXTURE_2D, textures[i].id);
+			material->bind(shader);
+
+			GLState::setBlend(true);
+			GLState::setPolygonMode(GL_FILL);
+			GLState::bindVertexArray(vao);
+			drawElements();
+		}
+		/**
+		 * @brief Issues the draw call alone, the material and VAO must already be bound
+		*/
+		void drawElements() const {
+			if(pool)
+				glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, (void*)(range.firstIndex * sizeof(GLuint)), range.baseVertex);
+			else
+				glDrawElements(GL_TRIANGLES, static_cast<GLuint>(indices.size()), GL_UNSIGNED_INT, 0);
+		}
+		/**
+		 * @brief Streams instance transforms into the instance buffer, orphaning last frame's storage so the upload doesn't stall
+		*/
+		void uploadInstances(const InstanceTransform* transforms, const GLsizei count) {
+			if(pool){
+				pool->uploadInstances(transforms, count);
+				return;
 			}
 
-			// Draw
-			glBindVertexArray(vao);
-			glDrawElements(GL_TRIANGLES, static_cast<GLuint>(indices.size()), GL_UNSIGNED_INT, 0);
-			glBindTexture(GL_TEXTURE_2D, 0);
-			glBindVertexArray(0);
+			glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+			if(count > instanceCapacity){
+				instanceCapacity = std::max(count, instanceCapacity * 2);
+			}
+			glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(InstanceTransform), nullptr, GL_STREAM_DRAW);
+			glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(InstanceTransform), transforms);
+		}
+		/**
+		 * @brief Draws the first `count` uploaded instances, the material and VAO must already be bound
+		*/
+		void drawElementsInstanced(const GLsizei count) const {
+			if(pool)
+				glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, (void*)(range.firstIndex * sizeof(GLuint)), count, range.baseVertex);
+			else
+				glDrawElementsInstanced(GL_TRIANGLES, static_cast<GLuint>(indices.size()), GL_UNSIGNED_INT, 0, count);
+		}
+		/**
+		 * @brief Returns the pool the mesh was placed in, nullptr if it has its own buffers
+		*/
+		GeometryPool* getPool() const {
+			return pool;
+		}
+		/**
+		 * @brief Returns where the mesh's vertices and indices are in its buffers
+		*/
+		const GeometryRange& getRange() const {
+			return range;
+		}
+		const std::vector<Vertex>& getVertices() const {
+			return vertices;
 		}
 		const std::vector<GLuint>& getIndices() const {
 			return indices;
@@ -92,6 +153,21 @@ class Mesh {
 		const std::vector<Texture>& getTextures() const {
 			return textures;
 		}
+		Material& getMaterial() {
+			return *material;
+		}
+		/**
+		 * @brief Returns the box around the vertices, in model space
+		*/
+		const BoundingBox& getBounds() const {
+			return bounds;
+		}
+		/**
+		 * @brief Returns the sphere around the vertices, centered on the box, in model space
+		*/
+		const BoundingSphere& getBoundingSphere() const {
+			return boundingSphere;
+		}
 		GLuint getVAO() const {
 			return vao;
 		}
@@ -105,12 +181,34 @@ class Mesh {
 			return name;
 		}
 	private:
+		void computeBounds() {
+			for(const Vertex& vertex : vertices) {
+				bounds.expand(vertex.pos);
+			}
+			if(!bounds.valid())
+				return;
+
+			boundingSphere.center = bounds.center();
+			for(const Vertex& vertex : vertices) {
+				boundingSphere.radius = std::max(boundingSphere.radius, glm::length(vertex.pos - boundingSphere.center));
+			}
+		}
+
 		GLuint vao;
 		GLuint vbo;
 		GLuint ebo;
+		GLuint instanceVBO;
+		GLsizei instanceCapacity;	// In instances
+
+		GeometryPool* pool = nullptr;
+		GeometryRange range;
 
 		std::string name;
 		std::vector<Vertex> vertices;
 		std::vector<GLuint> indices;
 		std::vector<Texture> textures;
+		std::shared_ptr<Material> material;	// Built from `textures` at load, shared by meshes with the same textures
+
+		BoundingBox bounds;
+		BoundingSphere boundingSphere;
 };
@@ -9,11 +9,14 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include <algorithm>
+#include <memory>
 #include <string>
 #include <string_view>
 #include <vector>
 
 #include "Mesh.hpp"
+#include "RenderQueue.hpp"
 #include "shader/BaseShader.hpp"
 #include "FileHandler.hpp"
 
@@ -37,9 +40,12 @@ class Model {
 		/**
 		 * @brief Initializes the model, loads it and its textures
 		 * @param path The path to the model
+		 * @param pool If set, the meshes are placed in the pool's shared buffers, for static models
 		 * @note If path is set to an empty string, it just sets 'directory' to "" and exits
 		*/
-		bool initialize(const char* path) {
+		bool initialize(const char* path, GeometryPool* pool = nullptr) {
+			this->pool = pool;
+
 			// Don't load if using empty path
 			if(*path == '\0'){
 				directory = "";
@@ -70,6 +76,10 @@ class Model {
 			
 			processNode(scene->mRootNode, scene);
 
+			for(const Mesh& mesh : meshes) {
+				bounds.expand(mesh.getBounds());
+			}
+
 			return true;
 		}
 		/**
@@ -81,6 +91,15 @@ class Model {
 				meshes[i].draw(shader);
 			}
 		}
+		/**
+		 * @brief Queues every mesh to be drawn with the same transform
+		 * @param transform The model matrix
+		*/
+		void submit(RenderQueue& queue, BaseShader& shader, const glm::mat4& transform) {
+			for(Mesh& mesh : meshes) {
+				queue.add(shader, mesh, transform);
+			}
+		}
 		/**
 		 * @brief Gets a pointer to the mesh
 		 * @param name The name of the desired mesh
@@ -94,6 +113,28 @@ class Model {
 		const std::vector<Mesh>& getMeshes() const {
 			return meshes;
 		}
+		/**
+		 * @brief Returns the box around every mesh, in model space
+		*/
+		const BoundingBox& getBounds() const {
+			return bounds;
+		}
+		/**
+		 * @brief Returns every mesh's triangles as 3 vertices each, in model space
+		 * @note The layout the collider functions take, eg. ShapeCache::getModel()
+		*/
+		std::vector<Vertex> getCollisionTriangles() const {
+			std::vector<Vertex> triangles;
+			for(const Mesh& mesh : meshes) {
+				const std::vector<Vertex>& vertices = mesh.getVertices();
+				for(const GLuint index : mesh.getIndices()) {
+					if(index < vertices.size())
+						triangles.push_back(vertices[index]);
+				}
+			}
+
+			return triangles;
+		}
 	private:
 		void processNode(aiNode* node, const aiScene* scene) {
 			// Process the node's meshes
@@ -163,7 +204,23 @@ class Model {
 				textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
 			}
 
-			return Mesh(vertices, indices, textures, (std::string)mesh->mName.C_Str());
+			return Mesh(vertices, indices, textures, (std::string)mesh->mName.C_Str(), pool, findMaterial(textures));
+		}
+		/**
+		 * @brief Returns the material of meshes with these textures, created on first use
+		 * @note Meshes sharing a material share its sort key, so pooled ones are drawn in one batch
+		*/
+		std::shared_ptr<Material> findMaterial(const std::vector<Texture>& textures) {
+			for(const std::pair<std::vector<Texture>, std::shared_ptr<Material>>& material : materials) {
+				const std::vector<Texture>& other = material.first;
+				if(std::equal(textures.begin(), textures.end(), other.begin(), other.end(), [](const Texture& a, const Texture& b) {
+					return a.id == b.id && a.type == b.type;
+				}))
+					return material.second;
+			}
+
+			materials.emplace_back(textures, std::make_shared<Material>(textures));
+			return materials.back().second;
 		}
 		std::vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName) {
 			std::vector<Texture> textures;
@@ -188,7 +245,7 @@ class Model {
 					// Texture load preperation
 					GLuint textureID;
 					glGenTextures(1, &textureID);
-					glBindTexture(GL_TEXTURE_2D, textureID);
+					GLState::bindTexture(0, textureID);
 
 					// Set struct properties
 					bool status = FileHandler::loadImage(directory + '/' + str.C_Str());	// Load texture with local path
@@ -207,5 +264,8 @@ class Model {
 
 		std::vector<Mesh> 		meshes;			// Meshes of the model
 		std::vector<Texture> 	loadedTextures;	// Loaded textures, allows reuse between meshes
+		std::vector<std::pair<std::vector<Texture>, std::shared_ptr<Material>>> materials;	// Each texture set's material, shared between meshes
 		std::string 			directory;		// The model base directory
+		BoundingBox				bounds;			// Union of the meshes' bounds
+		GeometryPool*			pool = nullptr;	// Where the meshes are placed, nullptr for their own buffers
 };
@@ -0,0 +1,312 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64)
+	#include <emmintrin.h>
+	#define OCCLUSION_SSE
+#endif
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "Bounds.hpp"
+
+/**
+ * @brief Counts from the frame since OcclusionCuller::begin()
+*/
+struct OcclusionStats {
+	uint32_t occluderTriangles = 0;		// Triangles given to addOccluder()
+	uint32_t rasterizedTriangles = 0;	// Triangles left after rejection and near plane clipping
+	uint32_t tested = 0;				// Boxes given to isVisible()
+	uint32_t occluded = 0;				// Boxes found hidden
+};
+
+/**
+ * @brief Software occlusion culling, occluders are rasterized into a small depth buffer on the CPU and boxes tested against it
+ * @details Each frame: begin() with the camera, addOccluder() the meshes that hide things(terrain, large static bodies),
+ * @details then isVisible() each renderable's world box before it's submitted. Pixels are processed 4 at a time with SSE2
+ * @details The buffer holds NDC depth. Occluders write the furthest depth they reach inside each pixel, and boxes are
+ * @details tested with their nearest depth over their screen rectangle grown by a pixel, so edge and depth errors make
+ * @details boxes visible, not hidden. Boxes crossing the near plane are always visible
+ * @details Coverage is sampled at pixel centers, so a gap thinner than a pixel between two separate occluders can still
+ * @details hide what's behind it. Watertight occluders like the terrain mesh don't have any
+ * @note Doesn't need a GL context, so it can be run and timed headlessly, see culling_bench
+*/
+class OcclusionCuller {
+	public:
+		/**
+		 * @param width Buffer width in pixels, rounded up to a multiple of 4
+		 * @param height Buffer height in pixels
+		*/
+		OcclusionCuller(const int width = 256, const int height = 128) {
+			resize(width, height);
+		}
+		void resize(const int width, const int height) {
+			this->width = (std::max(width, 4) + 3) & ~3;
+			this->height = std::max(height, 1);
+			depth.assign(this->width * this->height, CLEAR_DEPTH);
+		}
+		/**
+		 * @brief Clears the buffer for a new frame
+		*/
+		void begin(const glm::mat4& viewProjection) {
+			this->viewProjection = viewProjection;
+			std::fill(depth.begin(), depth.end(), CLEAR_DEPTH);
+			stats = OcclusionStats();
+		}
+		/**
+		 * @brief Rasterizes an indexed triangle mesh into the buffer
+		 * @param positions The first vertex position, each `stride` bytes apart(eg. &vertices[0].pos, sizeof(Vertex))
+		 * @param model The mesh's transform
+		*/
+		void addOccluder(const glm::vec3* positions, const size_t stride, const size_t vertexCount, const uint32_t* indices, const size_t indexCount, const glm::mat4& model = glm::mat4(1.f)) {
+			const glm::mat4 transform = viewProjection * model;
+			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(positions);
+
+			clipVertices.resize(vertexCount);
+			for(size_t i = 0; i < vertexCount; i++) {
+				const glm::vec3& position = *reinterpret_cast<const glm::vec3*>(bytes + i * stride);
+				clipVertices[i] = transform * glm::vec4(position, 1.f);
+			}
+
+			for(size_t i = 0; i + 2 < indexCount; i += 3) {
+				rasterizeClipped(clipVertices[indices[i]], clipVertices[indices[i + 1]], clipVertices[indices[i + 2]]);
+			}
+			stats.occluderTriangles += indexCount / 3;
+		}
+		/**
+		 * @brief Returns if any part of a world space box may be seen past the occluders
+		*/
+		bool isVisible(const BoundingBox& box) {
+			stats.tested++;
+			if(!box.valid())
+				return true;
+
+			// Screen rectangle and nearest depth of the corners
+			glm::vec2 screenMin(std::numeric_limits<float>::max());
+			glm::vec2 screenMax(std::numeric_limits<float>::lowest());
+			float nearest = std::numeric_limits<float>::max();
+			for(int corner = 0; corner < 8; corner++) {
+				const glm::vec3 point(
+					(corner & 1) ? box.max.x : box.min.x,
+					(corner & 2) ? box.max.y : box.min.y,
+					(corner & 4) ? box.max.z : box.min.z
+				);
+				const glm::vec4 clip = viewProjection * glm::vec4(point, 1.f);
+				if(clip.w <= NEAR_W || clip.z < -clip.w)
+					return true;	// Crosses the near plane
+
+				const glm::vec2 screen = toScreen(clip);
+				screenMin = glm::min(screenMin, screen);
+				screenMax = glm::max(screenMax, screen);
+				nearest = std::min(nearest, clip.z / clip.w);
+			}
+
+			// Grown by a pixel, starting on a multiple of 4 so each row is read in whole groups of 4
+			const int minX = std::max((int)std::floor(screenMin.x) - 1, 0) & ~3;
+			const int minY = std::max((int)std::floor(screenMin.y) - 1, 0);
+			const int maxX = std::min((int)std::floor(screenMax.x) + 1, width - 1);
+			const int maxY = std::min((int)std::floor(screenMax.y) + 1, height - 1);
+			if(minX > maxX || minY > maxY)
+				return true;	// Off screen, left to frustum culling
+
+			// Equal depths count as visible, so an occluder never hides its own box
+			for(int y = minY; y <= maxY; y++) {
+				const float* row = &depth[y * width];
+
+				#ifdef OCCLUSION_SSE
+					const __m128 boxDepth = _mm_set1_ps(nearest);
+					for(int x = minX; x <= maxX; x += 4) {
+						if(_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), boxDepth)))
+							return true;
+					}
+				#else
+					for(int x = minX; x <= maxX; x++) {
+						if(row[x] >= nearest)
+							return true;
+					}
+				#endif
+			}
+
+			stats.occluded++;
+			return false;
+		}
+		const OcclusionStats& getStats() const {
+			return stats;
+		}
+		int getWidth() const {
+			return width;
+		}
+		int getHeight() const {
+			return height;
+		}
+		/**
+		 * @brief Gets the buffer, row-major from the bottom left, `CLEAR_DEPTH` where nothing was drawn
+		*/
+		const float* getDepth() const {
+			return depth.data();
+		}
+
+		static constexpr float CLEAR_DEPTH = std::numeric_limits<float>::max();
+	private:
+		static constexpr float NEAR_W = 1e-5f;	// Smallest w that's divided by
+
+		/**
+		 * @brief Rejects a clip space triangle outside the frustum, clips it against the near plane and rasterizes what's left
+		*/
+		void rasterizeClipped(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c) {
+			// Every vertex outside the same plane
+			for(int axis = 0; axis < 3; axis++) {
+				if(a[axis] > a.w && b[axis] > b.w && c[axis] > c.w)
+					return;
+				if(a[axis] < -a.w && b[axis] < -b.w && c[axis] < -c.w)
+					return;
+			}
+
+			const glm::vec4 input[3] = { a, b, c };
+			if(a.z >= -a.w && b.z >= -b.w && c.z >= -c.w){
+				rasterize(input[0], input[1], input[2]);
+				return;
+			}
+
+			// Sutherland-Hodgman against z = -w, a triangle becomes at most a quad
+			glm::vec4 clipped[4];
+			int count = 0;
+			for(int i = 0; i < 3; i++) {
+				const glm::vec4& current = input[i];
+				const glm::vec4& next = input[(i + 1) % 3];
+				const float currentDistance = current.z + current.w;
+				const float nextDistance = next.z + next.w;
+
+				if(currentDistance >= 0.f)
+					clipped[count++] = current;
+				if((currentDistance >= 0.f) != (nextDistance >= 0.f))
+					clipped[count++] = current + (next - current) * (currentDistance / (currentDistance - nextDistance));
+			}
+
+			for(int i = 1; i + 1 < count; i++) {
+				rasterize(clipped[0], clipped[i], clipped[i + 1]);
+			}
+		}
+		/**
+		 * @brief Rasterizes a triangle in front of the near plane, keeping the nearest depth of each covered pixel
+		 * @details Coverage is tested at pixel centers with edge functions, the depth written is the plane's furthest
+		 * @details inside the pixel, clamped to the triangle's furthest vertex
+		*/
+		void rasterize(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c) {
+			if(a.w <= NEAR_W || b.w <= NEAR_W || c.w <= NEAR_W)
+				return;
+
+			glm::vec3 p0(toScreen(a), a.z / a.w);
+			glm::vec3 p1(toScreen(b), b.z / b.w);
+			glm::vec3 p2(toScreen(c), c.z / c.w);
+
+			float area = (p1.x - p0.x) * (p2.y - p0.y) - (p2.x - p0.x) * (p1.y - p0.y);
+			if(std::abs(area) < 1e-8f)
+				return;
+			if(area < 0.f){	// Both faces are drawn, counter-clockwise from here
+				std::swap(p1, p2);
+				area = -area;
+			}
+
+			const int minX = std::max((int)std::floor(std::min({ p0.x, p1.x, p2.x })), 0) & ~3;
+			const int minY = std::max((int)std::floor(std::min({ p0.y, p1.y, p2.y })), 0);
+			const int maxX = std::min((int)std::floor(std::max({ p0.x, p1.x, p2.x })), width - 1);
+			const int maxY = std::min((int)std::floor(std::max({ p0.y, p1.y, p2.y })), height - 1);
+			if(minX > maxX || minY > maxY)
+				return;
+			stats.rasterizedTriangles++;
+
+			// Edge functions E(x, y) = A * x + B * y + C, positive inside
+			const glm::vec3 points[3] = { p0, p1, p2 };
+			float edgeA[3];
+			float edgeB[3];
+			float edgeC[3];
+			for(int i = 0; i < 3; i++) {
+				const glm::vec3& from = points[i];
+				const glm::vec3& to = points[(i + 1) % 3];
+				edgeA[i] = from.y - to.y;
+				edgeB[i] = to.x - from.x;
+				edgeC[i] = -(edgeA[i] * from.x + edgeB[i] * from.y);
+			}
+
+			// Depth plane, pushed back to its furthest inside each pixel
+			const glm::vec3 e1 = p1 - p0;
+			const glm::vec3 e2 = p2 - p0;
+			const float dzdx = (e1.z * e2.y - e2.z * e1.y) / area;
+			const float dzdy = (e2.z * e1.x - e1.z * e2.x) / area;
+			const float zBias = 0.5f * (std::abs(dzdx) + std::abs(dzdy));
+			const float zMax = std::max({ p0.z, p1.z, p2.z });
+			const float zC = p0.z - dzdx * p0.x - dzdy * p0.y + zBias;
+
+			for(int y = minY; y <= maxY; y++) {
+				const float py = y + 0.5f;
+				float* row = &depth[y * width];
+
+				#ifdef OCCLUSION_SSE
+					const __m128 steps = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+					const __m128 zero = _mm_setzero_ps();
+					const __m128 maxDepth = _mm_set1_ps(zMax);
+					const __m128 x0 = _mm_add_ps(_mm_set1_ps((float)minX), steps);
+
+					__m128 edges[3];
+					__m128 edgeSteps[3];
+					for(int i = 0; i < 3; i++) {
+						edges[i] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edgeA[i]), x0), _mm_set1_ps(edgeB[i] * py + edgeC[i]));
+						edgeSteps[i] = _mm_set1_ps(edgeA[i] * 4.f);
+					}
+					__m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(dzdx), x0), _mm_set1_ps(dzdy * py + zC));
+					const __m128 zStep = _mm_set1_ps(dzdx * 4.f);
+
+					for(int x = minX; x <= maxX; x += 4) {
+						const __m128 inside = _mm_and_ps(
+							_mm_and_ps(_mm_cmpge_ps(edges[0], zero), _mm_cmpge_ps(edges[1], zero)),
+							_mm_cmpge_ps(edges[2], zero)
+						);
+						if(_mm_movemask_ps(inside)){
+							const __m128 current = _mm_loadu_ps(row + x);
+							const __m128 nearer = _mm_min_ps(current, _mm_min_ps(z, maxDepth));
+							_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, current)));
+						}
+
+						for(int i = 0; i < 3; i++) {
+							edges[i] = _mm_add_ps(edges[i], edgeSteps[i]);
+						}
+						z = _mm_add_ps(z, zStep);
+					}
+				#else
+					for(int x = minX; x <= maxX; x++) {
+						const float px = x + 0.5f;
+						bool inside = true;
+						for(int i = 0; i < 3; i++) {
+							inside &= edgeA[i] * px + edgeB[i] * py + edgeC[i] >= 0.f;
+						}
+						if(inside)
+							row[x] = std::min(row[x], std::min(dzdx * px + dzdy * py + zC, zMax));
+					}
+				#endif
+			}
+		}
+		/**
+		 * @brief Maps a clip space point to buffer pixels
+		*/
+		glm::vec2 toScreen(const glm::vec4& clip) const {
+			return glm::vec2(
+				(clip.x / clip.w * 0.5f + 0.5f) * width,
+				(clip.y / clip.w * 0.5f + 0.5f) * height
+			);
+		}
+
+		int width;
+		int height;
+		std::vector<float> depth;		// Row-major, `width` is a multiple of 4 so rows split into groups of 4
+		std::vector<glm::vec4> clipVertices;	// Reused by addOccluder()
+
+		glm::mat4 viewProjection = glm::mat4(1.f);
+		OcclusionStats stats;
+};
@@ -2,11 +2,22 @@
 
 #include <GL/glew.h>
 #include <GL/glu.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 
+#include <bullet/btBulletDynamicsCommon.h>
+#include <bullet/BulletDynamics/Dynamics/btActionInterface.h>
+#include <bullet/BulletCollision/CollisionShapes/btHeightfieldTerrainShape.h>
+
+#include <algorithm>
 #include <iostream>
+#include <cstddef>
+#include <cstring>
 #include <memory>
+#include <vector>
 
 #include "UI.hpp"
+#include "Frustum.hpp"
 #include "shader/ColliderShader.hpp"
 
 
@@ -19,11 +30,8 @@ class PhysicsDrawer : public btIDebugDraw {
 			initOpenGL();
 		}
 		~PhysicsDrawer() {
-			glDeleteBuffers(1, &vboLine);
-			glDeleteBuffers(1, &vboLineColor);
-			glDeleteBuffers(1, &vboTriangle);
-			glDeleteBuffers(1, &vboTriangleColor);
-			glDeleteVertexArrays(1, &vao);
+			releaseBuffer();
+			GLState::deleteVertexArray(vao);
 
 			delete ui;
 		}
@@ -38,45 +46,25 @@ class PhysicsDrawer : public btIDebugDraw {
 		 * @brief Pushes a line's vertices to the internal buffer with a color gradient
 		 */
 		void drawLine(const btVector3& from, const btVector3& to, const btVector3& fromColor, const btVector3& toColor) override {
-			vertices.push_back(from.getX());
-			vertices.push_back(from.getY());
-			vertices.push_back(from.getZ());
-			colors.push_back(fromColor.getX());
-			colors.push_back(fromColor.getY());
-			colors.push_back(fromColor.getZ());
+			if(!withinBudget(1)){
+				droppedLines++;
+				return;
+			}
 
-			vertices.push_back(to.getX());
-			vertices.push_back(to.getY());
-			vertices.push_back(to.getZ());
-			colors.push_back(toColor.getX());
-			colors.push_back(toColor.getY());
-			colors.push_back(toColor.getZ());
+			lines.push_back({ makeVertex(from, fromColor), makeVertex(to, toColor) });
 		}
 		/**
 		 * @brief Pushes a triange's vertices to the internal buffer
 		 * @note `alpha` is discarded
+		 * @note Costs as many lines as its edges from the line budget
 		 */
 		void drawTriangle(const btVector3& a, const btVector3& b, const btVector3& c, const btVector3& color, btScalar alpha) override {
-			triangles.push_back(a.getX());
-			triangles.push_back(a.getY());
-			triangles.push_back(a.getZ());
-			triColors.push_back(color.getX());
-			triColors.push_back(color.getY());
-			triColors.push_back(color.getZ());
-
-			triangles.push_back(b.getX());
-			triangles.push_back(b.getY());
-			triangles.push_back(b.getZ());
-			triColors.push_back(color.getX());
-			triColors.push_back(color.getY());
-			triColors.push_back(color.getZ());
-
-			triangles.push_back(c.getX());
-			triangles.push_back(c.getY());
-			triangles.push_back(c.getZ());
-			triColors.push_back(color.getX());
-			triColors.push_back(color.getY());
-			triColors.push_back(color.getZ());
+			if(!withinBudget(TRIANGLE_COST)){
+				droppedLines += TRIANGLE_COST;
+				return;
+			}
+
+			triangles.push_back({ makeVertex(a, color), makeVertex(b, color), makeVertex(c, color) });
 		}
 		/**
 		 * @brief Pushes a line between collision contact points to the buffer 
@@ -108,63 +96,155 @@ class PhysicsDrawer : public btIDebugDraw {
 		}
 		/**
 		 * @brief Renders all lines and triangles added by `drawLine()` and `drawTriangle()`
+		 * @details Both are copied into the next region of the ring buffer in one write, then drawn with
+		 * @details one draw call per primitive type
+		 * @note The staging vectors are cleared but keep their capacity for the next frame
 		 */
 		void flushLines() override {
-			if(vertices.empty() && triangles.empty()) return;
+			lastDroppedLines = droppedLines;
+			droppedLines = 0;
+
+			if(lines.empty() && triangles.empty()) return;
+
+			const GLsizeiptr lineBytes = lines.size() * sizeof(DebugLine);
+			const GLsizeiptr triangleBytes = triangles.size() * sizeof(DebugTriangle);
+			const GLsizeiptr bytes = lineBytes + triangleBytes;
+			if(bytes > regionSize)
+				allocateBuffer(bytes);
 
 			// Bind the shader and set up uniforms
 			shader.bind();
+			GLState::setPolygonMode(GL_FILL);
 
-			glBindVertexArray(vao);
+			GLState::bindVertexArray(vao);
+			glBindBuffer(GL_ARRAY_BUFFER, vbo);
 
-			// Upload line vertices
-			if(!vertices.empty()) {
-				glBindBuffer(GL_ARRAY_BUFFER, vboLine);
-				glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_DYNAMIC_DRAW);
-				glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-				glEnableVertexAttribArray(0);
+			const GLsizeiptr offset = beginRegion();
+			unsigned char* dest = persistent ?
+				mapped + offset :
+				static_cast<unsigned char*>(glMapBufferRange(GL_ARRAY_BUFFER, offset, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+			if(dest != nullptr){
+				std::memcpy(dest, lines.data(), lineBytes);
+				std::memcpy(dest + lineBytes, triangles.data(), triangleBytes);
+				if(!persistent)
+					glUnmapBuffer(GL_ARRAY_BUFFER);
 
-				// Upload line colors
-				glBindBuffer(GL_ARRAY_BUFFER, vboLineColor);
-				glBufferData(GL_ARRAY_BUFFER, colors.size() * sizeof(GLfloat), colors.data(), GL_DYNAMIC_DRAW);
-				glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-				glEnableVertexAttribArray(1);
+				const GLint first = offset / sizeof(DebugVertex);
+				if(!lines.empty())
+					glDrawArrays(GL_LINES, first, lines.size() * 2);
+				if(!triangles.empty())
+					glDrawArrays(GL_TRIANGLES, first + lines.size() * 2, triangles.size() * 3);
+			} else {
+				std::cerr << "PhysicsDrawer::flushLines(): Unable to map vertex buffer\n";
+			}
+			endRegion();
 
-				glDrawArrays(GL_LINES, 0, vertices.size() / 3);
+			GLState::bindVertexArray(0);
 
-				// Clear the buffers
-				vertices.clear();
-				colors.clear();
+			lines.clear();
+			triangles.clear();
+		}
+		/**
+		 * @brief Draws the objects whose AABBs intersect the camera's frustum, then flushes
+		 * @details Replaces btCollisionWorld::debugDrawWorld(), which draws every object and every triangle of
+		 * @details each heightfield. Objects are drawn nearest first, so the line budget is spent close to the camera
+		 * @details and traversal stops once it runs out. Heightfields only draw cells within the heightfield radius
+		 * @note Draws wireframes, AABBs, constraints, actions(eg. vehicles) and contact points, depending on the debug mode
+		 */
+		void drawWorld(btDiscreteDynamicsWorld* world, const CameraData& camera) {
+			const Frustum frustum(camera.viewProjection);
+			const glm::vec3 cameraPos = glm::vec3(camera.position);
+			const btVector3 viewer(cameraPos.x, cameraPos.y, cameraPos.z);
+
+			visibleObjects.clear();
+			for(int i = 0; i < world->getNumCollisionObjects(); i++) {
+				const btCollisionObject* obj = world->getCollisionObjectArray()[i];
+				if(obj->getCollisionFlags() & btCollisionObject::CF_DISABLE_VISUALIZE_OBJECT)
+					continue;
+
+				btVector3 aabbMin;
+				btVector3 aabbMax;
+				obj->getCollisionShape()->getAabb(obj->getWorldTransform(), aabbMin, aabbMax);
+				if(!frustum.intersectsAabb(glm::vec3(aabbMin.getX(), aabbMin.getY(), aabbMin.getZ()), glm::vec3(aabbMax.getX(), aabbMax.getY(), aabbMax.getZ())))
+					continue;
+
+				// Distance to the closest point of the AABB
+				btVector3 closest = viewer;
+				closest.setMax(aabbMin);
+				closest.setMin(aabbMax);
+				visibleObjects.push_back({ obj, (closest - viewer).length2() });
 			}
+			std::sort(visibleObjects.begin(), visibleObjects.end(), [](const VisibleObject& a, const VisibleObject& b) {
+				return a.distance2 < b.distance2;
+			});
 
-			// Upload triangle vertices
-			if(!triangles.empty()) {
-				glBindBuffer(GL_ARRAY_BUFFER, vboTriangle);
-				glBufferData(GL_ARRAY_BUFFER, triangles.size() * sizeof(GLfloat), triangles.data(), GL_DYNAMIC_DRAW);
-				glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-				glEnableVertexAttribArray(0);
+			const DefaultColors colors = getDefaultColors();
+			for(const VisibleObject& visible : visibleObjects) {
+				if(!withinBudget(1))
+					break;
 
-				// Upload triangle colors
-				glBindBuffer(GL_ARRAY_BUFFER, vboTriangleColor);
-				glBufferData(GL_ARRAY_BUFFER, triColors.size() * sizeof(GLfloat), triColors.data(), GL_DYNAMIC_DRAW);
-				glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-				glEnableVertexAttribArray(1);
+				const btCollisionObject* obj = visible.object;
+				if(debugMode & DBG_DrawWireframe){
+					const btVector3 color = getObjectColor(obj, colors);
+					if(obj->getCollisionShape()->getShapeType() == TERRAIN_SHAPE_PROXYTYPE)
+						drawHeightfield(obj, viewer, color);
+					else
+						world->debugDrawObject(obj->getWorldTransform(), obj->getCollisionShape(), color);
+				}
+				if(debugMode & DBG_DrawAabb){
+					btVector3 aabbMin;
+					btVector3 aabbMax;
+					obj->getCollisionShape()->getAabb(obj->getWorldTransform(), aabbMin, aabbMax);
+					drawAabb(aabbMin, aabbMax, colors.m_aabb);
+				}
+			}
 
-				glDrawArrays(GL_TRIANGLES, 0, triangles.size() / 3);
+			// Same conditions as btDiscreteDynamicsWorld::debugDrawWorld(), neither is culled
+			if(debugMode & (DBG_DrawConstraints | DBG_DrawConstraintLimits)){
+				for(int i = world->getNumConstraints() - 1; i >= 0; i--) {
+					world->debugDrawConstraint(world->getConstraint(i));
+				}
+			}
+			if(debugMode & (DBG_DrawWireframe | DBG_DrawAabb | DBG_DrawNormals)){
+				btAlignedObjectArray<btActionInterface*>& actions = ActionList::get(world);
+				for(int i = 0; i < actions.size(); i++) {
+					actions[i]->debugDraw(this);
+				}
+			}
 
-				// Clear the buffers
-				triangles.clear();
-				triColors.clear();
+			if(debugMode & DBG_DrawContactPoints){
+				btDispatcher* dispatcher = world->getDispatcher();
+				for(int i = 0; i < dispatcher->getNumManifolds(); i++) {
+					const btPersistentManifold* manifold = dispatcher->getManifoldByIndexInternal(i);
+					for(int j = 0; j < manifold->getNumContacts(); j++) {
+						const btManifoldPoint& point = manifold->getContactPoint(j);
+						const btVector3& pos = point.getPositionWorldOnB();
+						if(frustum.containsSphere(glm::vec3(pos.getX(), pos.getY(), pos.getZ()), 0.f))
+							drawContactPoint(pos, point.m_normalWorldOnB, point.getDistance(), point.getLifeTime(), colors.m_contactPoint);
+					}
+				}
 			}
 
-			glBindVertexArray(0);
+			flushLines();
 		}
-		/** 
-		 * @brief Sets the view and projection matrixes for the shader
+		/**
+		 * @brief Sets the maximum number of lines drawn per flush, further lines and triangles are dropped
+		 * @param maxLines The budget, or 0 for no limit
 		 */
-		void setCamera(const glm::mat4& cameraView, const float& fov) {
-			shader.bind();
-			shader.perspective(cameraView, fov);
+		void setLineBudget(const size_t maxLines) {
+			lineBudget = maxLines;
+		}
+		/**
+		 * @brief Sets the radius around the camera within which drawWorld() draws heightfield cells
+		 */
+		void setHeightfieldRadius(const float radius) {
+			heightfieldRadius = radius;
+		}
+		/**
+		 * @brief Returns the number of lines dropped by the line budget during the last flush
+		 */
+		size_t getDroppedLines() const {
+			return lastDroppedLines;
 		}
 		/**
 		 * @brief Prints to cerr
@@ -186,30 +266,220 @@ class PhysicsDrawer : public btIDebugDraw {
 			return debugMode;
 		}
 	private:
+		/// @brief Interleaved vertex, 16 bytes
+		struct DebugVertex {
+			GLfloat position[3];
+			GLubyte color[4];	// Normalized RGBA
+		};
+		struct DebugLine {
+			DebugVertex from;
+			DebugVertex to;
+		};
+		struct DebugTriangle {
+			DebugVertex a;
+			DebugVertex b;
+			DebugVertex c;
+		};
+
+		static constexpr int REGIONS = 3;						// Regions in the ring, so the GPU can read one while the next is written
+		static constexpr GLsizeiptr MIN_REGION_SIZE = 1 << 20;	// Bytes per region to start with
+
+		static constexpr size_t TRIANGLE_COST = 3;	// Lines a triangle counts as against the budget
+
+		/// @brief Reaches btDiscreteDynamicsWorld's protected actions, which have no getter
+		struct ActionList : public btDiscreteDynamicsWorld {
+			static btAlignedObjectArray<btActionInterface*>& get(btDiscreteDynamicsWorld* world) {
+				return world->*(&ActionList::m_actions);
+			}
+		};
+
+		struct VisibleObject {
+			const btCollisionObject* object;
+			btScalar distance2;	// Squared distance from the camera to the object's AABB
+		};
+
+		/// @brief Draws the edges of each triangle it's given, in world space
+		class TriangleDrawer : public btTriangleCallback {
+			public:
+				TriangleDrawer(btIDebugDraw* drawer, const btTransform& transform, const btVector3& color) : drawer(drawer), transform(transform), color(color) {}
+				void processTriangle(btVector3* triangle, int partId, int triangleIndex) override {
+					const btVector3 a = transform(triangle[0]);
+					const btVector3 b = transform(triangle[1]);
+					const btVector3 c = transform(triangle[2]);
+
+					drawer->drawLine(a, b, color);
+					drawer->drawLine(b, c, color);
+					drawer->drawLine(c, a, color);
+				}
+			private:
+				btIDebugDraw* drawer;
+				const btTransform& transform;
+				btVector3 color;
+		};
+
+		/**
+		 * @brief Returns if `cost` more lines fit in the budget, triangles count as TRIANGLE_COST lines each
+		 */
+		bool withinBudget(const size_t cost) const {
+			return lineBudget == 0 || lines.size() + triangles.size() * TRIANGLE_COST + cost <= lineBudget;
+		}
+		static DebugVertex makeVertex(const btVector3& position, const btVector3& color) {
+			auto channel = [](const btScalar value) {
+				return (GLubyte)(std::min(std::max((float)value, 0.f), 1.f) * 255.f + 0.5f);
+			};
+
+			return {
+				{ (GLfloat)position.getX(), (GLfloat)position.getY(), (GLfloat)position.getZ() },
+				{ channel(color.getX()), channel(color.getY()), channel(color.getZ()), 255 }
+			};
+		}
+
+		/**
+		 * @brief Draws a heightfield's cells within `heightfieldRadius` of the viewer
+		 */
+		void drawHeightfield(const btCollisionObject* obj, const btVector3& viewer, const btVector3& color) {
+			const btTransform& transform = obj->getWorldTransform();
+			const btVector3 local = transform.invXform(viewer);
+			const btVector3 extent(heightfieldRadius, BT_LARGE_FLOAT, heightfieldRadius);	// Every height in the radius
+
+			TriangleDrawer drawer(this, transform, color);
+			static_cast<const btConcaveShape*>(obj->getCollisionShape())->processAllTriangles(&drawer, local - extent, local + extent);
+		}
+		/**
+		 * @brief Gets the color btCollisionWorld::debugDrawWorld() would use for an object
+		 */
+		static btVector3 getObjectColor(const btCollisionObject* obj, const DefaultColors& colors) {
+			switch(obj->getActivationState()) {
+				case ACTIVE_TAG:
+					return colors.m_activeObject;
+				case ISLAND_SLEEPING:
+					return colors.m_deactivatedObject;
+				case WANTS_DEACTIVATION:
+					return colors.m_wantsDeactivationObject;
+				case DISABLE_DEACTIVATION:
+					return colors.m_disabledDeactivationObject;
+				case DISABLE_SIMULATION:
+					return colors.m_disabledSimulationObject;
+				default:
+					return btVector3(1.f, 0.f, 0.f);
+			}
+		}
 		/**
 		 * @brief Initialize OpenGL components and the shader
 		 */
 		void initOpenGL() {
 			glGenVertexArrays(1, &vao);
-			glBindVertexArray(vao);
-
-			glGenBuffers(1, &vboLine);
-			glGenBuffers(1, &vboLineColor);
-			glGenBuffers(1, &vboTriangle);
-			glGenBuffers(1, &vboTriangleColor);
 
-			glBindVertexArray(0);
+			// Persistently mapped buffers need GL 4.4 or ARB_buffer_storage, otherwise orphan on wrap
+			persistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+			allocateBuffer(MIN_REGION_SIZE);
 
 			shader.loadProgram();
 		}
+		/**
+		 * @brief (Re)creates the ring buffer with regions of at least `minRegionSize` bytes
+		 * @note Grows by doubling, capacity is kept across frames
+		 */
+		void allocateBuffer(const GLsizeiptr minRegionSize) {
+			GLsizeiptr size = std::max(regionSize, MIN_REGION_SIZE);
+			while(size < minRegionSize) {
+				size *= 2;
+			}
+
+			releaseBuffer();
+			regionSize = size;
+			region = 0;
+
+			GLState::bindVertexArray(vao);
+			glGenBuffers(1, &vbo);
+			glBindBuffer(GL_ARRAY_BUFFER, vbo);
+
+			if(persistent){
+				const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+				glBufferStorage(GL_ARRAY_BUFFER, regionSize * REGIONS, nullptr, flags);
+				mapped = static_cast<unsigned char*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, regionSize * REGIONS, flags));
+				if(mapped == nullptr){
+					std::cerr << "PhysicsDrawer::allocateBuffer(): Unable to persistently map buffer, falling back to orphaning\n";
+					persistent = false;
+					glDeleteBuffers(1, &vbo);
+					glGenBuffers(1, &vbo);
+					glBindBuffer(GL_ARRAY_BUFFER, vbo);
+				}
+			}
+			if(!persistent)
+				glBufferData(GL_ARRAY_BUFFER, regionSize * REGIONS, nullptr, GL_STREAM_DRAW);
+
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(DebugVertex), (void*)offsetof(DebugVertex, position));
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(DebugVertex), (void*)offsetof(DebugVertex, color));
+			glEnableVertexAttribArray(1);
+
+			GLState::bindVertexArray(0);
+		}
+		void releaseBuffer() {
+			for(GLsync& fence : fences) {
+				if(fence){
+					glDeleteSync(fence);
+					fence = 0;
+				}
+			}
+
+			if(vbo){
+				if(mapped){
+					glBindBuffer(GL_ARRAY_BUFFER, vbo);
+					glUnmapBuffer(GL_ARRAY_BUFFER);
+					mapped = nullptr;
+				}
+				glDeleteBuffers(1, &vbo);
+				vbo = 0;
+			}
+		}
+		/**
+		 * @brief Waits until the GPU is done with the current region
+		 * @return The region's byte offset
+		 * @note Without persistent mapping, the whole buffer is orphaned when the ring wraps instead
+		 */
+		GLsizeiptr beginRegion() {
+			if(persistent){
+				GLsync& fence = fences[region];
+				if(fence){
+					while(glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+					glDeleteSync(fence);
+					fence = 0;
+				}
+			} else if(region == 0){
+				glBufferData(GL_ARRAY_BUFFER, regionSize * REGIONS, nullptr, GL_STREAM_DRAW);
+			}
+
+			return region * regionSize;
+		}
+		void endRegion() {
+			if(persistent)
+				fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
 
-		std::vector<GLfloat> vertices;	// Vector for line segments
-		std::vector<GLfloat> colors;	// Vector for line segment colors
-		std::vector<GLfloat> triangles;	// Vector for triangles
-		std::vector<GLfloat> triColors;	// Vector for triangle colors
+			region = (region + 1) % REGIONS;
+		}
+
+		std::vector<DebugLine> lines;			// Lines drawn since the last flush
+		std::vector<DebugTriangle> triangles;	// Triangles drawn since the last flush
 
 		int debugMode;
-		GLuint vboLine, vboLineColor, vboTriangle, vboTriangleColor, vao;
+		std::vector<VisibleObject> visibleObjects;	// Reused by drawWorld()
+
+		size_t lineBudget = 100000;		// Maximum lines per flush, 0 for no limit
+		size_t droppedLines = 0;		// Lines dropped since the last flush, dropped triangles count as TRIANGLE_COST
+		size_t lastDroppedLines = 0;	// Lines dropped during the last flush
+		float heightfieldRadius = 64.f;	// Heightfield cells further than this from the camera aren't drawn
+
+		GLuint vao = 0;
+		GLuint vbo = 0;
+
+		// Ring buffer
+		bool persistent = false;			// If `vbo` is persistently mapped to `mapped`
+		unsigned char* mapped = nullptr;
+		GLsizeiptr regionSize = 0;			// Bytes per region
+		int region = 0;						// Region written by the next flush
+		GLsync fences[REGIONS] = {};		// Signaled once the GPU is done reading each region
 
 		UI* ui;	// Pointer to an existing UI class
 		ColliderShader shader;
@@ -8,34 +8,27 @@
 #include <cstdio>
 
 #include "Collision.h"
-#include "PhysicsDrawer.hpp"
+#include "ShapeCache.hpp"
+#include "PhysicsPool.hpp"
+#include "CollisionLayers.hpp"
+#include "Broadphase.hpp"
+#include "PhysicsLOD.hpp"
+#include "PhysicsProfiler.hpp"
+#include "PhysicsRender.h"
 
 class PhysicsEngine {
 	public:
-		PhysicsEngine() {
-			debugDrawer = new PhysicsDrawer();
-		}
+		/**
+		 * @note The debug drawer(and with it, any OpenGL work) is only created once debugDraw() is called,
+		 * @note so the engine can run without a GL context
+		 * @param broadphase The broadphase used by every world the engine creates, see physics_bench to pick one
+		*/
+		PhysicsEngine(const BroadphaseSettings& broadphase = BroadphaseSettings()) : broadphaseSettings(broadphase), debugDrawer(nullptr) {}
 		/**
 		 * @brief Deletes everything in reverse order from which they were instantiated
 		*/
 		~PhysicsEngine() {
-			// Remove rigidbodies from the dynamics world
-			for(int i = dynamicsWorld->getNumCollisionObjects() - 1; i >= 0; i--) {
-				btCollisionObject* obj = dynamicsWorld->getCollisionObjectArray()[i];
-				btRigidBody* body = btRigidBody::upcast(obj);
-				
-				if(body && body->getMotionState())
-					delete body->getMotionState();
-				dynamicsWorld->removeCollisionObject(obj);
-				delete obj;
-			}
-
-			// Delete collision shapes
-			for(int i = 0; i < objArray.size(); i++) {
-				btCollisionShape* shape = objArray[i];
-				objArray[i] = 0;
-				delete shape;
-			}
+			clearWorld();
 
 			delete dynamicsWorld;
 			delete solver;
@@ -44,64 +37,114 @@ class PhysicsEngine {
 			delete collisionConfig;
 
 			delete debugDrawer;
-
-			objArray.clear();
 		}
-		bool init() {
+		/**
+		 * @brief Creates the dynamics world
+		 * @param demoScene If the demo objects should be created and saved as the initial state
+		*/
+		bool init(const bool demoScene = true) {
 			collisionConfig = new btDefaultCollisionConfiguration();
 			dispatcher = new btCollisionDispatcher(collisionConfig);
-			interface = new btDbvtBroadphase();
+			interface = createBroadphase(broadphaseSettings);
 			solver = new btSequentialImpulseConstraintSolver();
 			dynamicsWorld = new btDiscreteDynamicsWorld(dispatcher, interface, solver, collisionConfig);
 
 			dynamicsWorld->setGravity(btVector3(0.f, -10.f, 0.f));
 			dynamicsWorld->setDebugDrawer(debugDrawer);
+			dynamicsWorld->addAction(&lod);
+
+			if(!demoScene)
+				return true;
 
 			///---< Demo Objects >---///
 			// bullet3 dimensions are double that of opengl, ie. 1.0(bullet) -> 0.5(opengl)
 			{	// Static ground, a 10x10x10 cube at (0, 0)
-				btCollisionShape* shape = new btBoxShape(btVector3(btScalar(5.f), btScalar(5.f), btScalar(5.f)));
-				objArray.push_back(shape);
+				btCollisionShape* shape = shapeCache.getBox(btVector3(btScalar(5.f), btScalar(5.f), btScalar(5.f)));
 
 				btTransform transform;
 				transform.setIdentity();
 				transform.setOrigin(btVector3(0.f, 0.f, 0.f));
 				
-				dynamicsWorld->addRigidBody(createRigidBody(shape, transform, 0.f));
+				addRigidBody(pool.createRigidBody(shape, transform, 0.f), CollisionLayers::STATIC);
 			}
 			{	// Dynamic sphere
-				btCollisionShape* shape = new btSphereShape(btScalar(1.f));
-				objArray.push_back(shape);
+				btCollisionShape* shape = shapeCache.getSphere(btScalar(1.f));
 
 				/// Create Dynamic Objects
 				btTransform transform;
 				transform.setIdentity();
 				transform.setOrigin(btVector3(0.f, 64.f, 0.f));
 
-				dynamicsWorld->addRigidBody(createRigidBody(shape, transform, 1.f));
+				addRigidBody(pool.createRigidBody(shape, transform, 1.f), CollisionLayers::DYNAMIC);
 			}
 
 			saveState("./saves/initState.bin");
 
 			return true;
 		}
-		void addRigidBody(btRigidBody* rigidbody) {
+		/**
+		 * @brief Adds a rigidbody to the world, which takes ownership of it and its collision shape
+		 * @note Shapes from `getShapeCache()` are released back to the cache instead of deleted,
+		 * @note so each body must hold its own reference. Bodies and shapes from `getPool()` are recycled instead
+		 * @param layer The body's collision layer, pairs of layers that don't collide are never tested
+		*/
+		void addRigidBody(btRigidBody* rigidbody, const CollisionLayers::Layer layer = CollisionLayers::DEFAULT) {
 			if(rigidbody){
-				if(rigidbody->getCollisionShape())
-					objArray.push_back(rigidbody->getCollisionShape());
-				else
+				btCollisionShape* shape = rigidbody->getCollisionShape();
+				if(shape){
+					if(!shapeCache.contains(shape) && !pool.owns(shape) && objArray.findLinearSearch(shape) == objArray.size())
+						objArray.push_back(shape);
+				} else {
 					throw std::runtime_error("PhysicsEngine::addRigidBody(): Unable to get collision shape");
-				dynamicsWorld->addRigidBody(rigidbody);
+				}
+				CollisionLayers::tag(rigidbody, layer);
+				dynamicsWorld->addRigidBody(rigidbody, layers.getGroup(layer), layers.getMask(layer));
 			} else {
 				throw std::runtime_error("PhysicsEngine::addRigidBody(): Arguement \"rigidbody\" is null");
 			}
 		}
-		void castRay(const glm::vec3& origin, const glm::vec3& direction, const float len) {
+		/**
+		 * @brief Removes a rigidbody from the world, returning ownership of it and its shape to the caller
+		 * @note Used to stream bodies(eg. heightfield tiles) out, add them back with addRigidBody()
+		*/
+		void removeRigidBody(btRigidBody* rigidbody) {
+			if(!rigidbody)
+				throw std::runtime_error("PhysicsEngine::removeRigidBody(): Arguement \"rigidbody\" is null");
+
+			objArray.remove(rigidbody->getCollisionShape());
+			lod.remove(rigidbody);
+			dynamicsWorld->removeRigidBody(rigidbody);
+		}
+		/**
+		 * @brief Removes a rigidbody from the world and destroys it and its motion state, recycling them if pooled
+		 * @note Cached shapes are released, pooled and uncached shapes may be shared and stay until the world is cleared
+		*/
+		void destroyRigidBody(btRigidBody* rigidbody) {
+			if(!rigidbody)
+				throw std::runtime_error("PhysicsEngine::destroyRigidBody(): Arguement \"rigidbody\" is null");
+
+			btCollisionShape* shape = rigidbody->getCollisionShape();
+			lod.remove(rigidbody);
+			dynamicsWorld->removeRigidBody(rigidbody);
+
+			if(!pool.destroyRigidBody(rigidbody)){
+				delete rigidbody->getMotionState();
+				delete rigidbody;
+			}
+			shapeCache.release(shape);
+		}
+		/**
+		 * @brief Casts a ray and prints the position of the hit body
+		 * @param queryMask Layers the ray can hit, see CollisionLayers::getQueryMask()
+		*/
+		void castRay(const glm::vec3& origin, const glm::vec3& direction, const float len, const int queryMask = CollisionLayers::ALL) {
 			btVector3 from = btVector3(origin.x, origin.y, origin.z);
 			btVector3 dir = btVector3(direction.x, direction.y, direction.z);
 			btVector3 to = from + (dir * len);
 			
 			btDynamicsWorld::ClosestRayResultCallback callback(from, to);
+			callback.m_collisionFilterGroup = CollisionLayers::ALL;	// Only filter by the query mask
+			callback.m_collisionFilterMask = queryMask;
 
 			dynamicsWorld->rayTest(from, to, callback);
 
@@ -122,14 +165,41 @@ class PhysicsEngine {
 				}
 			}
 		}
+		/**
+		 * @brief Casts a ray and gets the distance to the closest hit
+		 * @param direction Normalized
+		 * @param distance Set to the distance to the hit
+		 * @param queryMask Layers the ray can hit, see CollisionLayers::getQueryMask()
+		 * @return If anything was hit within `len`
+		*/
+		bool castRay(const glm::vec3& origin, const glm::vec3& direction, const float len, float& distance, const int queryMask = CollisionLayers::ALL) {
+			const btVector3 from = btVector3(origin.x, origin.y, origin.z);
+			const btVector3 to = from + btVector3(direction.x, direction.y, direction.z) * len;
+
+			btDynamicsWorld::ClosestRayResultCallback callback(from, to);
+			callback.m_collisionFilterGroup = CollisionLayers::ALL;	// Only filter by the query mask
+			callback.m_collisionFilterMask = queryMask;
+
+			dynamicsWorld->rayTest(from, to, callback);
+			if(!callback.hasHit())
+				return false;
+
+			distance = callback.m_closestHitFraction * len;
+			return true;
+		}
 		void tick(float delta_t) {
-			dynamicsWorld->stepSimulation(delta_t, 10);
+			profiler.beginTick();
+			const int substeps = dynamicsWorld->stepSimulation(delta_t, 10);
+			profiler.endTick(dynamicsWorld, substeps);
 		}
-		void debugDraw(const glm::mat4& cameraView, const float& cameraFOV, const int debugMode) {
+		void debugDraw(const CameraData& camera, const int debugMode) {
+			if(debugDrawer == nullptr){
+				debugDrawer = createPhysicsDrawer();
+				dynamicsWorld->setDebugDrawer(debugDrawer);
+			}
+
 			debugDrawer->setDebugMode(debugMode);
-			debugDrawer->setCamera(cameraView, cameraFOV);
-			
-			dynamicsWorld->debugDrawWorld();
+			drawPhysicsWorld(debugDrawer, dynamicsWorld, camera);	// Culled to the camera
 		}
 		/**
 		 * @brief Resets the simulation to its starting state
@@ -140,11 +210,13 @@ class PhysicsEngine {
 		}
 		/**
 		 * @brief Saves the current state of the physics engine to a file
+		 * @details Each body is saved with its collision layer as its name, see CollisionLayers::nameObjects()
 		 * @throws runtime_error if it fails to write to the filesystem
 		 */
 		void saveState(const std::string& filename) {
 			btDefaultSerializer* serializer = new btDefaultSerializer();
 			
+			const std::vector<std::string> names = CollisionLayers::nameObjects(dynamicsWorld, serializer);
 			dynamicsWorld->serialize(serializer);
 
 			std::ofstream file(filename, std::ios::binary);
@@ -162,29 +234,14 @@ class PhysicsEngine {
 		 * @throws runtime_error if it fails to read or deserialize the file
 		 */
 		void loadState(const std::string& filename) {
-			for(int i = dynamicsWorld->getNumCollisionObjects() - 1; i >= 0; i--) {
-				btCollisionObject* obj = dynamicsWorld->getCollisionObjectArray()[i];
-				btRigidBody* body = btRigidBody::upcast(obj);
-				
-				if(body && body->getMotionState())
-					delete body->getMotionState();
-				dynamicsWorld->removeCollisionObject(obj);
-				delete obj;
-			}
-			// Delete collision shapes
-			for(int i = 0; i < objArray.size(); i++) {
-				btCollisionShape* shape = objArray[i];
-				objArray[i] = 0;
-				delete shape;
-			}
-			objArray.resize(0);
+			clearWorld();
 
 			int bufferSize;
 			unsigned char* data = getFileData(filename, bufferSize);
 
 			collisionConfig = new btDefaultCollisionConfiguration();
 			dispatcher = new btCollisionDispatcher(collisionConfig);
-			interface = new btDbvtBroadphase();
+			interface = createBroadphase(broadphaseSettings);
 			solver = new btSequentialImpulseConstraintSolver();
 			dynamicsWorld = new btDiscreteDynamicsWorld(dispatcher, interface, solver, collisionConfig);
 
@@ -192,8 +249,10 @@ class PhysicsEngine {
 
 			if(!importer->loadFileFromMemory(reinterpret_cast<char*>(data), bufferSize))
 				throw std::runtime_error("PhysicsEngine::loadState(): Unable to deserialize file at \"" + filename + '"');
+			layers.restore(dynamicsWorld, *importer);
 
 			dynamicsWorld->setDebugDrawer(debugDrawer);
+			dynamicsWorld->addAction(&lod);
 
 			for(int i = 0; i < dynamicsWorld->getNumCollisionObjects(); i++) {
 				btCollisionObject* obj = dynamicsWorld->getCollisionObjectArray()[i];
@@ -203,7 +262,78 @@ class PhysicsEngine {
 			delete[] data;
 			delete importer;
 		}
+		/**
+		 * @brief Gets the shape cache, use it to share collision shapes between bodies
+		*/
+		ShapeCache& getShapeCache() {
+			return shapeCache;
+		}
+		/**
+		 * @brief Gets the body pool, use it for bodies that are spawned and destroyed often(eg. debris)
+		*/
+		BodyPool& getPool() {
+			return pool;
+		}
+		/**
+		 * @brief Gets the collision layers, add layers and change which collide before adding bodies
+		*/
+		CollisionLayers& getLayers() {
+			return layers;
+		}
+		/**
+		 * @brief Gets the simulation LOD, add far away bodies to it and update its viewer every tick
+		*/
+		PhysicsLOD& getLOD() {
+			return lod;
+		}
+		/**
+		 * @brief Gets the profiler, enable it to collect per phase timings of each tick
+		*/
+		PhysicsProfiler& getProfiler() {
+			return profiler;
+		}
+		const BroadphaseSettings& getBroadphaseSettings() const {
+			return broadphaseSettings;
+		}
+		/**
+		 * @brief Gets the dynamics world, for direct access to Bullet(eg. statistics and actions)
+		*/
+		btDiscreteDynamicsWorld* getDynamicsWorld() {
+			return dynamicsWorld;
+		}
 	private:
+		/**
+		 * @brief Removes and deletes every collision object, its motion state and its collision shape
+		 * @note Cached shapes are released to `shapeCache` instead, and only deleted once unreferenced
+		 * @note Pooled bodies and shapes are released all at once, keeping the pool's memory for the next world
+		*/
+		void clearWorld() {
+			lod.clear();
+
+			for(int i = dynamicsWorld->getNumCollisionObjects() - 1; i >= 0; i--) {
+				btCollisionObject* obj = dynamicsWorld->getCollisionObjectArray()[i];
+				btRigidBody* body = btRigidBody::upcast(obj);
+				btCollisionShape* shape = obj->getCollisionShape();
+
+				dynamicsWorld->removeCollisionObject(obj);
+				if(!pool.owns(obj)){
+					if(body && body->getMotionState())
+						delete body->getMotionState();
+					delete obj;
+				}
+
+				shapeCache.release(shape);
+			}
+			pool.clear();
+
+			// Delete uncached collision shapes
+			for(int i = 0; i < objArray.size(); i++) {
+				btCollisionShape* shape = objArray[i];
+				objArray[i] = 0;
+				delete shape;
+			}
+			objArray.clear();
+		}
 		/**
 		 * @brief Loads a file into memory and returns its data
 		 * @param filename The file path to load
@@ -230,9 +360,15 @@ class PhysicsEngine {
 		btDefaultCollisionConfiguration* collisionConfig;	// Default memory and collision setup
 		btCollisionDispatcher* dispatcher;					// Collision handler
 		btBroadphaseInterface* interface;					// AABB collision detection interface
+		BroadphaseSettings broadphaseSettings;				// Type of `interface`
 		btSequentialImpulseConstraintSolver* solver;		// Constraint solver
 		btDiscreteDynamicsWorld* dynamicsWorld;				// Dynamics world
-		btAlignedObjectArray<btCollisionShape*> objArray;	// Collision shape array
-
-		PhysicsDrawer* debugDrawer;
+		btAlignedObjectArray<btCollisionShape*> objArray;	// Uncached collision shape array
+		ShapeCache shapeCache;								// Shared, reference-counted collision shapes
+		BodyPool pool;										// Recycled bodies, motion states and primitive shapes
+		CollisionLayers layers;								// Collision filtering between layers
+		PhysicsLOD lod;										// Distance based simulation tiers
+		PhysicsProfiler profiler;							// Per phase timings, disabled by default
+
+		btIDebugDraw* debugDrawer;	// A PhysicsDrawer, created on first use
 };
\ No newline at end of file
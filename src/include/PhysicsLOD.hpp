@@ -0,0 +1,369 @@
+#pragma once
+
+#include <bullet/btBulletDynamicsCommon.h>
+#include <bullet/BulletDynamics/Dynamics/btActionInterface.h>
+#include <bullet/LinearMath/btTransformUtil.h>
+#include <glm/glm.hpp>
+
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <array>
+
+#include "Frustum.hpp"
+
+/**
+ * @brief How often a body is simulated
+*/
+enum class PhysicsTier : uint8_t {
+	FULL,		// Every step
+	REDUCED,	// Collides every `reducedInterval` steps, moves ballistically in between unless in contact
+	FROZEN		// Not simulated, its velocity is restored once promoted
+};
+
+/**
+ * @brief Per body simulation LOD settings
+*/
+struct PhysicsLODSettings {
+	bool enabled = true;			// If false, the body is always simulated at full rate
+	float reducedDistance = 64.f;	// Bodies further than this from the viewer are REDUCED
+	float frozenDistance = 192.f;	// Bodies further than this from the viewer are FROZEN
+	uint8_t reducedInterval = 4;	// Steps between full steps of a REDUCED body
+	bool canFreeze = true;			// If false, the body is never further than REDUCED
+};
+
+/**
+ * @brief Assigns bodies to simulation tiers by their distance to the viewer, and only simulates far tiers in part
+ * @details Tiers are re-evaluated every step, with hysteresis so bodies on a boundary don't flicker between tiers.
+ * @details Bodies outside the view frustum count as `hiddenDistanceScale` times further away, and a lower tier
+ * @details body touched by a fully simulated one is promoted immediately
+ * @details REDUCED bodies are spread over the interval so each step only collides a fraction of them. Between their
+ * @details collision steps bodies in contact are held still, and free ones are swept along their ballistic motion
+ * @details and collide on the next step if the sweep hits something, so they can't sink into or tunnel through it
+ * @note Add to the world with `world->addAction(&lod)`, bodies must be added to the world before the LOD
+*/
+class PhysicsLOD : public btActionInterface {
+	public:
+		/**
+		 * @param hysteresis Fraction past a tier's distance a body has to move before being demoted
+		 * @param hiddenDistanceScale Distance multiplier for bodies outside the view frustum
+		*/
+		PhysicsLOD(const float hysteresis = 0.1f, const float hiddenDistanceScale = 2.f) : hysteresis(hysteresis), hiddenDistanceScale(hiddenDistanceScale) {}
+		/**
+		 * @brief Starts managing a body's tier
+		 * @note Static and kinematic bodies are ignored, they are never simulated
+		*/
+		void add(btRigidBody* body, const PhysicsLODSettings& settings = PhysicsLODSettings()) {
+			if(body == nullptr || body->isStaticOrKinematicObject() || !settings.enabled || indices.count(body))
+				return;
+
+			Body entry;
+			entry.body = body;
+			entry.settings = settings;
+			entry.settings.reducedInterval = std::max<uint8_t>(settings.reducedInterval, 1);
+			entry.phase = nextPhase++;
+
+			indices[body] = bodies.size();
+			bodies.push_back(entry);
+			tierCounts[(size_t)PhysicsTier::FULL]++;
+		}
+		/**
+		 * @brief Stops managing a body, restoring it to full simulation
+		*/
+		void remove(btRigidBody* body) {
+			auto iter = indices.find(body);
+			if(iter == indices.end())
+				return;
+
+			const size_t index = iter->second;
+			tierCounts[(size_t)bodies[index].tier]--;
+			setTier(bodies[index], PhysicsTier::FULL);
+
+			// Swap and pop
+			bodies[index] = bodies.back();
+			indices[bodies[index].body] = index;
+			bodies.pop_back();
+			indices.erase(iter);
+		}
+		/**
+		 * @brief Stops managing every body, restoring them to full simulation
+		*/
+		void clear() {
+			for(Body& body : bodies) {
+				setTier(body, PhysicsTier::FULL);
+			}
+
+			bodies.clear();
+			indices.clear();
+			tierCounts.fill(0);
+		}
+		/**
+		 * @brief Sets the viewer, with no frustum every body counts as visible
+		*/
+		void setViewer(const glm::vec3& position) {
+			viewer = btVector3(position.x, position.y, position.z);
+			useFrustum = false;
+		}
+		/**
+		 * @brief Sets the viewer and the frustum used to tell if bodies are visible
+		 * @param viewProjection The camera's projection * view matrix
+		*/
+		void setViewer(const glm::vec3& position, const glm::mat4& viewProjection) {
+			viewer = btVector3(position.x, position.y, position.z);
+			frustum = Frustum(viewProjection);
+			useFrustum = true;
+		}
+		PhysicsTier getTier(const btCollisionObject* body) const {
+			auto iter = indices.find(body);
+			return (iter != indices.end()) ? bodies[iter->second].tier : PhysicsTier::FULL;
+		}
+		/**
+		 * @brief Returns the number of managed bodies in a tier
+		*/
+		size_t count(const PhysicsTier tier) const {
+			return tierCounts[(size_t)tier];
+		}
+		size_t size() const {
+			return bodies.size();
+		}
+		/**
+		 * @brief Moves bodies skipped this step, then re-evaluates every tier for the next step
+		*/
+		void updateAction(btCollisionWorld* collisionWorld, btScalar step) override {
+			promoteTouched(collisionWorld->getDispatcher());
+
+			for(Body& body : bodies) {
+				const bool blocked = body.skipped && !extrapolate(body, collisionWorld, step);
+				body.touching = false;
+
+				if(body.holdSteps > 0)
+					body.holdSteps--;
+
+				const PhysicsTier tier = (body.holdSteps > 0) ? PhysicsTier::FULL : evaluateTier(body);
+				if(tier != body.tier){
+					tierCounts[(size_t)body.tier]--;
+					tierCounts[(size_t)tier]++;
+				}
+				setTier(body, tier);
+
+				// REDUCED bodies take turns, only those whose phase matches or whose sweep hit something collide next step
+				if(body.tier == PhysicsTier::REDUCED)
+					setSkipped(body, !blocked && (stepCount + body.phase) % body.settings.reducedInterval != 0);
+			}
+
+			stepCount++;
+		}
+		void debugDraw(btIDebugDraw* debugDrawer) override {}
+	private:
+		struct Body {
+			btRigidBody* body;
+			PhysicsLODSettings settings;
+			PhysicsTier tier = PhysicsTier::FULL;
+			uint8_t phase = 0;			// Offset into the REDUCED interval
+			bool skipped = false;		// Simulation disabled for the current step
+			bool touching = false;		// Has contact points this step, set by promoteTouched()
+			uint16_t holdSteps = 0;		// Steps left at FULL after being hit
+			int activationState = ACTIVE_TAG;	// Activation state before being disabled
+
+			// Velocities before being frozen
+			btVector3 linearVelocity = btVector3(0.f, 0.f, 0.f);
+			btVector3 angularVelocity = btVector3(0.f, 0.f, 0.f);
+		};
+
+		/**
+		 * @brief Picks a body's tier from its distance to the viewer
+		*/
+		PhysicsTier evaluateTier(const Body& body) const {
+			btVector3 aabbMin;
+			btVector3 aabbMax;
+			body.body->getAabb(aabbMin, aabbMax);
+			const btVector3 center = (aabbMin + aabbMax) * 0.5f;
+			const float radius = (aabbMax - center).length();
+
+			float distance = std::max((float)(center - viewer).length() - radius, 0.f);
+			if(useFrustum && !frustum.containsSphere(glm::vec3(center.getX(), center.getY(), center.getZ()), radius))
+				distance *= hiddenDistanceScale;
+
+			// Demoting needs to pass the boundary by the hysteresis, promoting only needs to reach it
+			const PhysicsLODSettings& settings = body.settings;
+			const float reducedDistance = settings.reducedDistance * ((body.tier == PhysicsTier::FULL) ? (1.f + hysteresis) : 1.f);
+			const float frozenDistance = settings.frozenDistance * ((body.tier != PhysicsTier::FROZEN) ? (1.f + hysteresis) : 1.f);
+
+			if(settings.canFreeze && distance > frozenDistance)
+				return PhysicsTier::FROZEN;
+			if(distance > reducedDistance)
+				return PhysicsTier::REDUCED;
+			return PhysicsTier::FULL;
+		}
+		/**
+		 * @brief Moves a body into a tier, freezing or restoring its velocity
+		*/
+		void setTier(Body& body, const PhysicsTier tier) {
+			if(tier == body.tier)
+				return;
+
+			if(body.tier == PhysicsTier::FROZEN){
+				body.body->setLinearVelocity(body.linearVelocity);
+				body.body->setAngularVelocity(body.angularVelocity);
+			}
+
+			if(tier == PhysicsTier::FROZEN){
+				setSkipped(body, true);
+				body.linearVelocity = body.body->getLinearVelocity();
+				body.angularVelocity = body.body->getAngularVelocity();
+				body.body->setLinearVelocity(btVector3(0.f, 0.f, 0.f));
+				body.body->setAngularVelocity(btVector3(0.f, 0.f, 0.f));
+			} else {
+				setSkipped(body, false);
+			}
+
+			body.tier = tier;
+		}
+		/**
+		 * @brief Disables or re-enables a body's simulation, sleeping bodies are left alone
+		*/
+		void setSkipped(Body& body, const bool skipped) {
+			if(skipped == body.skipped)
+				return;
+
+			if(skipped){
+				body.activationState = body.body->getActivationState();
+				if(body.activationState == ISLAND_SLEEPING)
+					return;	// Already costs nothing, and wakes up if hit
+
+				body.body->forceActivationState(DISABLE_SIMULATION);
+			} else {
+				body.body->forceActivationState(body.activationState);
+				if(body.activationState != ISLAND_SLEEPING)
+					body.body->setDeactivationTime(0.f);
+			}
+
+			body.skipped = skipped;
+		}
+		/**
+		 * @brief Ignores the body being swept, and anything its collision filter doesn't collide with
+		*/
+		struct SweepCallback : public btCollisionWorld::ClosestConvexResultCallback {
+			const btCollisionObject* self;
+
+			SweepCallback(const btCollisionObject* self, const btVector3& from, const btVector3& to) : ClosestConvexResultCallback(from, to), self(self) {
+				m_collisionFilterGroup = self->getBroadphaseHandle()->m_collisionFilterGroup;
+				m_collisionFilterMask = self->getBroadphaseHandle()->m_collisionFilterMask;
+			}
+			bool needsCollision(btBroadphaseProxy* proxy) const override {
+				return proxy->m_clientObject != self && ClosestConvexResultCallback::needsCollision(proxy);
+			}
+		};
+
+		/**
+		 * @brief Integrates a skipped body under gravity, if nothing is in the way
+		 * @details Bodies in contact are held still, without the solver they'd sink into what they touch. Free ones are
+		 * @details swept from their transform to the predicted one, concave and compound shapes by their bounding sphere
+		 * @return False if the sweep hit something, the body is left in place and should collide next step
+		*/
+		bool extrapolate(Body& body, btCollisionWorld* collisionWorld, const btScalar step) {
+			if(body.tier == PhysicsTier::FROZEN || body.activationState == ISLAND_SLEEPING || body.touching)
+				return true;
+
+			btRigidBody* rigidBody = body.body;
+			const btVector3 velocity = rigidBody->getLinearVelocity() + rigidBody->getGravity() * step;
+
+			btTransform predicted;
+			btTransformUtil::integrateTransform(rigidBody->getWorldTransform(), velocity, rigidBody->getAngularVelocity(), step, predicted);
+			if(sweepHits(rigidBody, collisionWorld, predicted))
+				return false;
+
+			// The world only synchronizes active bodies
+			rigidBody->setLinearVelocity(velocity);
+			rigidBody->setWorldTransform(predicted);
+			rigidBody->setInterpolationWorldTransform(predicted);
+			if(rigidBody->getMotionState())
+				rigidBody->getMotionState()->setWorldTransform(predicted);
+
+			return true;
+		}
+		/**
+		 * @brief Sweeps a body's shape from its transform to `to`
+		 * @return If it hits anything on the way
+		*/
+		bool sweepHits(btRigidBody* rigidBody, btCollisionWorld* collisionWorld, const btTransform& to) const {
+			const btTransform& from = rigidBody->getWorldTransform();
+			const btCollisionShape* shape = rigidBody->getCollisionShape();
+
+			if(shape->isConvex()){
+				SweepCallback callback(rigidBody, from.getOrigin(), to.getOrigin());
+				collisionWorld->convexSweepTest(static_cast<const btConvexShape*>(shape), from, to, callback);
+				return callback.hasHit();
+			}
+
+			btVector3 center;
+			btScalar radius;
+			shape->getBoundingSphere(center, radius);
+			const btSphereShape sphere(radius);
+			const btTransform sphereFrom(btQuaternion::getIdentity(), from * center);
+			const btTransform sphereTo(btQuaternion::getIdentity(), to * center);
+
+			SweepCallback callback(rigidBody, sphereFrom.getOrigin(), sphereTo.getOrigin());
+			collisionWorld->convexSweepTest(&sphere, sphereFrom, sphereTo, callback);
+			return callback.hasHit();
+		}
+		/**
+		 * @brief Promotes lower tier bodies in contact with a simulated dynamic body, so they react to being hit
+		 * @details Also marks every managed body with contact points as touching, skipped bodies keep their last contacts
+		*/
+		void promoteTouched(btDispatcher* dispatcher) {
+			for(int i = 0; i < dispatcher->getNumManifolds(); i++) {
+				const btPersistentManifold* manifold = dispatcher->getManifoldByIndexInternal(i);
+				if(manifold->getNumContacts() == 0)
+					continue;
+
+				markTouching(manifold->getBody0());
+				markTouching(manifold->getBody1());
+				promoteIfHit(manifold->getBody0(), manifold->getBody1());
+				promoteIfHit(manifold->getBody1(), manifold->getBody0());
+			}
+		}
+		void markTouching(const btCollisionObject* object) {
+			auto iter = indices.find(object);
+			if(iter != indices.end())
+				bodies[iter->second].touching = true;
+		}
+		/**
+		 * @brief Promotes `target` and holds it at FULL if it's in a lower tier and `other` is a simulated, awake body
+		 * @note Bodies already at FULL aren't held, or bodies resting on each other(eg. a stack) would hold each other forever
+		*/
+		void promoteIfHit(const btCollisionObject* target, const btCollisionObject* other) {
+			if(other->isStaticOrKinematicObject() || !other->isActive() || getTier(other) != PhysicsTier::FULL)
+				return;
+
+			auto iter = indices.find(target);
+			if(iter == indices.end())
+				return;
+
+			Body& body = bodies[iter->second];
+			if(body.tier == PhysicsTier::FULL)
+				return;
+
+			body.holdSteps = HIT_HOLD_STEPS;
+			tierCounts[(size_t)body.tier]--;
+			tierCounts[(size_t)PhysicsTier::FULL]++;
+			setTier(body, PhysicsTier::FULL);
+		}
+
+		static const uint16_t HIT_HOLD_STEPS = 60;	// Steps a hit body stays at FULL before being re-evaluated
+
+		std::vector<Body> bodies;
+		std::unordered_map<const btCollisionObject*, size_t> indices;	// Body to its index in `bodies`
+		std::array<size_t, 3> tierCounts = { 0, 0, 0 };
+
+		btVector3 viewer = btVector3(0.f, 0.f, 0.f);
+		bool useFrustum = false;
+		Frustum frustum;
+
+		float hysteresis;
+		float hiddenDistanceScale;
+
+		uint8_t nextPhase = 0;
+		uint32_t stepCount = 0;
+};
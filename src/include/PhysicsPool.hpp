@@ -0,0 +1,291 @@
+#pragma once
+
+#include <bullet/btBulletDynamicsCommon.h>
+#include <bullet/LinearMath/btAlignedAllocator.h>
+
+#include <algorithm>
+#include <functional>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Fixed-size slot allocator for one type, objects are constructed in place in chunks of slots
+ * @details Destroyed slots go on a free list and are reused in O(1), chunks are never freed until the pool is,
+ * @details so once warmed up creating and destroying objects doesn't touch the heap
+ * @details Each chunk is twice the size of the last, so there are O(log n) chunks. The chunk owning a pointer is
+ * @details binary searched from the chunks sorted by address, O(log log n)
+ * @note Slots are 16 byte aligned, the same as Bullet's own aligned allocator
+*/
+template<class T> class ObjectPool {
+	public:
+		ObjectPool(const uint32_t firstChunkSize = 64) : firstChunkSize(std::max<uint32_t>(firstChunkSize, 1)) {}
+		/**
+		 * @brief Destroys every live object and frees every chunk
+		*/
+		~ObjectPool() {
+			clear();
+			for(Chunk& chunk : chunks) {
+				btAlignedFree(chunk.memory);
+			}
+		}
+		ObjectPool(const ObjectPool&) = delete;
+		ObjectPool& operator=(const ObjectPool&) = delete;
+
+		/**
+		 * @brief Constructs an object in a free slot, allocating a new chunk if there are none
+		*/
+		template<class... Args> T* create(Args&&... args) {
+			if(freeSlots.empty())
+				grow();
+
+			const SlotRef ref = freeSlots.back();
+			freeSlots.pop_back();
+
+			Chunk& chunk = chunks[ref.chunk];
+			T* object = new(chunk.memory + (size_t)ref.slot * STRIDE) T(std::forward<Args>(args)...);
+			chunk.live[ref.slot] = 1;
+			liveCount++;
+
+			return object;
+		}
+		/**
+		 * @brief Destroys an object and recycles its slot
+		 * @return If the object was owned by the pool, objects that aren't are left alone
+		*/
+		bool destroy(T* object) {
+			SlotRef ref;
+			if(!find(object, ref) || !chunks[ref.chunk].live[ref.slot])
+				return false;
+
+			object->~T();
+			chunks[ref.chunk].live[ref.slot] = 0;
+			freeSlots.push_back(ref);
+			liveCount--;
+
+			return true;
+		}
+		/**
+		 * @brief Returns if the object lives in one of the pool's slots
+		*/
+		bool owns(const void* object) const {
+			SlotRef ref;
+			return find(object, ref) && chunks[ref.chunk].live[ref.slot];
+		}
+		/**
+		 * @brief Destroys every live object at once, keeping the chunks for reuse
+		*/
+		void clear() {
+			freeSlots.clear();
+			for(uint32_t c = chunks.size(); c-- > 0;) {
+				Chunk& chunk = chunks[c];
+				for(uint32_t slot = chunk.capacity; slot-- > 0;) {
+					if(chunk.live[slot]){
+						reinterpret_cast<T*>(chunk.memory + (size_t)slot * STRIDE)->~T();
+						chunk.live[slot] = 0;
+					}
+					freeSlots.push_back({ c, slot });
+				}
+			}
+
+			liveCount = 0;
+		}
+		/**
+		 * @brief Allocates chunks until there are at least `count` slots
+		*/
+		void reserve(const size_t count) {
+			while(capacity() < count) {
+				grow();
+			}
+		}
+		/**
+		 * @brief Returns the number of live objects
+		*/
+		size_t size() const {
+			return liveCount;
+		}
+		/**
+		 * @brief Returns the number of slots, live or free
+		*/
+		size_t capacity() const {
+			return liveCount + freeSlots.size();
+		}
+	private:
+		static const size_t ALIGNMENT = 16;
+		static const size_t STRIDE = (sizeof(T) + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+		static_assert(alignof(T) <= ALIGNMENT, "ObjectPool: type is over-aligned");
+
+		struct Chunk {
+			unsigned char* memory;
+			uint32_t capacity;
+			std::vector<uint8_t> live;	// If each slot holds an object
+		};
+		struct SlotRef {
+			uint32_t chunk;
+			uint32_t slot;
+		};
+
+		/**
+		 * @brief Adds a chunk twice the size of the last, its slots are handed out lowest address first
+		*/
+		void grow() {
+			const uint32_t capacity = chunks.empty() ? firstChunkSize : chunks.back().capacity * 2;
+
+			Chunk chunk;
+			chunk.memory = static_cast<unsigned char*>(btAlignedAlloc(capacity * STRIDE, ALIGNMENT));
+			chunk.capacity = capacity;
+			chunk.live.assign(capacity, 0);
+			chunks.push_back(std::move(chunk));
+
+			const uint32_t index = chunks.size() - 1;
+			const auto position = std::lower_bound(chunksByAddress.begin(), chunksByAddress.end(), chunks[index].memory, [this](const uint32_t c, const unsigned char* memory) {
+				return std::less<const unsigned char*>()(chunks[c].memory, memory);
+			});
+			chunksByAddress.insert(position, index);
+
+			for(uint32_t slot = capacity; slot-- > 0;) {
+				freeSlots.push_back({ index, slot });
+			}
+		}
+		/**
+		 * @brief Finds the slot `object` points to
+		 * @details The owner can only be the last chunk starting at or before `object`
+		*/
+		bool find(const void* object, SlotRef& ref) const {
+			const unsigned char* address = static_cast<const unsigned char*>(object);
+			const std::less<const unsigned char*> less;
+
+			auto iter = std::upper_bound(chunksByAddress.begin(), chunksByAddress.end(), address, [&](const unsigned char* address, const uint32_t c) {
+				return less(address, chunks[c].memory);
+			});
+			if(iter == chunksByAddress.begin())
+				return false;
+
+			const uint32_t c = *--iter;
+			const Chunk& chunk = chunks[c];
+			if(!less(address, chunk.memory + (size_t)chunk.capacity * STRIDE))
+				return false;
+
+			const size_t offset = address - chunk.memory;
+			if(offset % STRIDE != 0)
+				return false;
+
+			ref = { c, (uint32_t)(offset / STRIDE) };
+			return true;
+		}
+
+		uint32_t firstChunkSize;
+		std::vector<Chunk> chunks;
+		std::vector<uint32_t> chunksByAddress;	// Indices into `chunks`, sorted by their memory's address
+		std::vector<SlotRef> freeSlots;
+		size_t liveCount = 0;
+};
+
+/**
+ * @brief Pools for rigidbodies, their motion states and common primitive shapes
+ * @details Use in place of createRigidBody() and `new bt*Shape()` for bodies that are spawned and despawned often,
+ * @details eg. debris, so churn recycles slots instead of going through malloc/free
+ * @note Objects from the pool must be given back with the destroy*() functions or clear(), never deleted directly
+*/
+class BodyPool {
+	public:
+		BodyPool() = default;
+		BodyPool(const BodyPool&) = delete;
+		BodyPool& operator=(const BodyPool&) = delete;
+
+		/**
+		 * @brief Creates a pooled rigidbody with a pooled motion state, the same as createRigidBody()
+		 * @param shape The collision shape, pooled or not. It isn't owned by the body
+		 * @param transform The initial position and rotation of the rigidbody
+		 * @param mass The mass of the rigidbody
+		 * @param moveAxises A normalized vector determining how the rigidbody will move(ie. 0 disables)
+		*/
+		btRigidBody* createRigidBody(btCollisionShape* shape, const btTransform& transform, const btScalar mass, const btVector3& moveAxises = btVector3(btScalar(1.f), btScalar(1.f), btScalar(1.f))) {
+			btVector3 inertia = btVector3(0.f, 0.f, 0.f);
+			if(mass != 0.f)
+				shape->calculateLocalInertia(mass, inertia);
+
+			btDefaultMotionState* motionState = motionStates.create(transform);
+			btRigidBody::btRigidBodyConstructionInfo rbInfo(mass, motionState, shape, inertia);
+
+			btRigidBody* rigidBody = bodies.create(rbInfo);
+			if(mass != 0.f)
+				rigidBody->setLinearFactor(moveAxises);
+
+			return rigidBody;
+		}
+		/**
+		 * @brief Recycles a pooled rigidbody and its motion state, its shape is left alone
+		 * @note The body must already be removed from the world
+		 * @return If the body was pooled, bodies that aren't are left alone
+		*/
+		bool destroyRigidBody(btRigidBody* body) {
+			if(!bodies.owns(body))
+				return false;
+
+			btMotionState* motionState = body->getMotionState();
+			bodies.destroy(body);
+			if(motionState)
+				motionStates.destroy(static_cast<btDefaultMotionState*>(motionState));
+
+			return true;
+		}
+		btCollisionShape* createBox(const btVector3& halfExtents) {
+			return boxes.create(halfExtents);
+		}
+		btCollisionShape* createSphere(const btScalar radius) {
+			return spheres.create(radius);
+		}
+		/**
+		 * @brief Creates a pooled Y-axis capsule shape
+		*/
+		btCollisionShape* createCapsule(const btScalar radius, const btScalar height) {
+			return capsules.create(radius, height);
+		}
+		/**
+		 * @brief Recycles a pooled shape
+		 * @note No body may still be using it
+		 * @return If the shape was pooled, shapes that aren't are left alone
+		*/
+		bool destroyShape(btCollisionShape* shape) {
+			switch(shape->getShapeType()) {
+				case BOX_SHAPE_PROXYTYPE:
+					return boxes.destroy(static_cast<btBoxShape*>(shape));
+				case SPHERE_SHAPE_PROXYTYPE:
+					return spheres.destroy(static_cast<btSphereShape*>(shape));
+				case CAPSULE_SHAPE_PROXYTYPE:
+					return capsules.destroy(static_cast<btCapsuleShape*>(shape));
+				default:
+					return false;
+			}
+		}
+		bool owns(const btCollisionObject* obj) const {
+			return bodies.owns(obj);
+		}
+		bool owns(const btCollisionShape* shape) const {
+			return boxes.owns(shape) || spheres.owns(shape) || capsules.owns(shape);
+		}
+		/**
+		 * @brief Destroys every pooled object at once, keeping the memory for reuse
+		 * @note Every pooled body must already be removed from the world
+		*/
+		void clear() {
+			bodies.clear();
+			motionStates.clear();
+			boxes.clear();
+			spheres.clear();
+			capsules.clear();
+		}
+		/**
+		 * @brief Returns the number of live pooled rigidbodies
+		*/
+		size_t size() const {
+			return bodies.size();
+		}
+	private:
+		ObjectPool<btRigidBody> bodies;
+		ObjectPool<btDefaultMotionState> motionStates;
+		ObjectPool<btBoxShape> boxes;
+		ObjectPool<btSphereShape> spheres;
+		ObjectPool<btCapsuleShape> capsules;
+};
@@ -0,0 +1,349 @@
+#pragma once
+
+#include <bullet/btBulletDynamicsCommon.h>
+#include <bullet/LinearMath/btQuickprof.h>
+#include <glm/vec2.hpp>
+
+#include <unordered_map>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <array>
+#include <set>
+
+class UI;
+
+/**
+ * @brief Phases of a physics step, Bullet's profile zones are summed into these
+*/
+enum class PhysicsPhase : uint8_t {
+	BROADPHASE,		// AABB updates and pair finding
+	NARROWPHASE,	// Contact generation for each pair
+	SOLVER,			// Island building and constraint solving
+	INTEGRATION,	// Gravity, motion prediction, integration and activation
+	SYNC,			// Motion states and ECS transforms
+	ACTIONS,		// Vehicles, LOD and other actions
+	COUNT
+};
+
+/**
+ * @brief Timings(in milliseconds) and counts of one physics tick
+*/
+struct PhysicsProfileSample {
+	uint64_t tick = 0;
+	int substeps = 0;
+	float total = 0.f;
+	std::array<float, (size_t)PhysicsPhase::COUNT> phases = {};
+
+	int bodies = 0;
+	int activeBodies = 0;
+	int pairs = 0;		// Broadphase overlapping pairs
+	int manifolds = 0;
+	int contacts = 0;
+	int islands = 0;
+};
+
+/**
+ * @brief Collects per phase timings, pair counts and island counts of each physics tick
+ * @details Phase timings come from Bullet's CProfileManager zones(BT_PROFILE), including any of our own zones
+ * @details mapped with addZone(). They read 0 if Bullet was built with BT_NO_PROFILE, the total is always measured
+ * @details Samples can be logged to a CSV or JSON file and summarized on a UI overlay
+ * @note CProfileManager is global, only one enabled profiler should be stepping at a time
+*/
+class PhysicsProfiler {
+	public:
+		PhysicsProfiler() {
+			// Bullet's own zones
+			addZone("updateAabbs", PhysicsPhase::BROADPHASE);
+			addZone("calculateOverlappingPairs", PhysicsPhase::BROADPHASE);
+			addZone("dispatchAllCollisionPairs", PhysicsPhase::NARROWPHASE);
+			addZone("createPredictiveContacts", PhysicsPhase::NARROWPHASE);
+			addZone("calculateSimulationIslands", PhysicsPhase::SOLVER);
+			addZone("solveConstraints", PhysicsPhase::SOLVER);
+			addZone("saveKinematicState", PhysicsPhase::INTEGRATION);
+			addZone("applyGravity", PhysicsPhase::INTEGRATION);
+			addZone("predictUnconstraintMotion", PhysicsPhase::INTEGRATION);
+			addZone("integrateTransforms", PhysicsPhase::INTEGRATION);
+			addZone("updateActivationState", PhysicsPhase::INTEGRATION);
+			addZone("synchronizeMotionStates", PhysicsPhase::SYNC);
+			addZone("updateActions", PhysicsPhase::ACTIONS);
+		}
+		~PhysicsProfiler() {
+			closeLog();
+		}
+		PhysicsProfiler(const PhysicsProfiler&) = delete;
+		PhysicsProfiler& operator=(const PhysicsProfiler&) = delete;
+
+		void setEnabled(const bool enabled) {
+			this->enabled = enabled;
+			if(enabled)
+				CProfileManager::Reset();
+		}
+		bool isEnabled() const {
+			return enabled;
+		}
+		/**
+		 * @brief Counts a profile zone(eg. one of our own BT_PROFILE("name") zones) towards a phase
+		 * @note Zones are matched by name, nested zones of a counted zone aren't counted again
+		*/
+		void addZone(const std::string& name, const PhysicsPhase phase) {
+			zones[name] = phase;
+		}
+		/**
+		 * @brief Call right before stepping the world
+		*/
+		void beginTick() {
+			if(!enabled)
+				return;
+
+			tickStart = std::chrono::steady_clock::now();
+		}
+		/**
+		 * @brief Call once the step, and anything profiled after it(eg. syncing transforms), is done
+		 * @param substeps The number of internal steps taken, as returned by stepSimulation()
+		*/
+		void endTick(btDynamicsWorld* world, const int substeps) {
+			if(!enabled)
+				return;
+
+			PhysicsProfileSample sample;
+			sample.tick = tickCount++;
+			sample.substeps = substeps;
+			sample.total = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - tickStart).count();
+
+			CProfileIterator* iter = CProfileManager::Get_Iterator();
+			if(iter){
+				collectZones(iter, sample);
+				CProfileManager::Release_Iterator(iter);
+			}
+			CProfileManager::Reset();
+
+			countWorld(world, sample);
+
+			last = sample;
+			accumulate(sample);
+			if(log.is_open())
+				writeSample(sample);
+		}
+		/**
+		 * @brief Returns the last tick's sample
+		*/
+		const PhysicsProfileSample& getLast() const {
+			return last;
+		}
+		/**
+		 * @brief Returns the mean of the last full window of ticks
+		*/
+		const PhysicsProfileSample& getAverage() const {
+			return average;
+		}
+		/**
+		 * @brief Returns a one line summary of the average sample
+		*/
+		std::string getSummary() const {
+			std::ostringstream oss;
+			oss << std::fixed << std::setprecision(2)
+				<< "physics " << average.total << "ms"
+				<< " bp " << average.phases[(size_t)PhysicsPhase::BROADPHASE]
+				<< " np " << average.phases[(size_t)PhysicsPhase::NARROWPHASE]
+				<< " solve " << average.phases[(size_t)PhysicsPhase::SOLVER]
+				<< " integ " << average.phases[(size_t)PhysicsPhase::INTEGRATION]
+				<< " sync " << average.phases[(size_t)PhysicsPhase::SYNC]
+				<< " act " << average.phases[(size_t)PhysicsPhase::ACTIONS]
+				<< " | bodies " << average.bodies << "(" << average.activeBodies << " active)"
+				<< " pairs " << average.pairs
+				<< " islands " << average.islands;
+
+			return oss.str();
+		}
+		/**
+		 * @brief Adds a text element to `ui` showing the summary, refreshed every window
+		 * @note `ui` must outlive the profiler
+		 * @note Defined in PhysicsRender.cpp, so the profiler doesn't pull in the UI
+		*/
+		void attachOverlay(UI& ui, const glm::vec2& pos = glm::vec2(10.f, 10.f), const float scale = 0.4f);
+		/**
+		 * @brief Starts logging every sample, as JSON if `path` ends in ".json" and CSV otherwise
+		 * @return If the file could be opened
+		*/
+		bool openLog(const std::string& path) {
+			closeLog();
+
+			log.open(path, std::ios::trunc);
+			if(!log.is_open()){
+				std::cerr << "PhysicsProfiler::openLog(): Unable to open \"" << path << "\"\n";
+				return false;
+			}
+
+			json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+			firstSample = true;
+			if(json)
+				log << "[\n";
+			else
+				log << "tick,substeps,total_ms,broadphase_ms,narrowphase_ms,solver_ms,integration_ms,sync_ms,actions_ms,bodies,active_bodies,pairs,manifolds,contacts,islands\n";
+
+			return true;
+		}
+		void closeLog() {
+			if(!log.is_open())
+				return;
+
+			if(json)
+				log << "\n]\n";
+			log.close();
+		}
+		/**
+		 * @brief Counts the simulation islands of the last step
+		*/
+		static int countIslands(const btCollisionWorld* world) {
+			std::set<int> islands;
+			for(int i = 0; i < world->getNumCollisionObjects(); i++) {
+				const int tag = world->getCollisionObjectArray()[i]->getIslandTag();
+				if(tag >= 0)
+					islands.insert(tag);
+			}
+
+			return islands.size();
+		}
+
+		static const int WINDOW = 60;	// Ticks averaged for getAverage() and the overlay
+	private:
+		/**
+		 * @brief Sums the time of every mapped zone under the iterator's current node
+		*/
+		void collectZones(CProfileIterator* iter, PhysicsProfileSample& sample) {
+			std::vector<int> unmapped;	// Children to search for mapped zones
+
+			int index = 0;
+			for(iter->First(); !iter->Is_Done(); iter->Next(), index++) {
+				auto zone = zones.find(iter->Get_Current_Name());
+				if(zone != zones.end())
+					sample.phases[(size_t)zone->second] += iter->Get_Current_Total_Time();
+				else
+					unmapped.push_back(index);
+			}
+
+			for(const int child : unmapped) {
+				iter->Enter_Child(child);
+				collectZones(iter, sample);
+				iter->Enter_Parent();
+			}
+		}
+		void countWorld(btDynamicsWorld* world, PhysicsProfileSample& sample) {
+			sample.bodies = world->getNumCollisionObjects();
+			for(int i = 0; i < world->getNumCollisionObjects(); i++) {
+				const btCollisionObject* obj = world->getCollisionObjectArray()[i];
+				if(!obj->isStaticObject() && obj->isActive())
+					sample.activeBodies++;
+			}
+
+			sample.pairs = world->getBroadphase()->getOverlappingPairCache()->getNumOverlappingPairs();
+
+			const btDispatcher* dispatcher = world->getDispatcher();
+			sample.manifolds = dispatcher->getNumManifolds();
+			for(int i = 0; i < sample.manifolds; i++) {
+				sample.contacts += dispatcher->getManifoldByIndexInternal(i)->getNumContacts();
+			}
+
+			sample.islands = countIslands(world);
+		}
+		/**
+		 * @brief Adds a sample to the window, updating the average and overlay once it's full
+		*/
+		void accumulate(const PhysicsProfileSample& sample) {
+			sum.total += sample.total;
+			for(size_t i = 0; i < sample.phases.size(); i++) {
+				sum.phases[i] += sample.phases[i];
+			}
+			sum.substeps += sample.substeps;
+			sum.bodies += sample.bodies;
+			sum.activeBodies += sample.activeBodies;
+			sum.pairs += sample.pairs;
+			sum.manifolds += sample.manifolds;
+			sum.contacts += sample.contacts;
+			sum.islands += sample.islands;
+
+			if(++windowCount < WINDOW)
+				return;
+
+			average = sum;
+			average.tick = sample.tick;
+			average.total /= WINDOW;
+			for(float& phase : average.phases) {
+				phase /= WINDOW;
+			}
+			average.substeps /= WINDOW;
+			average.bodies /= WINDOW;
+			average.activeBodies /= WINDOW;
+			average.pairs /= WINDOW;
+			average.manifolds /= WINDOW;
+			average.contacts /= WINDOW;
+			average.islands /= WINDOW;
+
+			sum = PhysicsProfileSample();
+			windowCount = 0;
+
+			if(overlayText)
+				*overlayText = getSummary();
+		}
+		void writeSample(const PhysicsProfileSample& sample) {
+			const auto& phases = sample.phases;
+			if(json){
+				if(!firstSample)
+					log << ",\n";
+				log << "{\"tick\":" << sample.tick
+					<< ",\"substeps\":" << sample.substeps
+					<< ",\"total\":" << sample.total
+					<< ",\"broadphase\":" << phases[(size_t)PhysicsPhase::BROADPHASE]
+					<< ",\"narrowphase\":" << phases[(size_t)PhysicsPhase::NARROWPHASE]
+					<< ",\"solver\":" << phases[(size_t)PhysicsPhase::SOLVER]
+					<< ",\"integration\":" << phases[(size_t)PhysicsPhase::INTEGRATION]
+					<< ",\"sync\":" << phases[(size_t)PhysicsPhase::SYNC]
+					<< ",\"actions\":" << phases[(size_t)PhysicsPhase::ACTIONS]
+					<< ",\"bodies\":" << sample.bodies
+					<< ",\"activeBodies\":" << sample.activeBodies
+					<< ",\"pairs\":" << sample.pairs
+					<< ",\"manifolds\":" << sample.manifolds
+					<< ",\"contacts\":" << sample.contacts
+					<< ",\"islands\":" << sample.islands
+					<< '}';
+			} else {
+				log << sample.tick << ',' << sample.substeps << ',' << sample.total;
+				for(const float phase : phases) {
+					log << ',' << phase;
+				}
+				log << ',' << sample.bodies
+					<< ',' << sample.activeBodies
+					<< ',' << sample.pairs
+					<< ',' << sample.manifolds
+					<< ',' << sample.contacts
+					<< ',' << sample.islands
+					<< '\n';
+			}
+
+			firstSample = false;
+		}
+
+		bool enabled = false;
+		std::unordered_map<std::string, PhysicsPhase> zones;	// Profile zone name to the phase it counts towards
+
+		std::chrono::steady_clock::time_point tickStart;
+		uint64_t tickCount = 0;
+
+		PhysicsProfileSample last;
+		PhysicsProfileSample average;
+		PhysicsProfileSample sum;	// Running sum of the current window
+		int windowCount = 0;
+
+		std::string* overlayText = nullptr;	// The overlay's text, owned by the UI
+
+		std::ofstream log;
+		bool json = false;
+		bool firstSample = true;
+};
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <bullet/btBulletDynamicsCommon.h>
+
+struct CameraData;
+
+/**
+ * @brief The render side of the physics classes, defined in PhysicsRender.cpp
+ * @details Keeps PhysicsDrawer, GL and the UI out of the physics headers, so a headless target(eg. physics_bench)
+ * @details only links Bullet as long as it never draws
+*/
+
+/**
+ * @brief Creates the physics debug drawer
+ * @note Needs a GL context
+*/
+btIDebugDraw* createPhysicsDrawer();
+
+/**
+ * @brief Draws the world with a drawer from createPhysicsDrawer(), culled to the camera
+*/
+void drawPhysicsWorld(btIDebugDraw* drawer, btDiscreteDynamicsWorld* world, const CameraData& camera);
@@ -0,0 +1,462 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "shader/BaseShader.hpp"
+#include "Material.hpp"
+#include "Frustum.hpp"
+#include "Mesh.hpp"
+
+/**
+ * @brief Coarse draw order, lower layers are drawn first regardless of their state
+*/
+enum class RenderLayer : uint8_t {
+	BACKGROUND,	// eg. terrain
+	GEOMETRY,
+	OVERLAY
+};
+
+/**
+ * @brief State changes and draws of one flush
+ * @details The `unsorted` counts are the changes submission order would have needed, for comparison
+*/
+struct RenderStats {
+	uint32_t items = 0;		// Drawn, after culling
+	uint32_t culled = 0;	// Outside the frustum
+	uint32_t drawCalls = 0;
+	uint32_t instancedDraws = 0;	// Draws covering more than one item
+	uint32_t instances = 0;			// Items drawn by instanced draws
+	uint32_t pooledBatches = 0;		// Batches of pooled meshes, one multi-draw each when supported
+	uint32_t pooledCommands = 0;	// Meshes drawn in those batches
+
+	uint32_t shaderChanges = 0;
+	uint32_t materialChanges = 0;
+	uint32_t vaoChanges = 0;
+
+	uint32_t unsortedShaderChanges = 0;
+	uint32_t unsortedMaterialChanges = 0;
+	uint32_t unsortedVaoChanges = 0;
+};
+
+/**
+ * @brief Collects draws from every renderer for a frame, sorts them to minimize state changes and submits them
+ * @details Each item is encoded into a 64 bit key, from most to least significant:
+ * @details layer(2) | shader(12) | material(16) | geometry(16) | depth(18)
+ * @details so items are grouped by shader, then material, then vertex array, and drawn front to back within a group
+ * @details Geometry is the VAO, or for meshes in a GeometryPool the mesh with the top bit set, so pooled meshes sort
+ * @details after the rest of their material and next to each other
+ * @details Keys are sorted with an 8 bit LSD radix sort, skipping passes where every key has the same digit
+ * @details Meshes are frustum culled by their world space bounds before sorting, see FrustumCuller
+ * @details After sorting, runs of the same mesh and shader are drawn as one instanced draw if the shader supports it
+ * @details and every pooled mesh sharing a material is drawn in one batch, see GeometryPool::drawIndirect()
+ * @note Shaders, materials and meshes must outlive the flush
+*/
+class RenderQueue {
+	public:
+		/**
+		 * @brief Draws an item with custom state, eg. the heightmap's patches
+		 * @note The item's shader is bound with the camera and model set, the callback binds the rest
+		*/
+		using DrawCallback = void(*)(void* object, BaseShader& shader);
+
+		/**
+		 * @brief Starts a frame, clearing the last frame's items
+		 * @param view The camera's view matrix
+		 * @param projection The camera's projection matrix
+		 * @param farPlane Distance depth is quantized over, items further away share the last depth
+		*/
+		void begin(const glm::mat4& view, const glm::mat4& projection, const float farPlane = 1000.f) {
+			this->view = view;
+			this->projection = projection;
+			this->farPlane = farPlane;
+			cameraPos = glm::vec3(glm::inverse(view)[3]);
+			frustum = Frustum(projection * view);
+
+			items.clear();
+			culler.clear();
+			shaderIDs.clear();
+			materialIDs.clear();
+			meshIDs.clear();
+		}
+		/**
+		 * @brief Queues a mesh
+		 * @param transform The mesh's model matrix
+		*/
+		void add(BaseShader& shader, Mesh& mesh, const glm::mat4& transform, const RenderLayer layer = RenderLayer::GEOMETRY) {
+			Item item;
+			item.shader = &shader;
+			item.mesh = &mesh;
+			item.material = &mesh.getMaterial();
+			item.vao = mesh.getVAO();
+			item.transform = transform;
+			item.key = encode(item, layer);
+
+			// The bounding sphere settles most meshes, only those it finds straddling a plane pay for transforming their box
+			const BoundingSphere& sphere = mesh.getBoundingSphere();
+			const float scale = std::sqrt(std::max({ glm::dot(transform[0], transform[0]), glm::dot(transform[1], transform[1]), glm::dot(transform[2], transform[2]) }));
+			switch(frustum.classifySphere(glm::vec3(transform * glm::vec4(sphere.center, 1.f)), sphere.radius * scale)) {
+				case -1:
+					item.cullIndex = OUTSIDE;
+					break;
+				case 1:
+					item.cullIndex = NOT_CULLED;
+					break;
+				default:
+					item.cullIndex = culler.add(mesh.getBounds().transformed(transform));
+			}
+
+			items.push_back(item);
+		}
+		/**
+		 * @brief Queues a custom draw, custom draws are never culled
+		 * @param vao The vertex array the callback binds, to group it with other users
+		*/
+		void addCustom(BaseShader& shader, void* object, DrawCallback draw, const GLuint vao, const glm::mat4& transform, const RenderLayer layer = RenderLayer::GEOMETRY) {
+			Item item;
+			item.shader = &shader;
+			item.object = object;
+			item.draw = draw;
+			item.vao = vao;
+			item.transform = transform;
+			item.key = encode(item, layer);
+
+			items.push_back(item);
+		}
+		/**
+		 * @brief Sorts and draws every queued item
+		*/
+		void flush() {
+			stats = RenderStats();
+			if(culling)
+				cull();
+			stats.items = items.size();
+			countUnsorted();
+
+			sortKeys();
+
+			BaseShader* currentShader = nullptr;
+			Material* currentMaterial = nullptr;
+			GLuint currentVao = 0;
+			for(size_t i = 0; i < entries.size(); i++) {
+				const Item& item = items[entries[i].index];
+
+				if(item.shader != currentShader){
+					currentShader = item.shader;
+					currentShader->bind();
+					currentShader->setCamera(view, projection);
+					currentMaterial = nullptr;	// Sampler handles are per program
+					stats.shaderChanges++;
+				}
+
+				if(item.draw){
+					currentShader->setModel(item.transform);
+					item.draw(item.object, *currentShader);
+					currentMaterial = nullptr;	// Unknown state after a custom draw
+					currentVao = 0;
+					stats.drawCalls++;
+					continue;
+				}
+
+				// Whatever a custom draw changed
+				GLState::setBlend(true);
+				GLState::setPolygonMode(GL_FILL);
+
+				if(item.material != currentMaterial){
+					currentMaterial = item.material;
+					currentMaterial->bind(*currentShader);
+					stats.materialChanges++;
+				}
+				if(item.vao != currentVao){
+					currentVao = item.vao;
+					GLState::bindVertexArray(currentVao);
+					stats.vaoChanges++;
+				}
+
+				if(item.mesh->getPool() && instancing && currentShader->supportsInstancing()){
+					i = drawPooledBatch(i) - 1;
+					continue;
+				}
+
+				const size_t runEnd = findRun(i);
+				if(runEnd - i > 1){
+					instanceTransforms.clear();
+					for(size_t j = i; j < runEnd; j++) {
+						instanceTransforms.push_back(InstanceTransform(items[entries[j].index].transform));
+					}
+
+					const GLsizei count = instanceTransforms.size();
+					item.mesh->uploadInstances(instanceTransforms.data(), count);
+					currentShader->setInstanced(true);
+					item.mesh->drawElementsInstanced(count);
+
+					stats.instancedDraws++;
+					stats.instances += count;
+					i = runEnd - 1;
+				} else {
+					currentShader->setModel(item.transform);
+					item.mesh->drawElements();
+				}
+				stats.drawCalls++;
+			}
+		}
+		/**
+		 * @brief Enables or disables instancing, eg. to compare draw counts
+		*/
+		void setInstancing(const bool instancing) {
+			this->instancing = instancing;
+		}
+		/**
+		 * @brief Enables or disables frustum culling
+		*/
+		void setCulling(const bool culling) {
+			this->culling = culling;
+		}
+		/**
+		 * @brief Returns the stats of the last flush
+		*/
+		const RenderStats& getStats() const {
+			return stats;
+		}
+		size_t size() const {
+			return items.size();
+		}
+		/**
+		 * @brief Returns the frustum of the camera given to begin()
+		*/
+		const Frustum& getFrustum() const {
+			return frustum;
+		}
+	private:
+		static const uint32_t NOT_CULLED = UINT32_MAX;
+		static const uint32_t OUTSIDE = UINT32_MAX - 1;	// Culled by its bounding sphere in add()
+
+		struct Item {
+			uint64_t key;
+
+			BaseShader* shader = nullptr;
+			Material* material = nullptr;
+			Mesh* mesh = nullptr;
+			GLuint vao = 0;
+			glm::mat4 transform;
+
+			void* object = nullptr;
+			DrawCallback draw = nullptr;
+
+			uint32_t cullIndex = NOT_CULLED;	// Box in `culler`, or OUTSIDE/NOT_CULLED when its sphere settled it
+		};
+		struct SortEntry {
+			uint64_t key;
+			uint32_t index;	// Into `items`
+		};
+
+		static const int SHADER_BITS = 12;
+		static const int MATERIAL_BITS = 16;
+		static const int GEOMETRY_BITS = 16;
+		static const int DEPTH_BITS = 18;
+		static const uint32_t POOLED_GEOMETRY = 1u << (GEOMETRY_BITS - 1);
+
+		uint64_t encode(const Item& item, const RenderLayer layer) {
+			const uint64_t shaderID = idOf(shaderIDs, item.shader) & ((1u << SHADER_BITS) - 1);
+			const uint64_t materialID = idOf(materialIDs, item.material) & ((1u << MATERIAL_BITS) - 1);
+			uint64_t geometryID;
+			if(item.mesh && item.mesh->getPool())
+				geometryID = POOLED_GEOMETRY | (idOf(meshIDs, item.mesh) & (POOLED_GEOMETRY - 1));
+			else
+				geometryID = item.vao & (POOLED_GEOMETRY - 1);
+
+			const float distance = glm::length(glm::vec3(item.transform[3]) - cameraPos);
+			const uint64_t depth = (uint64_t)(std::clamp(distance / farPlane, 0.f, 1.f) * ((1u << DEPTH_BITS) - 1));
+
+			uint64_t key = (uint64_t)layer;
+			key = (key << SHADER_BITS) | shaderID;
+			key = (key << MATERIAL_BITS) | materialID;
+			key = (key << GEOMETRY_BITS) | geometryID;
+			key = (key << DEPTH_BITS) | depth;
+
+			return key;
+		}
+		/**
+		 * @brief Gets a small id for a pointer, in order of first use this frame
+		*/
+		static uint32_t idOf(std::unordered_map<const void*, uint32_t>& ids, const void* ptr) {
+			if(ptr == nullptr)
+				return 0;
+
+			auto iter = ids.find(ptr);
+			if(iter != ids.end())
+				return iter->second;
+
+			const uint32_t id = ids.size() + 1;
+			ids.emplace(ptr, id);
+			return id;
+		}
+		/**
+		 * @brief Sorts `entries` by key, one histogram pass then up to 8 scatter passes
+		*/
+		void sortKeys() {
+			const size_t count = items.size();
+			entries.resize(count);
+			scratch.resize(count);
+			for(size_t i = 0; i < count; i++) {
+				entries[i] = { items[i].key, (uint32_t)i };
+			}
+
+			uint32_t histograms[8][256] = {};
+			for(const SortEntry& entry : entries) {
+				for(int pass = 0; pass < 8; pass++) {
+					histograms[pass][(entry.key >> (pass * 8)) & 0xFF]++;
+				}
+			}
+
+			for(int pass = 0; pass < 8; pass++) {
+				uint32_t* histogram = histograms[pass];
+				if(count == 0 || histogram[(entries[0].key >> (pass * 8)) & 0xFF] == count)
+					continue;	// Every key has the same digit
+
+				uint32_t offset = 0;
+				for(int digit = 0; digit < 256; digit++) {
+					const uint32_t digitCount = histogram[digit];
+					histogram[digit] = offset;
+					offset += digitCount;
+				}
+
+				for(const SortEntry& entry : entries) {
+					scratch[histogram[(entry.key >> (pass * 8)) & 0xFF]++] = entry;
+				}
+				entries.swap(scratch);
+			}
+		}
+		/**
+		 * @brief Tests every mesh's bounds against the frustum and drops the ones outside
+		*/
+		void cull() {
+			if(culler.size() != 0)
+				culler.cull(frustum);
+
+			const size_t count = items.size();
+			items.erase(std::remove_if(items.begin(), items.end(), [this](const Item& item) {
+				if(item.cullIndex == NOT_CULLED)
+					return false;
+				return item.cullIndex == OUTSIDE || !culler.isVisible(item.cullIndex);
+			}), items.end());
+
+			stats.culled = count - items.size();
+		}
+		/**
+		 * @brief Draws the pooled meshes from the sorted item `start` on sharing its shader, material and pool
+		 * @details Each run of the same mesh is one instanced command, every command is drawn at once
+		 * @return One past the batch's last entry
+		*/
+		size_t drawPooledBatch(const size_t start) {
+			const Item& first = items[entries[start].index];
+			GeometryPool* pool = first.mesh->getPool();
+
+			commands.clear();
+			instanceTransforms.clear();
+			size_t end = start;
+			while(end < entries.size()) {
+				const Item& item = items[entries[end].index];
+				if(item.draw || item.shader != first.shader || item.material != first.material || item.mesh->getPool() != pool)
+					break;
+
+				const size_t runEnd = findRun(end);
+				const GeometryRange& range = item.mesh->getRange();
+
+				DrawElementsIndirectCommand command;
+				command.count = range.indexCount;
+				command.instanceCount = runEnd - end;
+				command.firstIndex = range.firstIndex;
+				command.baseVertex = range.baseVertex;
+				command.baseInstance = instanceTransforms.size();
+				commands.push_back(command);
+
+				for(size_t j = end; j < runEnd; j++) {
+					instanceTransforms.push_back(InstanceTransform(items[entries[j].index].transform));
+				}
+				end = runEnd;
+			}
+
+			pool->uploadInstances(instanceTransforms.data(), instanceTransforms.size());
+			first.shader->setInstanced(true);
+			stats.drawCalls += pool->drawIndirect(commands);
+
+			stats.pooledBatches++;
+			stats.pooledCommands += commands.size();
+			stats.instances += instanceTransforms.size();
+
+			return end;
+		}
+		/**
+		 * @brief Finds the end of the run of items sharing the mesh and shader of the sorted item `start`
+		 * @return One past the run's last entry, `start + 1` if it can't be instanced
+		*/
+		size_t findRun(const size_t start) const {
+			const Item& first = items[entries[start].index];
+			if(!instancing || !first.shader->supportsInstancing())
+				return start + 1;
+
+			size_t end = start + 1;
+			while(end < entries.size()) {
+				const Item& item = items[entries[end].index];
+				if(item.mesh != first.mesh || item.shader != first.shader)
+					break;
+				end++;
+			}
+
+			return end;
+		}
+		/**
+		 * @brief Counts the state changes drawing in submission order would need
+		*/
+		void countUnsorted() {
+			const BaseShader* shader = nullptr;
+			const Material* material = nullptr;
+			GLuint vao = 0;
+			for(const Item& item : items) {
+				if(item.shader != shader){
+					shader = item.shader;
+					material = nullptr;
+					stats.unsortedShaderChanges++;
+				}
+				if(item.draw){
+					material = nullptr;
+					vao = 0;
+					continue;
+				}
+				if(item.material != material){
+					material = item.material;
+					stats.unsortedMaterialChanges++;
+				}
+				if(item.vao != vao){
+					vao = item.vao;
+					stats.unsortedVaoChanges++;
+				}
+			}
+		}
+
+		glm::mat4 view = glm::mat4(1.f);
+		glm::mat4 projection = glm::mat4(1.f);
+		glm::vec3 cameraPos = glm::vec3(0.f);
+		float farPlane = 1000.f;
+		Frustum frustum;
+		FrustumCuller culler;
+
+		std::vector<Item> items;
+		std::vector<SortEntry> entries;	// Sorted keys
+		std::vector<SortEntry> scratch;	// Radix sort ping-pong buffer
+		std::vector<InstanceTransform> instanceTransforms;	// Reused each instanced draw, normal matrices computed as they're added
+		std::vector<DrawElementsIndirectCommand> commands;	// Reused each pooled batch
+		bool instancing = true;
+		bool culling = true;
+		std::unordered_map<const void*, uint32_t> shaderIDs;
+		std::unordered_map<const void*, uint32_t> materialIDs;
+		std::unordered_map<const void*, uint32_t> meshIDs;	// Pooled meshes only
+
+		RenderStats stats;
+};
@@ -0,0 +1,461 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "Bounds.hpp"
+#include "Frustum.hpp"
+
+/**
+ * @brief Dynamic bounding volume hierarchy over world space boxes, eg. renderable entities
+ * @details Leaves store their box enlarged by `margin`, and stretched along their last movement so steadily moving
+ * @details boxes stay inside it for a few frames. Moving a box within its enlarged box is free, otherwise the leaf is
+ * @details removed and reinserted where it adds the least surface area. Each reinsert scales the enlargement by a
+ * @details pseudo-random factor in [1, 2), so boxes moving alike don't all leave their boxes on the same frame and
+ * @details reinsert in waves. Ancestors are refit and rebalanced
+ * @details with tree rotations on the way up, so the tree stays O(log n) deep however boxes move
+ * @details Frustum culling skips whole subtrees outside a plane, and stops testing planes a subtree is fully inside
+*/
+class SceneBVH {
+	public:
+		static const int32_t NULL_NODE = -1;
+
+		/**
+		 * @param margin Distance leaves' boxes are enlarged by, larger means fewer reinserts but looser culling
+		*/
+		SceneBVH(const float margin = 0.5f) : margin(margin) {}
+
+		/**
+		 * @brief Adds a box
+		 * @param userData Returned by queries, eg. the entity
+		 * @return The proxy, for move() and remove()
+		*/
+		int32_t insert(const BoundingBox& box, const uint32_t userData) {
+			const int32_t leaf = allocateNode();
+			Node& node = nodes[leaf];
+			node.box = fatten(box, glm::vec3(0.f), spread(leaf));
+			node.tight = box;
+			node.userData = userData;
+			node.height = 0;
+
+			insertLeaf(leaf);
+			leafCount++;
+
+			return leaf;
+		}
+		void remove(const int32_t proxy) {
+			removeLeaf(proxy);
+			freeNode(proxy);
+			leafCount--;
+		}
+		/**
+		 * @brief Updates a proxy's box
+		 * @return If the proxy left its enlarged box and was reinserted
+		*/
+		bool move(const int32_t proxy, const BoundingBox& box) {
+			Node& node = nodes[proxy];
+			const glm::vec3 displacement = box.center() - node.tight.center();
+			node.tight = box;
+			if(contains(node.box, box))
+				return false;
+
+			removeLeaf(proxy);
+			nodes[proxy].box = fatten(box, displacement, spread(proxy));
+			insertLeaf(proxy);
+
+			return true;
+		}
+		/**
+		 * @brief Calls `visit(userData)` for every proxy whose box intersects the frustum
+		 * @note Conservative, the same as Frustum::intersectsAabb()
+		*/
+		template<class F> void cull(const Frustum& frustum, F&& visit) {
+			if(root == NULL_NODE)
+				return;
+
+			stack.clear();
+			stack.push_back({ root, ALL_PLANES });
+			while(!stack.empty()) {
+				const StackEntry entry = stack.back();
+				stack.pop_back();
+
+				const Node& node = nodes[entry.node];
+				uint8_t planeMask = entry.planeMask;
+
+				// Test only the planes the parent straddles
+				const glm::vec3 center = node.box.center();
+				const glm::vec3 extents = node.box.extents();
+				bool outside = false;
+				for(int i = 0; i < 6; i++) {
+					if(!(planeMask & (1 << i)))
+						continue;
+
+					const glm::vec4& plane = frustum.planes[i];
+					const float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+					const float radius = glm::dot(glm::abs(glm::vec3(plane)), extents);
+					if(distance + radius < 0.f){
+						outside = true;
+						break;
+					}
+					if(distance - radius >= 0.f)
+						planeMask &= ~(1 << i);	// Fully inside, so are the children
+				}
+				if(outside)
+					continue;
+
+				if(node.isLeaf()){
+					visit(node.userData);
+				} else if(planeMask == 0){
+					visitSubtree(entry.node, visit);
+				} else {
+					stack.push_back({ node.left, planeMask });
+					stack.push_back({ node.right, planeMask });
+				}
+			}
+		}
+		/**
+		 * @brief Finds the closest proxy the ray hits
+		 * @param direction Normalized
+		 * @param userData Set to the hit proxy's
+		 * @param distance Set to the distance to the hit
+		 * @param test Called as `test(userData, distance)` for proxies whose box the ray enters closer than the closest
+		 * hit so far, `distance` being where it enters the box. Returns false if the proxy isn't hit, otherwise may set
+		 * `distance` to the exact hit, eg. against the proxy's triangles
+		 * @return If anything was hit within `maxDistance`
+		*/
+		template<class F> bool raycast(const glm::vec3& origin, const glm::vec3& direction, const float maxDistance, uint32_t& userData, float& distance, F&& test) {
+			if(root == NULL_NODE)
+				return false;
+
+			const glm::vec3 invDirection = 1.f / direction;
+			float closest = maxDistance;
+			bool hit = false;
+
+			stack.clear();
+			stack.push_back({ root, 0 });
+			while(!stack.empty()) {
+				const Node& node = nodes[stack.back().node];
+				stack.pop_back();
+
+				float entry;
+				if(!intersectRay(origin, invDirection, node.isLeaf() ? node.tight : node.box, closest, entry))
+					continue;
+
+				if(node.isLeaf()){
+					if(!test(node.userData, entry) || entry > closest)
+						continue;
+
+					closest = entry;
+					userData = node.userData;
+					hit = true;
+				} else {
+					stack.push_back({ node.left, 0 });
+					stack.push_back({ node.right, 0 });
+				}
+			}
+
+			distance = closest;
+			return hit;
+		}
+		bool raycast(const glm::vec3& origin, const glm::vec3& direction, const float maxDistance, uint32_t& userData, float& distance) {
+			return raycast(origin, direction, maxDistance, userData, distance, [](const uint32_t, float&) { return true; });
+		}
+		/**
+		 * @brief Returns a proxy's box, not enlarged
+		*/
+		const BoundingBox& getBounds(const int32_t proxy) const {
+			return nodes[proxy].tight;
+		}
+		/**
+		 * @brief Removes every proxy
+		*/
+		void clear() {
+			nodes.clear();
+			root = NULL_NODE;
+			freeList = NULL_NODE;
+			leafCount = 0;
+		}
+		/**
+		 * @brief Returns the number of proxies
+		*/
+		size_t size() const {
+			return leafCount;
+		}
+		/**
+		 * @brief Returns the number of levels below the root, 0 if empty
+		*/
+		int32_t getHeight() const {
+			return (root == NULL_NODE) ? 0 : nodes[root].height;
+		}
+	private:
+		static const uint8_t ALL_PLANES = 0x3F;
+		static constexpr float DISPLACEMENT_FRAMES = 16.f;	// Frames of movement leaves are stretched by
+		static constexpr float MAX_STRETCH = 16.f;	// In margins, so fast boxes don't get boxes that overlap half the scene
+
+		struct Node {
+			BoundingBox box;	// Enlarged by `margin` for leaves
+			BoundingBox tight;	// Leaves only
+
+			int32_t parent = NULL_NODE;	// Next free node when free
+			int32_t left = NULL_NODE;
+			int32_t right = NULL_NODE;
+			int32_t height = 0;	// Leaves are 0, free nodes -1
+
+			uint32_t userData = 0;
+
+			bool isLeaf() const {
+				return left == NULL_NODE;
+			}
+		};
+		struct StackEntry {
+			int32_t node;
+			uint8_t planeMask;	// Planes the node still has to be tested against
+		};
+
+		int32_t allocateNode() {
+			if(freeList == NULL_NODE){
+				nodes.emplace_back();
+				return nodes.size() - 1;
+			}
+
+			const int32_t index = freeList;
+			freeList = nodes[index].parent;
+			nodes[index] = Node();
+			return index;
+		}
+		void freeNode(const int32_t index) {
+			nodes[index].parent = freeList;
+			nodes[index].height = -1;
+			freeList = index;
+		}
+		/**
+		 * @brief Inserts a leaf next to the sibling that grows the tree's surface area the least
+		*/
+		void insertLeaf(const int32_t leaf) {
+			if(root == NULL_NODE){
+				root = leaf;
+				nodes[root].parent = NULL_NODE;
+				return;
+			}
+
+			// Descend while making the current node the sibling costs more than descending into a child
+			const BoundingBox leafBox = nodes[leaf].box;
+			int32_t index = root;
+			while(!nodes[index].isLeaf()) {
+				const Node& node = nodes[index];
+				const float area = surfaceArea(node.box);
+				const float combinedArea = surfaceArea(merge(node.box, leafBox));
+
+				const float cost = 2.f * combinedArea;
+				const float inheritanceCost = 2.f * (combinedArea - area);	// Paid by every ancestor below here
+
+				const float leftCost = childCost(node.left, leafBox) + inheritanceCost;
+				const float rightCost = childCost(node.right, leafBox) + inheritanceCost;
+				if(cost < leftCost && cost < rightCost)
+					break;
+
+				index = (leftCost < rightCost) ? node.left : node.right;
+			}
+
+			const int32_t sibling = index;
+			const int32_t oldParent = nodes[sibling].parent;
+			const int32_t newParent = allocateNode();
+			nodes[newParent].parent = oldParent;
+			nodes[newParent].box = merge(nodes[sibling].box, leafBox);
+			nodes[newParent].height = nodes[sibling].height + 1;
+			nodes[newParent].left = sibling;
+			nodes[newParent].right = leaf;
+			nodes[sibling].parent = newParent;
+			nodes[leaf].parent = newParent;
+
+			if(oldParent == NULL_NODE){
+				root = newParent;
+			} else if(nodes[oldParent].left == sibling){
+				nodes[oldParent].left = newParent;
+			} else {
+				nodes[oldParent].right = newParent;
+			}
+
+			refit(nodes[leaf].parent);
+		}
+		/**
+		 * @brief Unlinks a leaf, its sibling takes its parent's place
+		*/
+		void removeLeaf(const int32_t leaf) {
+			if(leaf == root){
+				root = NULL_NODE;
+				return;
+			}
+
+			const int32_t parent = nodes[leaf].parent;
+			const int32_t grandParent = nodes[parent].parent;
+			const int32_t sibling = (nodes[parent].left == leaf) ? nodes[parent].right : nodes[parent].left;
+
+			freeNode(parent);
+			if(grandParent == NULL_NODE){
+				root = sibling;
+				nodes[sibling].parent = NULL_NODE;
+				return;
+			}
+
+			if(nodes[grandParent].left == parent)
+				nodes[grandParent].left = sibling;
+			else
+				nodes[grandParent].right = sibling;
+			nodes[sibling].parent = grandParent;
+
+			refit(grandParent);
+		}
+		/**
+		 * @brief Rebalances and recomputes boxes and heights from `index` to the root
+		*/
+		void refit(int32_t index) {
+			while(index != NULL_NODE) {
+				index = balance(index);
+
+				Node& node = nodes[index];
+				node.height = 1 + std::max(nodes[node.left].height, nodes[node.right].height);
+				node.box = merge(nodes[node.left].box, nodes[node.right].box);
+
+				index = node.parent;
+			}
+		}
+		/**
+		 * @brief Rotates the taller child of `a` up if its children's heights differ by more than 1
+		 * @return The node now in `a`'s place
+		*/
+		int32_t balance(const int32_t a) {
+			Node& nodeA = nodes[a];
+			if(nodeA.isLeaf() || nodeA.height < 2)
+				return a;
+
+			const int32_t b = nodeA.left;
+			const int32_t c = nodeA.right;
+			const int32_t difference = nodes[c].height - nodes[b].height;
+
+			if(difference > 1)
+				return rotateUp(a, c, b, false);
+			if(difference < -1)
+				return rotateUp(a, b, c, true);
+
+			return a;
+		}
+		/**
+		 * @brief Moves `up`, a child of `a`, into `a`'s place. `a` keeps `other` and the shorter of `up`'s children
+		 * @param upIsLeft If `up` is `a`'s left child
+		*/
+		int32_t rotateUp(const int32_t a, const int32_t up, const int32_t other, const bool upIsLeft) {
+			Node& nodeA = nodes[a];
+			Node& nodeUp = nodes[up];
+			const int32_t f = nodeUp.left;
+			const int32_t g = nodeUp.right;
+
+			// `up` takes `a`'s place
+			nodeUp.left = a;
+			nodeUp.parent = nodeA.parent;
+			nodeA.parent = up;
+			if(nodeUp.parent == NULL_NODE){
+				root = up;
+			} else if(nodes[nodeUp.parent].left == a){
+				nodes[nodeUp.parent].left = up;
+			} else {
+				nodes[nodeUp.parent].right = up;
+			}
+
+			// The taller grandchild stays with `up`, the shorter moves to `a`
+			const int32_t taller = (nodes[f].height > nodes[g].height) ? f : g;
+			const int32_t shorter = (taller == f) ? g : f;
+			nodeUp.right = taller;
+			if(upIsLeft)
+				nodeA.left = shorter;
+			else
+				nodeA.right = shorter;
+			nodes[shorter].parent = a;
+
+			nodeA.box = merge(nodes[other].box, nodes[shorter].box);
+			nodeA.height = 1 + std::max(nodes[other].height, nodes[shorter].height);
+			nodeUp.box = merge(nodeA.box, nodes[taller].box);
+			nodeUp.height = 1 + std::max(nodeA.height, nodes[taller].height);
+
+			return up;
+		}
+		template<class F> void visitSubtree(const int32_t index, F&& visit) {
+			const size_t base = stack.size();
+			stack.push_back({ index, 0 });
+			while(stack.size() > base) {
+				const Node& node = nodes[stack.back().node];
+				stack.pop_back();
+
+				if(node.isLeaf()){
+					visit(node.userData);
+				} else {
+					stack.push_back({ node.left, 0 });
+					stack.push_back({ node.right, 0 });
+				}
+			}
+		}
+		/**
+		 * @brief Returns the cost of making `child` the new leaf's sibling, or of descending into it
+		*/
+		float childCost(const int32_t child, const BoundingBox& leafBox) const {
+			const BoundingBox& box = nodes[child].box;
+			const float combinedArea = surfaceArea(merge(box, leafBox));
+			return nodes[child].isLeaf() ? combinedArea : combinedArea - surfaceArea(box);
+		}
+		/**
+		 * @brief Enlarges a box by the margin, and by a few frames of `displacement` in its direction, both scaled by `spread`
+		*/
+		BoundingBox fatten(const BoundingBox& box, const glm::vec3& displacement, const float spread) const {
+			const float enlarged = margin * spread;
+			const glm::vec3 predicted = glm::clamp(displacement * DISPLACEMENT_FRAMES * spread, glm::vec3(-MAX_STRETCH * margin), glm::vec3(MAX_STRETCH * margin));
+			return BoundingBox(
+				box.min - glm::vec3(enlarged) + glm::min(predicted, glm::vec3(0.f)),
+				box.max + glm::vec3(enlarged) + glm::max(predicted, glm::vec3(0.f))
+			);
+		}
+		/**
+		 * @brief Returns a factor in [1, 2) hashed from the leaf and the reinsert count, deterministic between runs
+		*/
+		float spread(const int32_t leaf) {
+			const uint32_t hash = ((uint32_t)leaf * 2654435761u) ^ (++reinsertCount * 2246822519u);
+			return 1.f + ((hash * 2654435761u) >> 16) / 65536.f;
+		}
+
+		static BoundingBox merge(const BoundingBox& a, const BoundingBox& b) {
+			return BoundingBox(glm::min(a.min, b.min), glm::max(a.max, b.max));
+		}
+		static bool contains(const BoundingBox& outer, const BoundingBox& inner) {
+			return glm::all(glm::lessThanEqual(outer.min, inner.min)) && glm::all(glm::greaterThanEqual(outer.max, inner.max));
+		}
+		static float surfaceArea(const BoundingBox& box) {
+			const glm::vec3 size = box.max - box.min;
+			return 2.f * (size.x * size.y + size.y * size.z + size.z * size.x);
+		}
+		/**
+		 * @brief Slab test
+		 * @param entry Set to the distance the ray enters the box, 0 if it starts inside
+		*/
+		static bool intersectRay(const glm::vec3& origin, const glm::vec3& invDirection, const BoundingBox& box, const float maxDistance, float& entry) {
+			const glm::vec3 t0 = (box.min - origin) * invDirection;
+			const glm::vec3 t1 = (box.max - origin) * invDirection;
+			const glm::vec3 tNear = glm::min(t0, t1);
+			const glm::vec3 tFar = glm::max(t0, t1);
+
+			entry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.f));
+			const float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+
+			return entry <= exit;
+		}
+
+		std::vector<Node> nodes;
+		std::vector<StackEntry> stack;	// Traversal stack, kept between queries
+		int32_t root = NULL_NODE;
+		int32_t freeList = NULL_NODE;
+		size_t leafCount = 0;
+		uint32_t reinsertCount = 0;	// Seeds spread()
+
+		float margin;
+};
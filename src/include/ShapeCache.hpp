@@ -0,0 +1,361 @@
+#pragma once
+
+#include <bullet/btBulletDynamicsCommon.h>
+
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Collision.h"
+#include "ColliderCooker.h"
+
+/**
+ * @brief Reference-counted cache of collision shapes, keyed by their source data
+ * @details Colliders built from identical vertex data and parameters resolve to one shared shape(and one BVH),
+ * @details so a prop repeated N times in a scene only builds and stores its shape once
+ * @details Lookups hash the source data, hits compare it in full against the cached shape's own vertices, so two different meshes with the same hash never share a shape
+ * @note Shapes returned by the `get*()` functions must be given back with `release()`, never deleted directly
+*/
+class ShapeCache {
+	public:
+		ShapeCache() = default;
+		/**
+		 * @brief Deletes every cached shape, regardless of its reference count
+		*/
+		~ShapeCache() {
+			clear();
+		}
+		ShapeCache(const ShapeCache&) = delete;
+		ShapeCache& operator=(const ShapeCache&) = delete;
+
+		/**
+		 * @brief Gets a shared mesh shape for the given vertices, building it on a cache miss
+		 * @param verticies Vector of all of Vertex structs from the collider mesh
+		 * @param convex If the mesh is concave or convex
+		 * @param bvhCachePath For concave meshes, the cooked BVH file to load from/save to, or "" to always build it
+		 * @note Only vertex positions are compared, normals and texture coordinates don't affect the shape
+		 * @return btCollisionShape pointer, with its reference count incremented
+		*/
+		btCollisionShape* getMesh(const std::vector<Vertex>& verticies, const bool& convex, const std::string& bvhCachePath = "") {
+			Source source = sourceBegin(convex ? ShapeKind::CONVEX_HULL : ShapeKind::TRIANGLE_MESH);
+			source.verticies = &verticies;
+
+			return acquire(std::move(source), [&]() -> btCollisionShape* {
+				if(!convex && !bvhCachePath.empty())
+					return createCachedTriangleMesh(verticies, bvhCachePath);
+				return createCollisionMesh(verticies, convex);
+			});
+		}
+		/**
+		 * @brief Gets a shared cooked(simplified and decomposed) shape for the given vertices
+		 * @param verticies Vector of Vertex structs, every 3 forming a triangle
+		 * @param settings The cooking settings
+		 * @param cachePath File to load the cooked hulls from/save them to, or "" to always cook in memory
+		 * @return btCollisionShape pointer, with its reference count incremented
+		 * @note Unlike getMesh(..., false), the result can be used on dynamic bodies
+		*/
+		btCollisionShape* getCooked(const std::vector<Vertex>& verticies, const CookingSettings& settings = CookingSettings(), const std::string& cachePath = "") {
+			Source source = sourceBegin(ShapeKind::COOKED);
+			appendValue(source, settings.maxHullVertices);
+			appendValue(source, settings.maxHulls);
+			appendValue(source, settings.concavityThreshold);
+			appendValue(source, settings.decompose);
+			source.verticies = &verticies;
+
+			return acquire(std::move(source), [&]() {
+				return createCookedShape(cachePath.empty() ? cookCollider(verticies, settings) : cookCollider(verticies, settings, cachePath));
+			});
+		}
+		/**
+		 * @brief Gets a shared collider for a loaded model
+		 * @param triangles The model's triangles, see Model::getCollisionTriangles()
+		 * @param dynamic If the body has mass, dynamic bodies get cooked hulls, static ones a triangle mesh
+		 * @param cachePath Base path of the cooked files, usually the model's path, or "" to not cache them on disk
+		 * @return btCollisionShape pointer, with its reference count incremented
+		*/
+		btCollisionShape* getModel(const std::vector<Vertex>& triangles, const bool dynamic, const std::string& cachePath = "") {
+			if(dynamic)
+				return getCooked(triangles, CookingSettings(), cachePath.empty() ? "" : cachePath + ".cooked");
+
+			return getMesh(triangles, false, cachePath.empty() ? "" : cachePath + ".bvh");
+		}
+		/**
+		 * @brief Gets a shared box shape
+		 * @param halfExtents Half of the box's size along each axis
+		 * @return btCollisionShape pointer, with its reference count incremented
+		*/
+		btCollisionShape* getBox(const btVector3& halfExtents) {
+			Source source = sourceBegin(ShapeKind::BOX);
+			appendValue(source, halfExtents.getX());
+			appendValue(source, halfExtents.getY());
+			appendValue(source, halfExtents.getZ());
+
+			return acquire(std::move(source), [&]() { return new btBoxShape(halfExtents); });
+		}
+		/**
+		 * @brief Gets a shared sphere shape
+		 * @return btCollisionShape pointer, with its reference count incremented
+		*/
+		btCollisionShape* getSphere(const btScalar radius) {
+			Source source = sourceBegin(ShapeKind::SPHERE);
+			appendValue(source, radius);
+
+			return acquire(std::move(source), [&]() { return new btSphereShape(radius); });
+		}
+		/**
+		 * @brief Gets a shared Y-axis capsule shape
+		 * @return btCollisionShape pointer, with its reference count incremented
+		*/
+		btCollisionShape* getCapsule(const btScalar radius, const btScalar height) {
+			Source source = sourceBegin(ShapeKind::CAPSULE);
+			appendValue(source, radius);
+			appendValue(source, height);
+
+			return acquire(std::move(source), [&]() { return new btCapsuleShape(radius, height); });
+		}
+		/**
+		 * @brief Adds a reference to an already cached shape
+		 * @note Does nothing if the shape isn't owned by the cache
+		*/
+		void retain(const btCollisionShape* shape) {
+			auto iter = shapeKeys.find(shape);
+			if(iter != shapeKeys.end())
+				iter->second.entry->refCount++;
+		}
+		/**
+		 * @brief Removes a reference from a cached shape, deleting it once nothing references it
+		 * @return If the shape was deleted
+		 * @note Does nothing if the shape isn't owned by the cache
+		*/
+		bool release(const btCollisionShape* shape) {
+			auto iter = shapeKeys.find(shape);
+			if(iter == shapeKeys.end())
+				return false;
+
+			Entry* entry = iter->second.entry;
+			if(--entry->refCount > 0)
+				return false;
+
+			auto [begin, end] = entries.equal_range(iter->second.hash);
+			auto owner = std::find_if(begin, end, [&](const auto& candidate) { return &candidate.second == entry; });
+
+			destroyShape(entry->shape);
+			shapeKeys.erase(iter);
+			entries.erase(owner);
+
+			return true;
+		}
+		/**
+		 * @brief Returns if the shape is owned by the cache
+		*/
+		bool contains(const btCollisionShape* shape) const {
+			return shapeKeys.find(shape) != shapeKeys.end();
+		}
+		/**
+		 * @brief Returns the number of references to a cached shape, or 0 if it isn't cached
+		*/
+		uint32_t getRefCount(const btCollisionShape* shape) const {
+			auto iter = shapeKeys.find(shape);
+			return (iter != shapeKeys.end()) ? iter->second.entry->refCount : 0;
+		}
+		/**
+		 * @brief Returns the number of unique shapes in the cache
+		*/
+		size_t size() const {
+			return entries.size();
+		}
+		/**
+		 * @brief Deletes every cached shape
+		 * @attention Any rigidbody still using a cached shape is left with a dangling pointer
+		*/
+		void clear() {
+			for(auto& [hash, entry] : entries) {
+				destroyShape(entry.shape);
+			}
+
+			entries.clear();
+			shapeKeys.clear();
+		}
+	private:
+		/// @brief The first byte of every source
+		enum class ShapeKind : uint8_t {
+			CONVEX_HULL,
+			TRIANGLE_MESH,
+			COOKED,
+			BOX,
+			SPHERE,
+			CAPSULE
+		};
+
+		/// @brief What a shape is built from, its kind and parameters as raw bytes, plus its vertices if it has any
+		struct Source {
+			std::vector<unsigned char> params;					// Starts with the ShapeKind
+			const std::vector<Vertex>* verticies = nullptr;	// Only borrowed for the lookup, never copied into the key
+		};
+
+		struct Entry {
+			btCollisionShape* shape;
+			uint32_t refCount;
+			std::vector<unsigned char> params;
+			std::vector<glm::vec3> positions;	// Only if the shape doesn't keep its source vertices, hulls are simplified and cooked shapes decomposed
+		};
+
+		/// @brief Where a shape's entry is, for retain() and release()
+		struct ShapeKey {
+			uint64_t hash;
+			Entry* entry;	// Elements don't move on rehash
+		};
+
+		/**
+		 * @brief Returns the cached shape built from `source`, or creates it with `build()`
+		*/
+		template<class Builder> btCollisionShape* acquire(Source&& source, Builder build) {
+			const uint64_t hash = hashSource(source);
+			auto [begin, end] = entries.equal_range(hash);
+			for(auto iter = begin; iter != end; iter++) {
+				if(matches(iter->second, source)){
+					iter->second.refCount++;
+					return iter->second.shape;
+				}
+			}
+
+			btCollisionShape* shape = build();
+			Entry entry = { shape, 1, std::move(source.params), {} };
+			if(source.verticies && shape->getShapeType() != TRIANGLE_MESH_SHAPE_PROXYTYPE){
+				entry.positions.reserve(source.verticies->size());
+				for(const Vertex& vertex : *source.verticies) {
+					entry.positions.push_back(vertex.pos);
+				}
+			}
+
+			Entry* cached = &entries.emplace(hash, std::move(entry))->second;
+			shapeKeys[shape] = { hash, cached };
+
+			return shape;
+		}
+		/**
+		 * @brief Returns if `entry` was built from `source`
+		 * @note Triangle meshes are compared against their own mesh interface, other shapes against their kept positions
+		*/
+		static bool matches(const Entry& entry, const Source& source) {
+			if(entry.params != source.params)
+				return false;
+			if(!source.verticies)
+				return true;
+
+			const std::vector<Vertex>& verticies = *source.verticies;
+			if(entry.shape->getShapeType() == TRIANGLE_MESH_SHAPE_PROXYTYPE)
+				return meshMatches(static_cast<const btBvhTriangleMeshShape*>(entry.shape)->getMeshInterface(), verticies);
+
+			return std::equal(entry.positions.begin(), entry.positions.end(), verticies.begin(), verticies.end(), [](const glm::vec3& position, const Vertex& vertex) {
+				return position == vertex.pos;
+			});
+		}
+		/**
+		 * @brief Returns if the mesh holds exactly the triangles in `verticies`, every 3 forming a triangle
+		*/
+		static bool meshMatches(const btStridingMeshInterface* mesh, const std::vector<Vertex>& verticies) {
+			size_t vertex = 0;
+			for(int part = 0; part < mesh->getNumSubParts(); part++) {
+				const unsigned char* vertexBase;
+				const unsigned char* indexBase;
+				int numVerts, vertexStride, indexStride, numFaces;
+				PHY_ScalarType vertexType, indexType;
+				mesh->getLockedReadOnlyVertexIndexBase(&vertexBase, numVerts, vertexType, vertexStride, &indexBase, indexStride, numFaces, indexType, part);
+
+				bool match = vertex + (size_t)numFaces * 3 <= verticies.size();
+				for(int face = 0; match && face < numFaces; face++) {
+					const unsigned char* indices = indexBase + (size_t)face * indexStride;
+					for(int corner = 0; match && corner < 3; corner++) {
+						const unsigned char* position = vertexBase + (size_t)readIndex(indices, indexType, corner) * vertexStride;
+						match = readPosition(position, vertexType) == verticies[vertex++].pos;
+					}
+				}
+				mesh->unLockReadOnlyVertexBase(part);
+
+				if(!match)
+					return false;
+			}
+
+			return vertex == verticies.size();
+		}
+		static uint32_t readIndex(const unsigned char* indices, const PHY_ScalarType type, const int corner) {
+			switch(type) {
+				case PHY_SHORT:
+					return reinterpret_cast<const unsigned short*>(indices)[corner];
+				case PHY_UCHAR:
+					return indices[corner];
+				default:
+					return reinterpret_cast<const unsigned int*>(indices)[corner];
+			}
+		}
+		static glm::vec3 readPosition(const unsigned char* position, const PHY_ScalarType type) {
+			if(type == PHY_DOUBLE){
+				const double* components = reinterpret_cast<const double*>(position);
+				return glm::vec3(components[0], components[1], components[2]);
+			}
+
+			const float* components = reinterpret_cast<const float*>(position);
+			return glm::vec3(components[0], components[1], components[2]);
+		}
+		/**
+		 * @brief Deletes a shape and any data it doesn't own itself
+		 * @note btBvhTriangleMeshShape doesn't delete its btTriangleMesh, and btCompoundShape doesn't delete its children
+		*/
+		static void destroyShape(btCollisionShape* shape) {
+			if(shape->getShapeType() == TRIANGLE_MESH_SHAPE_PROXYTYPE){
+				btStridingMeshInterface* mesh = static_cast<btBvhTriangleMeshShape*>(shape)->getMeshInterface();
+				delete shape;
+				delete mesh;
+			} else if(shape->getShapeType() == COMPOUND_SHAPE_PROXYTYPE){
+				btCompoundShape* compound = static_cast<btCompoundShape*>(shape);
+				for(int i = compound->getNumChildShapes() - 1; i >= 0; i--) {
+					btCollisionShape* child = compound->getChildShape(i);
+					compound->removeChildShapeByIndex(i);
+					destroyShape(child);
+				}
+				delete shape;
+			} else {
+				delete shape;
+			}
+		}
+
+		/// @brief Starts a source with the shape's kind, so different shape types with the same parameters don't match
+		static Source sourceBegin(const ShapeKind kind) {
+			return Source{ std::vector<unsigned char>(1, (unsigned char)kind), nullptr };
+		}
+		template<class T> static void appendValue(Source& source, const T value) {
+			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+			source.params.insert(source.params.end(), bytes, bytes + sizeof(T));
+		}
+		/**
+		 * @brief FNV-1a(64 bit) of the source's parameters and vertex positions
+		 * @note Only vertex positions are hashed, normals and texture coordinates don't affect the shape
+		*/
+		static uint64_t hashSource(const Source& source) {
+			uint64_t hash = hashBytes(14695981039346656037ull, source.params.data(), source.params.size());
+			if(source.verticies){
+				const uint64_t count = source.verticies->size();
+				hash = hashBytes(hash, &count, sizeof(count));
+				for(const Vertex& vertex : *source.verticies) {
+					hash = hashBytes(hash, &vertex.pos, sizeof(glm::vec3));
+				}
+			}
+
+			return hash;
+		}
+		static uint64_t hashBytes(uint64_t hash, const void* data, const size_t size) {
+			const unsigned char* bytes = static_cast<const unsigned char*>(data);
+			for(size_t i = 0; i < size; i++) {
+				hash ^= bytes[i];
+				hash *= 1099511628211ull;
+			}
+
+			return hash;
+		}
+
+		std::unordered_multimap<uint64_t, Entry> entries;					// Source hash to shapes, colliding sources each get an entry
+		std::unordered_map<const btCollisionShape*, ShapeKey> shapeKeys;	// Shape to its entry, for release()
+};
@@ -1,10 +1,13 @@
 #include <glm/mat4x4.hpp>
 #include <glm/vec3.hpp>
 
+#include <algorithm>
 #include <iostream>
 #include <string>
 
+#include "Frustum.hpp"
 #include "Model.hpp"
+#include "OcclusionCuller.hpp"
 #include "shader/BaseShader.hpp"
 
 /**
@@ -67,8 +70,12 @@ class StaticBody {
 		 * @param shader The shader used to draw
 		 * @param cameraView The view matrix of the camera
 		 * @param cameraFOV The FOV of the camera
+		 * @param frustum If set, the body isn't drawn when its bounds are outside it
 		*/
-		void draw(BaseShader &shader, const glm::mat4 &cameraView, const float &cameraFOV) {
+		void draw(BaseShader &shader, const glm::mat4 &cameraView, const float &cameraFOV, const Frustum* frustum = nullptr) {
+			if(frustum && !frustum->intersectsAabb(getWorldBounds()))
+				return;
+
 			shader.bind();
 			shader.setRotation(pos.rotation, pos.rotationAxis);
 			shader.setScale(scale, scale, scale);
@@ -77,6 +84,47 @@ class StaticBody {
 
 			model.draw(shader);
 		}
+		/**
+		 * @brief Queues the object to be drawn, with the same transform as draw()
+		*/
+		void submit(RenderQueue& queue, BaseShader& shader) {
+			model.submit(queue, shader, getTransform());
+		}
+		/**
+		 * @brief Rasterizes the model as an occluder, if it's big enough to be worth it
+		 * @param minExtent Smallest half size of the world box along any axis, small bodies cost more than they hide
+		*/
+		void addOccluder(OcclusionCuller& culler, const float minExtent = 0.f) const {
+			const BoundingBox bounds = getWorldBounds();
+			if(!bounds.valid())
+				return;
+			const glm::vec3 extents = bounds.extents();
+			if(std::max({ extents.x, extents.y, extents.z }) < minExtent)
+				return;
+
+			const glm::mat4 transform = getTransform();
+			for(const Mesh& mesh : model.getMeshes()) {
+				const std::vector<Vertex>& vertices = mesh.getVertices();
+				if(vertices.empty())
+					continue;
+
+				culler.addOccluder(&vertices[0].pos, sizeof(Vertex), vertices.size(), mesh.getIndices().data(), mesh.getIndices().size(), transform);
+			}
+		}
+		/**
+		 * @brief Returns the model matrix draw() uses
+		*/
+		glm::mat4 getTransform() const {
+			glm::mat4 transform = glm::translate(glm::mat4(1.f), pos.pos);
+			transform = glm::scale(transform, glm::vec3(scale));
+			return glm::rotate(transform, pos.rotation, pos.rotationAxis);
+		}
+		/**
+		 * @brief Returns the box around the model, in world space
+		*/
+		BoundingBox getWorldBounds() const {
+			return model.getBounds().transformed(getTransform());
+		}
 		/**
 		 * @brief Sets the scale
 		*/
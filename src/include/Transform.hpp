@@ -0,0 +1,37 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+
+/**
+ * @brief Returns the matrix that transforms normals for a model matrix, the inverse transpose of its upper 3x3
+ * @details Rotations with a uniform scale skip the inverse: for M = sR, inverse(transpose(M)) = R / s = M / s^2
+*/
+inline glm::mat3 normalMatrix(const glm::mat4& model) {
+	const glm::mat3 linear(model);
+
+	const float xx = glm::dot(linear[0], linear[0]);
+	const float yy = glm::dot(linear[1], linear[1]);
+	const float zz = glm::dot(linear[2], linear[2]);
+	const float tolerance = xx * 1e-4f;	// Relative to the squared scale
+	if(xx > 0.f
+		&& std::abs(xx - yy) <= tolerance && std::abs(xx - zz) <= tolerance
+		&& std::abs(glm::dot(linear[0], linear[1])) <= tolerance
+		&& std::abs(glm::dot(linear[0], linear[2])) <= tolerance
+		&& std::abs(glm::dot(linear[1], linear[2])) <= tolerance)
+		return linear * (1.f / xx);
+
+	return glm::transpose(glm::inverse(linear));
+}
+
+/**
+ * @brief A model matrix with its normal matrix, the per-instance data of instanced draws
+*/
+struct InstanceTransform {
+	glm::mat4 model = glm::mat4(1.f);
+	glm::mat3 normal = glm::mat3(1.f);
+
+	InstanceTransform() = default;
+	InstanceTransform(const glm::mat4& model) : model(model), normal(normalMatrix(model)) {}
+};
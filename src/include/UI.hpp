@@ -51,14 +51,13 @@ class Text {
 
 			auto fChars = font.lock().get()->charMap;
 
-			GLenum err = glGetError(); if(err != GL_NO_ERROR) {	std::cerr << "Unhandled OpenGL Error: " << err << " for \"" << text << "\"\n"; }
-
 			shader.bind();
 			shader.setColor(color);
 			shader.setPos(glm::vec3(640.f, 480.f, 0.f));
 
-			glActiveTexture(GL_TEXTURE0);
-			glBindVertexArray(shader.getVAO());
+			GLState::setBlend(true);
+			GLState::setPolygonMode(GL_FILL);
+			GLState::bindVertexArray(shader.getVAO());
 
 			// Draw each character
 			float x = pos.x;	// X position of the each character
@@ -84,7 +83,7 @@ class Text {
 					{ xpos + width, ypos + height, 1.f, 0.f }           
 				};
 				
-				glBindTexture(GL_TEXTURE_2D, ch.textureID);
+				GLState::bindTexture(0, ch.textureID);
 				glBindBuffer(GL_ARRAY_BUFFER, shader.getVBO());
 				glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
 				glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -94,9 +93,6 @@ class Text {
 				// Adjust next X position for the next character
 				x += (ch.advance >> 6) * scale; // Bitshift by 6 to get value in pixels
 			}
-
-			glBindVertexArray(0);
-			glBindTexture(GL_TEXTURE_2D, 0);
 		}
 		virtual ~Text() = default;
 		
@@ -199,7 +195,7 @@ class UI {
 
 				GLuint texture;
 				glGenTextures(1, &texture);
-				glBindTexture(GL_TEXTURE_2D, texture);
+				GLState::bindTexture(0, texture);
 				glTexImage2D(
 					GL_TEXTURE_2D,
 					0,
@@ -250,7 +246,7 @@ class UI {
 			FT_Done_Face(face);
 			FT_Done_FreeType(ft);
 			
-			glBindTexture(GL_TEXTURE_2D, 0);
+			GLState::bindTexture(0, 0);
 
 			return true;
 		}
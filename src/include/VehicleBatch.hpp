@@ -0,0 +1,299 @@
+#pragma once
+
+#include <bullet/btBulletDynamicsCommon.h>
+#include <bullet/BulletDynamics/Dynamics/btActionInterface.h>
+#include <bullet/BulletDynamics/Vehicle/btRaycastVehicle.h>
+#include <bullet/LinearMath/btAabbUtil2.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief A wheel's suspension ray and its result
+*/
+struct WheelRay {
+	btVector3 from;
+	btVector3 to;
+
+	btVector3 hitPoint;
+	btVector3 hitNormal;
+	btScalar fraction;					// Fraction along the ray of the closest hit, 1 if nothing was hit
+	const btCollisionObject* hitObject;	// Closest rigidbody hit, or nullptr
+};
+
+/**
+ * @brief Vehicle raycaster which answers wheel rays from results cast ahead of time by VehicleBatch
+ * @details Results are consumed in order, rays that don't match the next result(eg. a vehicle outside of
+ * @details the batch) are cast individually, the same as btDefaultVehicleRaycaster
+*/
+class BatchedVehicleRaycaster : public btVehicleRaycaster {
+	public:
+		BatchedVehicleRaycaster(btDynamicsWorld* world) : fallback(world) {}
+
+		void* castRay(const btVector3& from, const btVector3& to, btVehicleRaycasterResult& result) override {
+			if(cursor < rays.size() && rays[cursor].from == from && rays[cursor].to == to){
+				const WheelRay& ray = rays[cursor++];
+				if(ray.hitObject == nullptr)
+					return nullptr;
+
+				result.m_hitPointInWorld = ray.hitPoint;
+				result.m_hitNormalInWorld = ray.hitNormal;
+				result.m_hitNormalInWorld.normalize();
+				result.m_distFraction = ray.fraction;
+
+				return (void*)ray.hitObject;
+			}
+
+			return fallback.castRay(from, to, result);
+		}
+		/**
+		 * @brief Gets the ray buffer, filled by VehicleBatch before the vehicles are updated
+		*/
+		std::vector<WheelRay>& getRays() {
+			return rays;
+		}
+		/**
+		 * @brief Starts consuming results from the first ray
+		*/
+		void rewind() {
+			cursor = 0;
+		}
+	private:
+		btDefaultVehicleRaycaster fallback;
+
+		std::vector<WheelRay> rays;
+		size_t cursor = 0;
+};
+
+/**
+ * @brief Steps many raycast vehicles as one action, casting every wheel's suspension ray in a single pass first
+ * @details Every wheel ray of every vehicle is gathered, then one broadphase query over their combined bounds collects
+ * @details the bodies they can hit, instead of one full world ray test per wheel. A sweep along x over both sorted by
+ * @details their bounds pairs each ray with the bodies it overlaps, and only those pairs are ray tested
+ * @note Vehicles must be created with getRaycaster() and not be added to the world themselves, add the batch with
+ * @note `world->addAction(&batch)` instead. The batch doesn't own its vehicles
+*/
+class VehicleBatch : public btActionInterface {
+	public:
+		VehicleBatch(btDynamicsWorld* world) : world(world), raycaster(world) {}
+
+		btVehicleRaycaster* getRaycaster() {
+			return &raycaster;
+		}
+		void add(btRaycastVehicle* vehicle) {
+			if(std::find(vehicles.begin(), vehicles.end(), vehicle) == vehicles.end())
+				vehicles.push_back(vehicle);
+		}
+		void remove(btRaycastVehicle* vehicle) {
+			vehicles.erase(std::remove(vehicles.begin(), vehicles.end(), vehicle), vehicles.end());
+		}
+		const std::vector<btRaycastVehicle*>& getVehicles() const {
+			return vehicles;
+		}
+		size_t size() const {
+			return vehicles.size();
+		}
+		/**
+		 * @brief Casts every wheel ray, then updates each vehicle, called by the world every substep
+		*/
+		void updateAction(btCollisionWorld* collisionWorld, btScalar step) override {
+			castWheelRays();
+
+			raycaster.rewind();
+			for(btRaycastVehicle* vehicle : vehicles) {
+				vehicle->updateVehicle(step);
+			}
+		}
+		void debugDraw(btIDebugDraw* debugDrawer) override {
+			for(btRaycastVehicle* vehicle : vehicles) {
+				vehicle->debugDraw(debugDrawer);
+			}
+		}
+	private:
+		/// @brief A wheel ray's bounds, and the vehicle casting it
+		struct RayBounds {
+			btVector3 min;
+			btVector3 max;
+			uint32_t ray;		// Index into the raycaster's rays
+			uint32_t vehicle;	// Index into `filters`
+		};
+		/// @brief A body the wheel rays may hit, with its broadphase bounds
+		struct Candidate {
+			btCollisionObject* object;
+			btVector3 min;
+			btVector3 max;
+		};
+		/// @brief What a vehicle's wheel rays ignore, its own chassis and the layers it doesn't collide with
+		struct VehicleFilter {
+			const btCollisionObject* chassis;
+			int group;
+			int mask;
+		};
+
+		/// @brief Collects every rigidbody that can support a wheel
+		struct CandidateCallback : public btBroadphaseAabbCallback {
+			std::vector<Candidate>* candidates;
+
+			bool process(const btBroadphaseProxy* proxy) override {
+				btCollisionObject* obj = static_cast<btCollisionObject*>(proxy->m_clientObject);
+
+				// Same as btDefaultVehicleRaycaster, only solid rigidbodies support a wheel
+				const btRigidBody* body = btRigidBody::upcast(obj);
+				if(body && body->hasContactResponse())
+					candidates->push_back({ obj, proxy->m_aabbMin, proxy->m_aabbMax });
+
+				return true;
+			}
+		};
+
+		/**
+		 * @brief Fills the raycaster with every wheel ray, in the order the vehicles will cast them
+		*/
+		void castWheelRays() {
+			std::vector<WheelRay>& rays = raycaster.getRays();
+			rays.clear();
+			rayBounds.clear();
+			filters.clear();
+
+			// Same rays as btRaycastVehicle::rayCast(), from the hard point along the suspension
+			for(btRaycastVehicle* vehicle : vehicles) {
+				const btBroadphaseProxy* chassisProxy = vehicle->getRigidBody()->getBroadphaseHandle();
+				filters.push_back({
+					vehicle->getRigidBody(),
+					chassisProxy ? chassisProxy->m_collisionFilterGroup : btBroadphaseProxy::DefaultFilter,
+					chassisProxy ? chassisProxy->m_collisionFilterMask : btBroadphaseProxy::AllFilter
+				});
+
+				for(int i = 0; i < vehicle->getNumWheels(); i++) {
+					vehicle->updateWheelTransformsWS(vehicle->getWheelInfo(i), false);
+
+					const btWheelInfo& wheel = vehicle->getWheelInfo(i);
+					WheelRay ray;
+					ray.from = wheel.m_raycastInfo.m_hardPointWS;
+					ray.to = ray.from + wheel.m_raycastInfo.m_wheelDirectionWS * (wheel.getSuspensionRestLength() + wheel.m_wheelsRadius);
+					ray.fraction = btScalar(1.f);
+					ray.hitObject = nullptr;
+
+					RayBounds bounds = { ray.from, ray.from, (uint32_t)rays.size(), (uint32_t)filters.size() - 1 };
+					bounds.min.setMin(ray.to);
+					bounds.max.setMax(ray.to);
+					rayBounds.push_back(bounds);
+
+					rays.push_back(ray);
+				}
+			}
+			if(rays.empty())
+				return;
+
+			// One broadphase query over every ray
+			btVector3 aabbMin = rayBounds[0].min;
+			btVector3 aabbMax = rayBounds[0].max;
+			for(const RayBounds& bounds : rayBounds) {
+				aabbMin.setMin(bounds.min);
+				aabbMax.setMax(bounds.max);
+			}
+
+			candidates.clear();
+			CandidateCallback callback;
+			callback.candidates = &candidates;
+			world->getBroadphase()->aabbTest(aabbMin, aabbMax, callback);
+			if(candidates.empty())
+				return;
+
+			sweep(rays);
+		}
+		/**
+		 * @brief Pairs rays and candidates whose bounds overlap along x, and ray tests each pair
+		 * @details Both are sorted by their lowest x. Each one visited is tested against the other kind still active,
+		 * @details those ending before it starts are dropped as nothing visited later can overlap them
+		*/
+		void sweep(std::vector<WheelRay>& rays) {
+			std::sort(rayBounds.begin(), rayBounds.end(), [](const RayBounds& a, const RayBounds& b) {
+				return a.min.getX() < b.min.getX();
+			});
+			std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+				return a.min.getX() < b.min.getX();
+			});
+
+			activeRays.clear();
+			activeCandidates.clear();
+			size_t r = 0;
+			size_t c = 0;
+			while(r < rayBounds.size() || c < candidates.size()) {
+				if(c == candidates.size() || (r < rayBounds.size() && rayBounds[r].min.getX() <= candidates[c].min.getX())){
+					const RayBounds& bounds = rayBounds[r];
+					for(size_t i = 0; i < activeCandidates.size();) {
+						const Candidate& candidate = candidates[activeCandidates[i]];
+						if(candidate.max.getX() < bounds.min.getX()){
+							activeCandidates[i] = activeCandidates.back();
+							activeCandidates.pop_back();
+							continue;
+						}
+
+						castRay(rays[bounds.ray], bounds, candidate);
+						i++;
+					}
+					activeRays.push_back(r++);
+				} else {
+					const Candidate& candidate = candidates[c];
+					for(size_t i = 0; i < activeRays.size();) {
+						const RayBounds& bounds = rayBounds[activeRays[i]];
+						if(bounds.max.getX() < candidate.min.getX()){
+							activeRays[i] = activeRays.back();
+							activeRays.pop_back();
+							continue;
+						}
+
+						castRay(rays[bounds.ray], bounds, candidate);
+						i++;
+					}
+					activeCandidates.push_back(c++);
+				}
+			}
+		}
+		/**
+		 * @brief Tests a ray against a candidate, keeping the hit if it's the closest so far
+		*/
+		void castRay(WheelRay& ray, const RayBounds& bounds, const Candidate& candidate) {
+			if(!TestAabbAgainstAabb2(bounds.min, bounds.max, candidate.min, candidate.max))
+				return;
+
+			const VehicleFilter& filter = filters[bounds.vehicle];
+			const btCollisionObject* obj = candidate.object;
+			const btBroadphaseProxy* proxy = obj->getBroadphaseHandle();
+			if(obj == filter.chassis || !(proxy->m_collisionFilterGroup & filter.mask) || !(filter.group & proxy->m_collisionFilterMask))
+				return;
+
+			btTransform fromTransform;
+			btTransform toTransform;
+			fromTransform.setIdentity();
+			toTransform.setIdentity();
+			fromTransform.setOrigin(ray.from);
+			toTransform.setOrigin(ray.to);
+
+			// Starts at the closest hit so far, so only closer hits are reported
+			btCollisionWorld::ClosestRayResultCallback callback(ray.from, ray.to);
+			callback.m_closestHitFraction = ray.fraction;
+			btCollisionWorld::rayTestSingle(fromTransform, toTransform, candidate.object, obj->getCollisionShape(), obj->getWorldTransform(), callback);
+
+			if(callback.hasHit()){
+				ray.hitPoint = callback.m_hitPointWorld;
+				ray.hitNormal = callback.m_hitNormalWorld;
+				ray.fraction = callback.m_closestHitFraction;
+				ray.hitObject = callback.m_collisionObject;
+			}
+		}
+
+		btDynamicsWorld* world;
+		BatchedVehicleRaycaster raycaster;
+
+		std::vector<btRaycastVehicle*> vehicles;
+
+		// Reused every substep
+		std::vector<RayBounds> rayBounds;
+		std::vector<Candidate> candidates;
+		std::vector<VehicleFilter> filters;	// One per vehicle, in the order of `vehicles`
+		std::vector<size_t> activeRays;			// Indices into `rayBounds` the sweep still overlaps
+		std::vector<size_t> activeCandidates;	// Indices into `candidates` the sweep still overlaps
+};
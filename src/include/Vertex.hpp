@@ -0,0 +1,12 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+/**
+ * @brief A mesh vertex, also the input of the collider functions
+*/
+struct Vertex {
+	glm::vec3 pos;
+	glm::vec3 normal;
+	glm::vec2 texCoord;
+};
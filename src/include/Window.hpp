@@ -18,6 +18,7 @@
 #include <cmath>
 
 #include "Camera.hpp"
+#include "GLState.hpp"
 #include "UI.hpp"
 
 #define CREATE_ERROR(msg, err) fprintf(stderr, "Window::init(): %s %i %c", msg, err, '\n'); return 0
@@ -122,13 +123,15 @@ class Window {
 				CREATE_ERROR("Unable to initialize GLEW, GLEW Error: ", glewGetErrorString(glewStatus));
 			}
 
+			GLState::enableDebugOutput();	// Debug builds only
+
 			glViewport(0, 0, windowData.width, windowData.height);
 
 			// OpenGL settings, move to main?
 			glEnable(GL_CULL_FACE);
 			glEnable(GL_DEPTH_TEST);
 			glDepthFunc(GL_LESS);
-			glEnable(GL_BLEND);
+			GLState::setBlend(true);
 			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 			GLenum err = glGetError();
@@ -7,12 +7,14 @@
 #include <glm/mat4x4.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <bullet/btBulletDynamicsCommon.h>
+#include <bullet/BulletCollision/CollisionDispatch/btGhostObject.h>
 #include <BulletWorldImporter/btBulletWorldImporter.h>
 
 #include <json/json.h>
 
 #include <unordered_map>
 #include <functional>
+#include <algorithm>
 #include <typeinfo>
 #include <iostream>
 #include <fstream>
@@ -21,10 +23,18 @@
 #include <vector>
 #include <queue>
 #include <array>
+#include <limits>
 #include <set>
 
 #include "../shader/BaseShader.hpp"
-#include "../PhysicsDrawer.hpp"
+#include "../CollisionLayers.hpp"
+#include "../PhysicsLOD.hpp"
+#include "../RenderQueue.hpp"
+#include "../SceneBVH.hpp"
+#include "../OcclusionCuller.hpp"
+#include "../PhysicsProfiler.hpp"
+#include "../Broadphase.hpp"
+#include "../PhysicsRender.h"
 #include "../Model.hpp"
 
 #define MAX_COMPONENTS 32
@@ -138,6 +148,18 @@ template<class T> class ComponentArray : public IComponentArray {
 			// return it always and assume that the caller knows if its "activated"(valid) or not
 			return (entityToComponent.test(entity)) ? &components[entity] : nullptr;
 		}
+		/// @brief Queues an entity whose component changed, so systems only update what changed
+		/// @note Queue an entity once until clearChanged(), eg. only when a flag in the component goes from false to true
+		void markChanged(const Entity& entity) {
+			changed.push_back(entity);
+		}
+		/// @brief Returns the entities queued by markChanged()
+		const std::vector<Entity>& getChanged() const {
+			return changed;
+		}
+		void clearChanged() {
+			changed.clear();
+		}
 	private:
 		/// @brief "Packed" component array, every entity has a component already created for it
 		/// @details Components are only "activated" when their index is in the bitset
@@ -150,6 +172,9 @@ template<class T> class ComponentArray : public IComponentArray {
 		/// @brief Number of valid entries in the array
 		/// @attention Most likely useless, will probaly remove
 		uint16_t validComponents;
+
+		/// @brief Entities queued by markChanged()
+		std::vector<Entity> changed;
 };
 
 /// @brief Manages ComponentArrays and Entity interactions with them
@@ -244,11 +269,14 @@ class ComponentManager {
 /// @note If it is part of a child node, the transform matrix is in local space(ie. relative to the parent)
 struct PositionComponent {
 	glm::mat4x4 transform = glm::mat4x4(1.f);
+	bool moved = true;	// Set whenever `transform` changes along with ComponentArray::markChanged(), cleared once GraphicsSystem's BVH is refit
 };
 
 /// @brief Holds a rigidbody
 struct PhysicsComponent {
 	btRigidBody* rigidbody = nullptr;
+	CollisionLayers::Layer layer = CollisionLayers::DEFAULT;	// Set before the body is added to the world
+	PhysicsLODSettings lod;	// Simulation tiers by distance to the viewer, set before the body is added to the world
 
 	~PhysicsComponent() {
 		if(rigidbody)
@@ -286,26 +314,185 @@ class System {
 		System() = default;
 		virtual ~System() = default;
 
+		/// @brief Called by SystemManager after an entity joins `entities`
+		virtual void entityAdded(const Entity& entity) {}
+		/// @brief Called by SystemManager after an entity leaves `entities`
+		virtual void entityRemoved(const Entity& entity) {}
+
 		/// @brief A unique set of entities
 		/// @note Cheaper to have a set of actual values as pointers are 8 bytes on x64 systems
 		std::set<Entity> entities;
 };
 
+/// @brief Phase of a contact between two entities
+enum class ContactEventType : uint8_t {
+	BEGIN,		// The pair started touching this step
+	PERSIST,	// The pair was already touching last step
+	END			// The pair stopped touching this step
+};
+
+/// @brief A contact between two entities during the last physics step
+/// @note `a` is always less than `b`, objects without an entity are EntityManager::INVALID
+/// @note END events hold the last contact seen
+struct ContactEvent {
+	Entity a = EntityManager::INVALID;
+	Entity b = EntityManager::INVALID;
+	ContactEventType type = ContactEventType::BEGIN;
+	bool trigger = false;	// Either object is a trigger volume(has CF_NO_CONTACT_RESPONSE)
+
+	glm::vec3 point = glm::vec3(0.f);	// Deepest contact point, on `b`
+	glm::vec3 normal = glm::vec3(0.f);	// Contact normal on `b`, pointing towards `a`
+	float depth = 0.f;					// Distance between the objects, negative when penetrating
+	float impulse = 0.f;				// Total impulse applied over every contact point of the pair
+
+	uint64_t key() const { return ((uint64_t)a << 32) | b; }
+};
+
+/// @brief Turns Bullet's contact manifolds into begin/persist/end events between entities
+/// @details Walks the dispatcher's manifolds once per step and compares the touching pairs against the last step
+/// @details Buffers are reserved up front and reused, so no memory is allocated per event
+/// @note Entities are read from the collision object's user index(see PhysicsSystem::addRigidBody())
+class ContactEventStream {
+	public:
+		/// @param capacity Number of pairs to reserve space for, buffers only grow past this
+		ContactEventStream(const size_t capacity = 4096) {
+			events.reserve(capacity);
+			current.reserve(capacity);
+			previous.reserve(capacity);
+		}
+		/// @brief Drops the events of the last frame, call before stepping the world
+		void beginFrame() {
+			events.clear();
+		}
+		/// @brief Appends the events of one step, from the dispatcher's current manifolds
+		/// @note Call once after every internal step(eg. from an internal tick callback), so pairs that touch for a
+		/// @note single substep are reported too. A frame may then hold several events for the same pair
+		void update(const btCollisionDispatcher* dispatcher) {
+			std::swap(previous, current);
+			current.clear();
+
+			const int numManifolds = dispatcher->getNumManifolds();
+			for(int i = 0; i < numManifolds; i++) {
+				const btPersistentManifold* manifold = dispatcher->getManifoldByIndexInternal(i);
+				const int numContacts = manifold->getNumContacts();
+				if(numContacts == 0)
+					continue;
+
+				const btCollisionObject* objA = manifold->getBody0();
+				const btCollisionObject* objB = manifold->getBody1();
+				Entity a = getEntity(objA);
+				Entity b = getEntity(objB);
+				if(a == EntityManager::INVALID && b == EntityManager::INVALID)
+					continue;
+
+				// Find the deepest point and sum the impulses
+				int deepest = 0;
+				btScalar impulse = 0.f;
+				for(int j = 0; j < numContacts; j++) {
+					const btManifoldPoint& point = manifold->getContactPoint(j);
+					impulse += point.getAppliedImpulse();
+
+					if(point.getDistance() < manifold->getContactPoint(deepest).getDistance())
+						deepest = j;
+				}
+				const btManifoldPoint& point = manifold->getContactPoint(deepest);
+
+				// Order the pair, Bullet's normal is on B so flip it when swapping
+				const bool swapped = a > b;
+				const btVector3& position = swapped ? point.getPositionWorldOnA() : point.getPositionWorldOnB();
+				const btVector3 normal = swapped ? -point.m_normalWorldOnB : point.m_normalWorldOnB;
+
+				ContactEvent contact;
+				contact.a = swapped ? b : a;
+				contact.b = swapped ? a : b;
+				contact.trigger = (objA->getCollisionFlags() | objB->getCollisionFlags()) & btCollisionObject::CF_NO_CONTACT_RESPONSE;
+				contact.point = glm::vec3(position.getX(), position.getY(), position.getZ());
+				contact.normal = glm::vec3(normal.getX(), normal.getY(), normal.getZ());
+				contact.depth = point.getDistance();
+				contact.impulse = impulse;
+
+				current.push_back(contact);
+			}
+
+			std::sort(current.begin(), current.end(), [](const ContactEvent& lhs, const ContactEvent& rhs) {
+				return lhs.key() < rhs.key();
+			});
+
+			// Merge pairs with multiple manifolds(eg. compound shapes), keeping the deepest point
+			size_t merged = 0;
+			for(size_t i = 0; i < current.size(); i++) {
+				if(merged > 0 && current[merged - 1].key() == current[i].key()){
+					ContactEvent& contact = current[merged - 1];
+					const float impulse = contact.impulse + current[i].impulse;
+					if(current[i].depth < contact.depth)
+						contact = current[i];
+					contact.impulse = impulse;
+				} else {
+					current[merged++] = current[i];
+				}
+			}
+			current.resize(merged);
+
+			// Both lists are sorted, so walk them together
+			size_t i = 0;
+			size_t j = 0;
+			while(i < current.size() || j < previous.size()) {
+				if(j == previous.size() || (i < current.size() && current[i].key() < previous[j].key())){
+					push(current[i++], ContactEventType::BEGIN);
+				} else if(i == current.size() || previous[j].key() < current[i].key()){
+					push(previous[j++], ContactEventType::END);
+				} else {
+					push(current[i], ContactEventType::PERSIST);
+					i++;
+					j++;
+				}
+			}
+		}
+		/// @brief Forgets every pair without emitting END events, eg. after the world is replaced
+		void clear() {
+			events.clear();
+			current.clear();
+			previous.clear();
+		}
+		/// @brief Returns the contiguous array of events from every step since beginFrame(), in step order
+		const ContactEvent* data() const { return events.data(); }
+		size_t size() const { return events.size(); }
+		const ContactEvent* begin() const { return events.data(); }
+		const ContactEvent* end() const { return events.data() + events.size(); }
+	private:
+		static Entity getEntity(const btCollisionObject* obj) {
+			return (obj->getUserIndex() >= 0) ? (Entity)obj->getUserIndex() : EntityManager::INVALID;
+		}
+		void push(const ContactEvent& contact, const ContactEventType type) {
+			events.push_back(contact);
+			events.back().type = type;
+		}
+
+		std::vector<ContactEvent> events;	// Events from every step since beginFrame()
+		std::vector<ContactEvent> current;	// Touching pairs this step, sorted by key
+		std::vector<ContactEvent> previous;	// Touching pairs last step, sorted by key
+};
+
 /// @brief Controls physics interactions
 /// @details holds everything required to host a physics world
 class PhysicsSystem : public System {
 	public:
-		PhysicsSystem(ComponentArray<PositionComponent>* positionCompArr, ComponentArray<PhysicsComponent>* physicsCompArr, const std::string& initialStatePath = "")
-			: positionCompArr(positionCompArr), physicsCompArr(physicsCompArr), debugDrawer(new PhysicsDrawer()) {
+		/// @param broadphase The broadphase used by the world, see physics_bench to pick one per level
+		PhysicsSystem(ComponentArray<PositionComponent>* positionCompArr, ComponentArray<PhysicsComponent>* physicsCompArr, const std::string& initialStatePath = "", const BroadphaseSettings& broadphase = BroadphaseSettings())
+			: positionCompArr(positionCompArr), physicsCompArr(physicsCompArr), broadphaseSettings(broadphase), debugDrawer(nullptr) {
 				// Initialize bullet subsystems
 				collisionConfig = new btDefaultCollisionConfiguration();
 				dispatcher = new btCollisionDispatcher(collisionConfig);
-				interface = new btDbvtBroadphase();
+				interface = createBroadphase(broadphaseSettings);
 				solver = new btSequentialImpulseConstraintSolver();
 				dynamicsWorld = new btDiscreteDynamicsWorld(dispatcher, interface, solver, collisionConfig);
 
 				dynamicsWorld->setGravity(btVector3(0.f, -10.f, 0.f));
 				dynamicsWorld->setDebugDrawer(debugDrawer);
+				dynamicsWorld->addAction(&lod);
+				dynamicsWorld->setInternalTickCallback(internalTick, this);
+
+				profiler.addZone("PhysicsSystem::syncTransforms", PhysicsPhase::SYNC);
 
 				if(initialStatePath.compare("") != 0)
 					loadState(initialStatePath);
@@ -314,7 +501,16 @@ class PhysicsSystem : public System {
 			}
 		~PhysicsSystem() {}
 		void tick(const Uint32& deltaTime) {
-			dynamicsWorld->stepSimulation(deltaTime / 1000.f, 10);
+			profiler.beginTick();
+			contactEvents.beginFrame();
+			const int substeps = dynamicsWorld->stepSimulation(deltaTime / 1000.f, 10);	// Contact events are gathered by internalTick()
+
+			syncTransforms();
+			profiler.endTick(dynamicsWorld, substeps);
+		}
+		/// @brief Copies every entity's rigidbody transform to its PositionComponent
+		void syncTransforms() {
+			BT_PROFILE("PhysicsSystem::syncTransforms");
 
 			for(const Entity& entity : entities) {
 				PhysicsComponent* physicsComp = physicsCompArr->get(entity);
@@ -350,17 +546,90 @@ class PhysicsSystem : public System {
 					) * worldTransform
 				);
 
-				positionComp->transform = worldTransform;
+				if(positionComp->transform != worldTransform){
+					positionComp->transform = worldTransform;
+					if(!positionComp->moved){
+						positionComp->moved = true;
+						positionCompArr->markChanged(entity);
+					}
+				}
+			}
+		}
+		/// @brief Adds an entity's rigidbody to the world on its collision layer
+		/// @details Tags the body with the entity for contact events
+		void addRigidBody(const Entity& entity) {
+			PhysicsComponent* physicsComp = physicsCompArr->get(entity);
+			if(physicsComp == nullptr || physicsComp->rigidbody == nullptr){
+				std::cerr << "PhysicsSystem::addRigidBody(): Entity " << entity << " has no rigidbody\n";
+				return;
 			}
+
+			physicsComp->rigidbody->setUserIndex(entity);
+			CollisionLayers::tag(physicsComp->rigidbody, physicsComp->layer);
+			dynamicsWorld->addRigidBody(physicsComp->rigidbody, layers.getGroup(physicsComp->layer), layers.getMask(physicsComp->layer));
+			lod.add(physicsComp->rigidbody, physicsComp->lod);
+		}
+		/// @brief Removes an entity's rigidbody from the world and the LOD, the component keeps owning it
+		/// @note Call before the component is removed or destroyed, as it deletes the body
+		void removeRigidBody(const Entity& entity) {
+			PhysicsComponent* physicsComp = physicsCompArr->get(entity);
+			if(physicsComp == nullptr || physicsComp->rigidbody == nullptr){
+				std::cerr << "PhysicsSystem::removeRigidBody(): Entity " << entity << " has no rigidbody\n";
+				return;
+			}
+
+			lod.remove(physicsComp->rigidbody);
+			dynamicsWorld->removeRigidBody(physicsComp->rigidbody);
+		}
+		/// @brief Creates a trigger volume for an entity, which reports contact events but doesn't collide
+		/// @note The system takes ownership of `shape`
+		btGhostObject* addTrigger(const Entity& entity, btCollisionShape* shape, const btTransform& transform) {
+			btGhostObject* trigger = new btGhostObject();
+			trigger->setCollisionShape(shape);
+			trigger->setWorldTransform(transform);
+			trigger->setCollisionFlags(trigger->getCollisionFlags() | btCollisionObject::CF_NO_CONTACT_RESPONSE);
+			trigger->setActivationState(DISABLE_DEACTIVATION);	// Keep reporting bodies that fall asleep inside it
+			trigger->setUserIndex(entity);
+			CollisionLayers::tag(trigger, CollisionLayers::TRIGGER);
+
+			// The trigger layer doesn't test against static geometry or other triggers
+			dynamicsWorld->addCollisionObject(trigger, layers.getGroup(CollisionLayers::TRIGGER), layers.getMask(CollisionLayers::TRIGGER));
+			objArray.push_back(shape);
+
+			return trigger;
+		}
+		/// @brief Returns the contact and trigger events from every substep of the last tick
+		const ContactEventStream& getContactEvents() const {
+			return contactEvents;
+		}
+		/// @brief Returns the collision layers, add layers and change which collide before adding bodies
+		CollisionLayers& getLayers() {
+			return layers;
+		}
+		/// @brief Returns the profiler, enable it to collect per phase timings of each tick
+		PhysicsProfiler& getProfiler() {
+			return profiler;
+		}
+		/// @brief Returns the simulation LOD, update its viewer every tick
+		PhysicsLOD& getLOD() {
+			return lod;
+		}
+		/// @brief Returns the dynamics world, eg. for VehicleSystem
+		/// @note Replaced by loadState()
+		btDiscreteDynamicsWorld* getDynamicsWorld() {
+			return dynamicsWorld;
 		}
 		/// @brief Casts a ray from `origin` with a heading of `direction` and length of `len`
+		/// @param queryMask Layers the ray can hit, see CollisionLayers::getQueryMask()
 		/// @returns A pointer to the hit rigidbody or nullptr if there's no collision
-		const btRigidBody* castRay(const glm::vec3& origin, const glm::vec3& direction, const float len) {
+		const btRigidBody* castRay(const glm::vec3& origin, const glm::vec3& direction, const float len, const int queryMask = CollisionLayers::ALL) {
 			btVector3 from = btVector3(origin.x, origin.y, origin.z);
 			btVector3 dir = btVector3(direction.x, direction.y, direction.z);
 			btVector3 to = from + (dir * len);
 
 			btDynamicsWorld::ClosestRayResultCallback callback(from, to);
+			callback.m_collisionFilterGroup = CollisionLayers::ALL;	// Only filter by the query mask
+			callback.m_collisionFilterMask = queryMask;
 
 			dynamicsWorld->rayTest(from, to, callback);
 
@@ -385,11 +654,15 @@ class PhysicsSystem : public System {
 			return nullptr;
 		}
 		/// @brief Use the physics debugger to draw with the given debug level
-		void debugDraw(const glm::mat4& cameraView, const float& cameraFOV, const int debugMode) {
-			debugDrawer->setDebugMode(debugMode);
-			debugDrawer->setCamera(cameraView, cameraFOV);
+		/// @note Creates the debug drawer on first use, so the system can run without a GL context
+		void debugDraw(const CameraData& camera, const int debugMode) {
+			if(debugDrawer == nullptr){
+				debugDrawer = createPhysicsDrawer();
+				dynamicsWorld->setDebugDrawer(debugDrawer);
+			}
 
-			dynamicsWorld->debugDrawWorld();
+			debugDrawer->setDebugMode(debugMode);
+			drawPhysicsWorld(debugDrawer, dynamicsWorld, camera);	// Culled to the camera
 		}
 		/// @brief Resets the simulation to its starting state
 		/// @note Attempts to load initState.bin from the saves folder
@@ -397,9 +670,11 @@ class PhysicsSystem : public System {
 			loadState("saves/initState.bin");
 		}
 		/// @brief Saves the current state of the physics engine to a file
+		/// @details Each body is saved with its collision layer as its name, see CollisionLayers::nameObjects()
 		void saveState(const std::string& filename) {
 			btDefaultSerializer* serializer = new btDefaultSerializer();
 
+			const std::vector<std::string> names = CollisionLayers::nameObjects(dynamicsWorld, serializer);
 			dynamicsWorld->serialize(serializer);
 
 			std::ofstream file(filename, std::ios::binary);
@@ -422,6 +697,7 @@ class PhysicsSystem : public System {
 				return;
 			}
 
+			lod.clear();
 			for(int i = dynamicsWorld->getNumCollisionObjects() - 1; i >= 0; i--) {
 				btCollisionObject* obj = dynamicsWorld->getCollisionObjectArray()[i];
 				btRigidBody* body = btRigidBody::upcast(obj);
@@ -442,7 +718,7 @@ class PhysicsSystem : public System {
 			// Recreate
 			collisionConfig = new btDefaultCollisionConfiguration();
 			dispatcher = new btCollisionDispatcher(collisionConfig);
-			interface = new btDbvtBroadphase();
+			interface = createBroadphase(broadphaseSettings);
 			solver = new btSequentialImpulseConstraintSolver();
 			dynamicsWorld = new btDiscreteDynamicsWorld(dispatcher, interface, solver, collisionConfig);
 
@@ -450,8 +726,12 @@ class PhysicsSystem : public System {
 
 			if(!importer->loadFileFromMemory(reinterpret_cast<char*>(data), bufferSize))
 				throw std::runtime_error("PhysicsSystem::loadState(): Unable to deserialize file at \"" + filename + '"');
+			layers.restore(dynamicsWorld, *importer);
 
 			dynamicsWorld->setDebugDrawer(debugDrawer);
+			dynamicsWorld->addAction(&lod);
+			dynamicsWorld->setInternalTickCallback(internalTick, this);
+			contactEvents.clear();
 
 			for(int i = 0; i < dynamicsWorld->getNumCollisionObjects(); i++) {
 				btCollisionObject* obj = dynamicsWorld->getCollisionObjectArray()[i];
@@ -462,6 +742,11 @@ class PhysicsSystem : public System {
 			delete importer;
 		}
 	private:
+		/// @brief Called by the world after every internal step, so contact events see every substep
+		static void internalTick(btDynamicsWorld* world, btScalar step) {
+			PhysicsSystem* system = static_cast<PhysicsSystem*>(world->getWorldUserInfo());
+			system->contactEvents.update(static_cast<const btCollisionDispatcher*>(world->getDispatcher()));
+		}
 		/// @brief Loads a file into memory and returns its data
 		/// @param filename The file path to load
 		/// @param bufferSize A variable to hold the file size
@@ -492,18 +777,24 @@ class PhysicsSystem : public System {
 		btDefaultCollisionConfiguration* collisionConfig;	// Default memory and collision setup
 		btCollisionDispatcher* dispatcher;					// Collision handler
 		btBroadphaseInterface* interface;					// AABB collision detection interface
+		BroadphaseSettings broadphaseSettings;				// Type of `interface`
 		btSequentialImpulseConstraintSolver* solver;		// Constraint solver
 		btDiscreteDynamicsWorld* dynamicsWorld;				// Dynamics world
 		btAlignedObjectArray<btCollisionShape*> objArray;	// Collision shape array
 
-		PhysicsDrawer* debugDrawer;
+		ContactEventStream contactEvents;
+		CollisionLayers layers;
+		PhysicsLOD lod;
+		PhysicsProfiler profiler;
+
+		btIDebugDraw* debugDrawer;	// A PhysicsDrawer, created on first use
 };
 
 /// @brief Controls graphics
 class GraphicsSystem : public System {
 	public:
 		GraphicsSystem(ComponentArray<PositionComponent>* positionCompArr, ComponentArray<RenderComponent>* renderCompArr)
-			: positionCompArr(positionCompArr), renderCompArr(renderCompArr){}
+			: positionCompArr(positionCompArr), renderCompArr(renderCompArr), proxies(MAX_ENTITIES, SceneBVH::NULL_NODE){}
 		~GraphicsSystem() {}
 		void tick(BaseShader& shader, const glm::mat4x4& cameraView, const float& fov) {
 			shader.bind();
@@ -524,15 +815,147 @@ class GraphicsSystem : public System {
 				shader.perspective(positionComp->transform, cameraView, fov);
 				renderComp->model.draw(shader);
 			}
+		}
+		/// @brief Queues every visible entity inside the queue's frustum instead of drawing it, see RenderQueue
+		/// @details Culled hierarchically with the BVH, the queue then culls each mesh
+		/// @param occlusion If set, entities it finds hidden behind its occluders aren't queued, add the occluders first
+		void submit(RenderQueue& queue, BaseShader& shader, OcclusionCuller* occlusion = nullptr) {
+			updateBVH();
+
+			bvh.cull(queue.getFrustum(), [&](const uint32_t entity) {
+				RenderComponent* renderComp = renderCompArr->get(entity);
+				if(!renderComp->visible)
+					return;
+				if(occlusion && !occlusion->isVisible(worldBounds(entity)))
+					return;
+
+				PositionComponent* positionComp = positionCompArr->get(entity);
+				renderComp->model.submit(queue, shader, glm::scale(positionComp->transform, renderComp->scale));
+			});
+		}
+		/// @brief Finds the closest visible entity the ray hits, tested against its meshes' triangles, without going through physics
+		/// @param direction Normalized
+		/// @param maxDistance Eg. the distance to the terrain, so entities behind it aren't picked
+		/// @param distance Set to the distance to the hit
+		/// @return The entity, EntityManager::INVALID if nothing was hit
+		Entity pick(const glm::vec3& origin, const glm::vec3& direction, const float maxDistance, float& distance) {
+			updateBVH();
+
+			uint32_t entity;
+			const bool hit = bvh.raycast(origin, direction, maxDistance, entity, distance, [&](const uint32_t entity, float& hitDistance) {
+				return renderCompArr->get(entity)->visible && intersectModel(entity, origin, direction, hitDistance);
+			});
+
+			return hit ? entity : EntityManager::INVALID;
+		}
+		/// @brief Removes entities that left the system, inserts ones that joined and refits moved ones
+		/// @details Only touches the entities queued by the system hooks and PositionComponent's ComponentArray::markChanged()
+		void updateBVH() {
+			for(const Entity& entity : removed) {
+				if(proxies[entity] == SceneBVH::NULL_NODE)
+					continue;
+
+				bvh.remove(proxies[entity]);
+				proxies[entity] = SceneBVH::NULL_NODE;
+			}
+			removed.clear();
+
+			for(const Entity& entity : added) {
+				if(proxies[entity] != SceneBVH::NULL_NODE || entities.count(entity) == 0)
+					continue;
+
+				proxies[entity] = bvh.insert(worldBounds(entity), entity);
+				positionCompArr->get(entity)->moved = false;
+			}
+			added.clear();
+
+			for(const Entity& entity : positionCompArr->getChanged()) {
+				PositionComponent* positionComp = positionCompArr->get(entity);
+				if(positionComp == nullptr)
+					continue;
 
-			GLenum err = glGetError();
-			if(err != GL_NO_ERROR) {
-				std::cerr << "GraphicsSystem ERROR: Unhandled OpenGL Error: " << err << std::endl;
+				if(positionComp->moved && proxies[entity] != SceneBVH::NULL_NODE)
+					bvh.move(proxies[entity], worldBounds(entity));
+				positionComp->moved = false;
 			}
+			positionCompArr->clearChanged();
+		}
+		void entityAdded(const Entity& entity) override {
+			added.push_back(entity);
+		}
+		void entityRemoved(const Entity& entity) override {
+			removed.push_back(entity);
+		}
+		/// @brief Returns the BVH over every entity's world bounds
+		const SceneBVH& getBVH() const {
+			return bvh;
 		}
 	private:
+		/// @brief Returns an entity's model bounds in world space, scaled the same as its draws
+		BoundingBox worldBounds(const Entity entity) {
+			const glm::mat4 transform = glm::scale(positionCompArr->get(entity)->transform, renderCompArr->get(entity)->scale);
+			return renderCompArr->get(entity)->model.getBounds().transformed(transform);
+		}
+		/// @brief Tests a world space ray against an entity's triangles, in model space so its transform is applied once
+		/// @param distance Set to the closest hit, already the world distance as the ray is transformed with the model
+		bool intersectModel(const Entity entity, const glm::vec3& origin, const glm::vec3& direction, float& distance) {
+			const glm::mat4 inverse = glm::inverse(glm::scale(positionCompArr->get(entity)->transform, renderCompArr->get(entity)->scale));
+			const glm::vec3 localOrigin = glm::vec3(inverse * glm::vec4(origin, 1.f));
+			const glm::vec3 localDirection = glm::vec3(inverse * glm::vec4(direction, 0.f));
+
+			bool hit = false;
+			float closest = std::numeric_limits<float>::max();
+			for(const Mesh& mesh : renderCompArr->get(entity)->model.getMeshes()) {
+				const std::vector<Vertex>& vertices = mesh.getVertices();
+				const std::vector<GLuint>& indices = mesh.getIndices();
+				for(size_t i = 0; i + 2 < indices.size(); i += 3) {
+					if(indices[i] >= vertices.size() || indices[i + 1] >= vertices.size() || indices[i + 2] >= vertices.size())
+						continue;
+
+					float t;
+					if(intersectTriangle(localOrigin, localDirection, vertices[indices[i]].pos, vertices[indices[i + 1]].pos, vertices[indices[i + 2]].pos, t) && t < closest){
+						closest = t;
+						hit = true;
+					}
+				}
+			}
+
+			if(hit)
+				distance = closest;
+			return hit;
+		}
+		/// @brief Moller-Trumbore ray triangle test, both faces count
+		/// @param t Set to the hit's distance along the ray in units of `direction`
+		static bool intersectTriangle(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, float& t) {
+			const glm::vec3 edge1 = b - a;
+			const glm::vec3 edge2 = c - a;
+			const glm::vec3 p = glm::cross(direction, edge2);
+			const float determinant = glm::dot(edge1, p);
+			if(std::abs(determinant) < 1e-12f)
+				return false;	// Parallel
+
+			const float invDeterminant = 1.f / determinant;
+			const glm::vec3 toOrigin = origin - a;
+			const float u = glm::dot(toOrigin, p) * invDeterminant;
+			if(u < 0.f || u > 1.f)
+				return false;
+
+			const glm::vec3 q = glm::cross(toOrigin, edge1);
+			const float v = glm::dot(direction, q) * invDeterminant;
+			if(v < 0.f || u + v > 1.f)
+				return false;
+
+			t = glm::dot(edge2, q) * invDeterminant;
+			return t >= 0.f;
+		}
+
 		ComponentArray<PositionComponent>* positionCompArr;
 		ComponentArray<RenderComponent>* renderCompArr;
+
+		SceneBVH bvh;
+		std::vector<int32_t> proxies;	// Entity to BVH proxy, SceneBVH::NULL_NODE if not inserted
+		std::vector<Entity> added;		// Joined the system since the last updateBVH()
+		std::vector<Entity> removed;	// Left the system since the last updateBVH()
 };
 
 /// @brief Manages Systems
@@ -573,18 +996,21 @@ class SystemManager {
 				const ComponentSet& components = systemDependencies.at(id);
 
 				if((componentSet & components) == components){
-					system.get()->entities.insert(entity);
+					if(system.get()->entities.insert(entity).second)
+						system.get()->entityAdded(entity);
 					std::cout << "Added entity to system with componentset of " << components << '\n';
 				} else {
 					std::cout << "Removed entity from system with componentset of " << components << '\n';
-					system.get()->entities.erase(entity);
+					if(system.get()->entities.erase(entity))
+						system.get()->entityRemoved(entity);
 				}
 			}
 		}
 		/// @brief Removes an entity from every System
 		void removeEntity(const Entity& entity) {
 			for(auto& [hash, system] : systems) {
-				system.get()->entities.erase(entity);
+				if(system.get()->entities.erase(entity))
+					system.get()->entityRemoved(entity);
 			}
 		}
 	private:
@@ -637,5 +1063,33 @@ Entity loadEntityFromPrefab(const std::string& path, EntityManager& entityManage
 		}
 	}
 
+	// Collision layer, by name
+	if(root.isMember("layer")){
+		PhysicsComponent* physicsComp = compManager.getComponent<PhysicsComponent>(entity);
+		PhysicsSystem* physicsSystem = sysManager.getSystem<PhysicsSystem>();
+
+		if(physicsComp && physicsSystem){
+			CollisionLayers::Layer layer = physicsSystem->getLayers().get(root["layer"].asString());
+			if(layer != CollisionLayers::INVALID)
+				physicsComp->layer = layer;
+			else
+				std::cerr << "Unknown collision layer \"" << root["layer"].asString() << "\" in \"" << path << "\"\n";
+		}
+	}
+
+	// Simulation LOD, any missing settings keep their defaults
+	if(root.isMember("lod")){
+		PhysicsComponent* physicsComp = compManager.getComponent<PhysicsComponent>(entity);
+		const Json::Value& lod = root["lod"];
+
+		if(physicsComp){
+			physicsComp->lod.enabled = lod.get("enabled", physicsComp->lod.enabled).asBool();
+			physicsComp->lod.reducedDistance = lod.get("reducedDistance", physicsComp->lod.reducedDistance).asFloat();
+			physicsComp->lod.frozenDistance = lod.get("frozenDistance", physicsComp->lod.frozenDistance).asFloat();
+			physicsComp->lod.reducedInterval = (uint8_t)lod.get("reducedInterval", physicsComp->lod.reducedInterval).asUInt();
+			physicsComp->lod.canFreeze = lod.get("canFreeze", physicsComp->lod.canFreeze).asBool();
+		}
+	}
+
 	return entity;
 }
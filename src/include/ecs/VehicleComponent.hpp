@@ -6,9 +6,13 @@
 #include <bullet/LinearMath/btVector3.h>
 #include <bullet/LinearMath/btScalar.h>
 
+#include <unordered_map>
 #include <bitset>
+#include <memory>
+#include <vector>
 
 #include "ECS.hpp"
+#include "../VehicleBatch.hpp"
 
 /// @brief Holds data relating to a wheel
 struct WheelPhysicsData {
@@ -31,11 +35,15 @@ struct WheelPhysicsData {
 };
 
 /// @brief Holds data relating to a raycast vehicle
+/// @note The vehicle is created by VehicleSystem::addVehicle(), once `rigidbody` is set
+/// @note VehicleSystem owns the vehicle, so copies of the component only share it
 struct VehicleComponent : PhysicsComponent {
-    btVehicleRaycaster* vehicleRaycaster = nullptr; // Raycaster for simulating wheel contact
-    btRaycastVehicle* vehicle = nullptr;            // Bullet vehicle object for car physics
+    btRaycastVehicle* vehicle = nullptr;            // Bullet vehicle object for car physics, owned by VehicleSystem
     btRaycastVehicle::btVehicleTuning tuning = btRaycastVehicle::btVehicleTuning();       // Vehicle-unique physics settings
 
+    std::vector<std::pair<WheelPhysicsData, bool>> wheels; // Wheels and if they can steer, added when the vehicle is created
+    std::vector<glm::mat4> wheelTransforms;                 // World transform of each wheel, written by VehicleSystem::tick()
+
     btScalar engineForce = 0.f;     // Current engine force
     btScalar brakeForce = 0.f;      // Current brake force
     btScalar steeringAngle = 0.f;   // Current steering angle, in radians
@@ -45,20 +53,14 @@ struct VehicleComponent : PhysicsComponent {
     float suspensionDamping = 0.88f;        // Damping factor for suspension
     float suspensionCompression = 0.83f;    // Compression factor for suspension
 
-    VehicleComponent(btDynamicsWorld* dynamicsWorld, const std::vector<std::pair<WheelPhysicsData, bool>>& wheels = {})
-        : vehicleRaycaster(new btDefaultVehicleRaycaster(dynamicsWorld)),
-          vehicle(new btRaycastVehicle(tuning, rigidbody, vehicleRaycaster)) {
-        // Add wheels to the vehicle
-        for(const auto [wheel, canSteer] : wheels) {
-            addWheel(wheel, canSteer);
-        }
-    }
-    // Destructor to clean up Bullet objects
-    ~VehicleComponent() {
-        delete vehicle;
-        delete vehicleRaycaster;
-    }
+    VehicleComponent(const std::vector<std::pair<WheelPhysicsData, bool>>& wheels = {}) : wheels(wheels) {}
     void addWheel(const WheelPhysicsData& wheel, const bool canSteer = true) {
+        wheels.push_back({ wheel, canSteer });
+        if(vehicle)
+            createWheel(wheel, canSteer);
+    }
+    /// @brief Adds a wheel to the bullet vehicle
+    void createWheel(const WheelPhysicsData& wheel, const bool canSteer) {
         btWheelInfo& wheelInfo = vehicle->addWheel(
             wheel.connectionPoint,
             wheel.wheelDirection,
@@ -70,21 +72,30 @@ struct VehicleComponent : PhysicsComponent {
         );
 
         wheelInfo.m_rollInfluence = wheel.rollInfluence;
+        wheelTransforms.push_back(glm::mat4(1.f));
     }
     void applyEngineForce(btScalar force) {
         engineForce = force;
+        if(!vehicle)
+            return;
+
         for(int i = 0; i < vehicle->getNumWheels(); i++) {
             vehicle->applyEngineForce(engineForce, i);
         }
     }
     void setBrakeForce(btScalar force) {
         brakeForce = force;
+        if(!vehicle)
+            return;
+
         for(int i = 0; i < vehicle->getNumWheels(); i++) {
             vehicle->setBrake(brakeForce, i);
         }
     }
     void setSteeringAngle(btScalar angle) {
         steeringAngle = angle;
+        if(!vehicle)
+            return;
 
         for(int i = 0; i < vehicle->getNumWheels(); i++) {
             if(vehicle->getWheelInfo(i).m_bIsFrontWheel) {
@@ -95,19 +106,154 @@ struct VehicleComponent : PhysicsComponent {
 };
 
 /// @brief Controls vehicle interactions
-/// @details Requires VehicleComponent
+/// @details Requires PositionComponent and VehicleComponent
+/// @details Every vehicle is stepped by one VehicleBatch action, which casts all wheel rays before the vehicles update
+/// @details The system owns the vehicles, they're deleted by removeVehicle(), or by tick() once their entity leaves the system
+/// @note `dynamicsWorld` must outlive the system, reloading PhysicsSystem's state replaces it
 class VehicleSystem : public System {
     public:
-        VehicleSystem(ComponentArray<VehicleComponent>* vehicleCompArr, btDynamicsWorld* dynamicsWorld)
-            : vehicleCompArr(vehicleCompArr), dynamicsWorld(dynamicsWorld) {}
-        ~VehicleSystem() { }
-        void tick(const Uint32& deltaTime) { }
+        VehicleSystem(ComponentArray<PositionComponent>* positionCompArr, ComponentArray<VehicleComponent>* vehicleCompArr, btDynamicsWorld* dynamicsWorld)
+            : positionCompArr(positionCompArr), vehicleCompArr(vehicleCompArr), dynamicsWorld(dynamicsWorld), batch(dynamicsWorld) {
+                dynamicsWorld->addAction(&batch);
+            }
+        ~VehicleSystem() {
+            dynamicsWorld->removeAction(&batch);
+        }
+        VehicleSystem(const VehicleSystem&) = delete;
+        VehicleSystem& operator=(const VehicleSystem&) = delete;
+        /// @brief Creates the entity's vehicle from its chassis rigidbody and adds it to the batch
+        /// @note Add the chassis to the world first, eg. with PhysicsSystem::addRigidBody()
+        void addVehicle(const Entity& entity) {
+            VehicleComponent* vehicleComp = vehicleCompArr->get(entity);
+            if(vehicleComp == nullptr || vehicleComp->rigidbody == nullptr){
+                std::cerr << "VehicleSystem::addVehicle(): Entity " << entity << " has no chassis rigidbody\n";
+                return;
+            }
+            if(vehicleComp->vehicle)
+                return;
+
+            vehicleComp->tuning.m_suspensionStiffness = vehicleComp->suspensionStiffness;
+            vehicleComp->tuning.m_suspensionDamping = vehicleComp->suspensionDamping;
+            vehicleComp->tuning.m_suspensionCompression = vehicleComp->suspensionCompression;
+
+            removeVehicle(entity);  // Left over from a component that was replaced
+            std::unique_ptr<btRaycastVehicle>& vehicle = vehicles[entity];
+            vehicle = std::make_unique<btRaycastVehicle>(vehicleComp->tuning, vehicleComp->rigidbody, batch.getRaycaster());
+
+            vehicleComp->vehicle = vehicle.get();
+            vehicleComp->rigidbody->setActivationState(DISABLE_DEACTIVATION);	// Sleeping chassis ignore engine force
+            vehicleComp->wheelTransforms.clear();
+            for(const auto& [wheel, canSteer] : vehicleComp->wheels) {
+                vehicleComp->createWheel(wheel, canSteer);
+            }
+
+            vehicleComp->applyEngineForce(vehicleComp->engineForce);
+            vehicleComp->setBrakeForce(vehicleComp->brakeForce);
+            vehicleComp->setSteeringAngle(vehicleComp->steeringAngle);
+
+            batch.add(vehicleComp->vehicle);
+        }
+        /// @brief Removes the entity's vehicle from the batch and deletes it, the chassis is left in the world
+        /// @note The only place vehicles are deleted, besides the system's destructor
+        void removeVehicle(const Entity& entity) {
+            auto iter = vehicles.find(entity);
+            if(iter == vehicles.end())
+                return;
+
+            batch.remove(iter->second.get());
+
+            VehicleComponent* vehicleComp = vehicleCompArr->get(entity);
+            if(vehicleComp && vehicleComp->vehicle == iter->second.get())
+                vehicleComp->vehicle = nullptr;
+
+            vehicles.erase(iter);
+        }
+        /// @brief Writes every vehicle's chassis and wheel transforms into the ECS
+        /// @details Vehicles of entities that left the system(eg. were destroyed) are removed first
+        /// @note Call after PhysicsSystem::tick(), the vehicles themselves are stepped with the world
+        void tick(const Uint32& deltaTime) {
+            removeStale();
+
+            btScalar matrix[16];
+            for(const Entity& entity : entities) {
+                VehicleComponent* vehicleComp = vehicleCompArr->get(entity);
+                btRaycastVehicle* vehicle = vehicleComp->vehicle;
+                if(vehicle == nullptr)
+                    continue;
+
+                // The motion state's interpolated transform, the same one the wheels are placed from below
+                btTransform chassis = vehicle->getChassisWorldTransform();
+                if(btMotionState* motionState = vehicle->getRigidBody()->getMotionState())
+                    motionState->getWorldTransform(chassis);
+                chassis.getOpenGLMatrix(matrix);
+                PositionComponent* positionComp = positionCompArr->get(entity);
+                positionComp->transform = toMat4(matrix);
+                if(!positionComp->moved){
+                    positionComp->moved = true;
+                    positionCompArr->markChanged(entity);
+                }
+
+                for(int i = 0; i < vehicle->getNumWheels(); i++) {
+                    vehicle->updateWheelTransform(i, true);	// Placed from the chassis' motion state, like the chassis above
+                    vehicle->getWheelInfo(i).m_worldTransform.getOpenGLMatrix(matrix);
+                    vehicleComp->wheelTransforms[i] = toMat4(matrix);
+                }
+            }
+        }
         /// @brief Attempts to free a vehicle that is flipped or stuck
         /// @detail Resets the rotation and moves the vehicle up 10 units
-        void reset() { }
+        void reset(const Entity& entity) {
+            VehicleComponent* vehicleComp = vehicleCompArr->get(entity);
+            if(vehicleComp == nullptr || vehicleComp->vehicle == nullptr)
+                return;
+
+            btRigidBody* chassis = vehicleComp->rigidbody;
+            btTransform transform = chassis->getWorldTransform();
+
+            // Keep the heading around the Y axis, drop the roll and pitch
+            const btVector3 forward = transform.getBasis().getColumn(vehicleComp->vehicle->getForwardAxis());
+            transform.setRotation(btQuaternion(btVector3(0.f, 1.f, 0.f), btAtan2(forward.getX(), forward.getZ())));
+            transform.setOrigin(transform.getOrigin() + btVector3(0.f, 10.f, 0.f));
+
+            chassis->setWorldTransform(transform);
+            if(chassis->getMotionState())
+                chassis->getMotionState()->setWorldTransform(transform);
+            chassis->setLinearVelocity(btVector3(0.f, 0.f, 0.f));
+            chassis->setAngularVelocity(btVector3(0.f, 0.f, 0.f));
+            chassis->clearForces();
+
+            vehicleComp->vehicle->resetSuspension();
+        }
+        /// @brief Returns the number of vehicles being simulated
+        size_t size() const {
+            return batch.size();
+        }
     private:
+        /// @brief Removes the vehicles of entities that aren't in the system anymore
+        void removeStale() {
+            std::vector<Entity> stale;
+            for(const auto& [entity, vehicle] : vehicles) {
+                if(entities.count(entity) == 0)
+                    stale.push_back(entity);
+            }
+            for(const Entity& entity : stale) {
+                removeVehicle(entity);
+            }
+        }
+        static glm::mat4 toMat4(const btScalar* matrix) {
+            glm::mat4 result;
+            for(int i = 0; i < 16; i++) {
+                result[i / 4][i % 4] = (float)matrix[i];
+            }
+
+            return result;
+        }
+
         // Component dependencies
+        ComponentArray<PositionComponent>* positionCompArr;
         ComponentArray<VehicleComponent>* vehicleCompArr;
 
         btDynamicsWorld* dynamicsWorld;   // Dynamics world from PhysicsSystem
+        VehicleBatch batch;               // Steps every vehicle, added to `dynamicsWorld` as an action
+        std::unordered_map<Entity, std::unique_ptr<btRaycastVehicle>> vehicles;    // Every vehicle created, by entity
 };
@@ -4,11 +4,31 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <type_traits>
+#include <string_view>
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
 #include <string>
+#include <map>
 
 #include "../FileHandler.hpp"
-#include "../Camera.hpp"
+#include "../GLState.hpp"
+#include "../CameraBuffer.hpp"
+#include "../Transform.hpp"
+
+/**
+ * @brief Typed handle to a uniform's location, resolve once with BaseShader::getUniform() and reuse every draw
+ * @note A handle to a uniform the program doesn't use is invalid(-1), setting it does nothing, the same as OpenGL
+ * @note Handles are only valid for the program they were resolved from, resolve them again after a reload
+*/
+template<class T> struct Uniform {
+	GLint location = -1;
+
+	bool valid() const {
+		return location >= 0;
+	}
+};
 
 /**
  * @brief Shader program which holds a textured quad
@@ -33,24 +53,16 @@ class BaseShader {
 		 * @brief Deletes the shader program
 		*/
 		void freeProgram() {
-			glDeleteProgram(programID);
+			GLState::deleteProgram(programID);
 		}
 		/**
-		 * @brief Sets this shader as the current program
-		 * @return a bool if the binding worked or not
+		 * @brief Sets this shader as the current program, skipped if it already is
+		 * @note Errors are reported by GLState's debug callback in debug builds
+		 * @return false if the program was never loaded
 		*/
 		bool bind() {
-			glUseProgram(programID);
-
-			// Check for errors
-			GLenum error = glGetError();
-			if(error != GL_NO_ERROR) {
-				std::cerr << "Error binding shader: (" << error << ")\n";
-				printProgramLog(programID);
-				return false;
-			}
-
-			return true;
+			GLState::useProgram(programID);
+			return programID != 0;
 		}
 		/**
 		 * @brief Loads the shader program
@@ -113,46 +125,79 @@ class BaseShader {
 			glDeleteShader(vertexShader);
 			glDeleteShader(fragmentShader);
 
+			introspectUniforms();
+
 			return true;
 		}
 		/**
 		 * @brief Applies the appropriate transforms to show perspective or not
-		 * @param cameraView The 4x4 matrix representing the camera's view
-		 * @param fov The camera's fov
+		 * @param cameraView Unused, view and projection come from the Camera block, see CameraBuffer
+		 * @param fov Unused, see `cameraView`
 		 */
 		void perspective(const glm::mat4 cameraView, const float fov) {
 			glm::mat4 model = glm::mat4(1.f);
-			glm::mat4 view 	= glm::mat4(1.f);
-			glm::mat4 projection = glm::mat4(1.f);
 
 			model = glm::translate(model, pos);                     // Set position
 			model = glm::scale(model, scale);						// Set scale
 			model = glm::rotate(model, rotationRad, rotationAxis);	// Set rotation
-			projection = glm::perspective(glm::radians(fov), 640.f / 480.f, 0.1f, 1000.f);
-			view = cameraView;
 
-			glUniformMatrix4fv(glGetUniformLocation(programID, "model"), 1, GL_FALSE, glm::value_ptr(model));
-			glUniformMatrix4fv(glGetUniformLocation(programID, "view"), 1, GL_FALSE, glm::value_ptr(view));
-			glUniformMatrix4fv(glGetUniformLocation(programID, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+			setModel(model);
 		}
 		/**
 		 * @brief Applies the appropriate transforms to show perspective or not
 		 * @param transform The model tranform
-		 * @param cameraView The 4x4 matrix representing the camera's view
-		 * @param fov The camera's fov
+		 * @param cameraView Unused, view and projection come from the Camera block, see CameraBuffer
+		 * @param fov Unused, see `cameraView`
 		 */
 		void perspective(const glm::mat4x4& transform, const glm::mat4 cameraView, const float fov) {
 			glm::mat4 model = transform;
-			glm::mat4 view 	= glm::mat4(1.f);
-			glm::mat4 projection = glm::mat4(1.f);
 
 			model = glm::scale(model, scale);						// Set scale
-			projection = glm::perspective(glm::radians(fov), 640.f / 480.f, 0.1f, 1000.f);
-			view = cameraView;
 
-			glUniformMatrix4fv(glGetUniformLocation(programID, "model"), 1, GL_FALSE, glm::value_ptr(model));
-			glUniformMatrix4fv(glGetUniformLocation(programID, "view"), 1, GL_FALSE, glm::value_ptr(view));
-			glUniformMatrix4fv(glGetUniformLocation(programID, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+			setModel(model);
+		}
+		/**
+		 * @brief Sets the model matrix as is, ignoring the shader's position, rotation and scale
+		 * @note Also sets its normal matrix if the program uses one, see normalMatrix()
+		 */
+		void setModel(const glm::mat4& model) {
+			setInstanced(false);
+			set(modelUniform, model);
+			if(normalMatrixUniform.valid())
+				set(normalMatrixUniform, normalMatrix(model));
+		}
+		/**
+		 * @brief Switches between the `model` uniform and per-instance model matrices, if the program supports it
+		 * @note Skips the upload if it's already set
+		 */
+		void setInstanced(const bool instanced) {
+			if(instanced == this->instanced)
+				return;
+
+			set(instancedUniform, instanced);
+			this->instanced = instanced;
+		}
+		/**
+		 * @brief Returns if the program reads model matrices from the instance attributes, see Mesh::INSTANCE_ATTRIB
+		 */
+		bool supportsInstancing() const {
+			return instancedUniform.valid();
+		}
+		/**
+		 * @brief Sets the view and projection matrices, only for programs without the Camera block
+		 */
+		void setCamera(const glm::mat4& view, const glm::mat4& projection) {
+			if(cameraBlock)
+				return;
+
+			set(viewUniform, view);
+			set(projectionUniform, projection);
+		}
+		/**
+		 * @brief Returns if the program reads view and projection from the shared Camera block, see CameraBuffer
+		 */
+		bool usesCameraBlock() const {
+			return cameraBlock;
 		}
 		/**
 		 * @brief Sets the rotation of the object by the given radians, on the given axis
@@ -188,8 +233,8 @@ class BaseShader {
 		 * @param field The name of the variable
 		 * @param mat4 The matrix data
 		 */
-		void setMat4(const std::string &field, const glm::mat4 mat4) {
-			glUniformMatrix4fv(glGetUniformLocation(programID, field.c_str()), 1, GL_FALSE, glm::value_ptr(mat4));
+		void setMat4(const std::string_view field, const glm::mat4 mat4) {
+			glUniformMatrix4fv(getLocation(field), 1, GL_FALSE, glm::value_ptr(mat4));
 		}
 		/**
 		 * @brief Sets a Vec4 uniform variable's value
@@ -199,8 +244,8 @@ class BaseShader {
 		 * @param value3 The third value of the Vec4
 		 * @param value4 The fourth value of the Vec4
 		 */
-		void setFloat4(const std::string &field, const float value1, const float value2, const float value3, const float value4) {
-			glUniform4f(glGetUniformLocation(programID, field.c_str()), value1, value2, value3, value4);
+		void setFloat4(const std::string_view field, const float value1, const float value2, const float value3, const float value4) {
+			glUniform4f(getLocation(field), value1, value2, value3, value4);
 		}
 		/**
 		 * @brief Sets a Vec3 uniform variable's value
@@ -209,40 +254,81 @@ class BaseShader {
 		 * @param value2 The second value of the Vec3
 		 * @param value3 The third value of the Vec3
 		 */
-		void setFloat3(const std::string &field, const float value1, const float value2, const float value3) {
-			glUniform3f(glGetUniformLocation(programID, field.c_str()), value1, value2, value3);
+		void setFloat3(const std::string_view field, const float value1, const float value2, const float value3) {
+			glUniform3f(getLocation(field), value1, value2, value3);
 		}
 		/**
 		 * @brief Sets a Vec3 uniform variable's value
 		 * @param field The name of the variable
 		 * @param vec3 The 3D vector data
 		 */
-		void setVec3(const std::string &field, const glm::vec3 vec3) {
-			glUniform3f(glGetUniformLocation(programID, field.c_str()), vec3.x, vec3.y, vec3.z);
+		void setVec3(const std::string_view field, const glm::vec3 vec3) {
+			glUniform3f(getLocation(field), vec3.x, vec3.y, vec3.z);
 		}
 		/**
 		 * @brief Sets a boolean uniform variable's value
 		 * @param field The name of the variable
 		 * @param value The value to set
 		 */
-		void setBool(const std::string &field, const bool value) {
-			glUniform1i(glGetUniformLocation(programID, field.c_str()), (int)value); 
+		void setBool(const std::string_view field, const bool value) {
+			glUniform1i(getLocation(field), (int)value);
 		}
 		/**
 		 * @brief Sets an int uniform variable's value
 		 * @param field The name of the variable
 		 * @param value The value to set
 		 */
-		void setInt(const std::string &field, const int value) {
-			glUniform1i(glGetUniformLocation(programID, field.c_str()), value); 
+		void setInt(const std::string_view field, const int value) {
+			glUniform1i(getLocation(field), value);
 		}
 		/**
 		 * @brief Sets a float uniform variable's value
 		 * @param field The name of the variable
 		 * @param value The value to set
 		 */
-		void setFloat(const std::string &field, const float value) {
-			glUniform1f(glGetUniformLocation(programID, field.c_str()), value);
+		void setFloat(const std::string_view field, const float value) {
+			glUniform1f(getLocation(field), value);
+		}
+		/**
+		 * @brief Resolves a typed handle to a uniform, from the table built at link time
+		 * @param field The name of the variable, array elements are named "field[i]"
+		 * @note Warns if the uniform's GLSL type doesn't match `T`
+		 * @return The handle, invalid if the program doesn't use the uniform
+		 */
+		template<class T> Uniform<T> getUniform(const std::string_view field) const {
+			auto iter = uniforms.find(field);
+			if(iter == uniforms.end())
+				return Uniform<T>();
+
+			if(!matchesType<T>(iter->second.type))
+				std::cerr << "BaseShader::getUniform(): \"" << field << "\" is GLSL type 0x" << std::hex << iter->second.type << std::dec << ", not the requested type\n";
+
+			return Uniform<T>{ iter->second.location };
+		}
+		/**
+		 * @brief Sets a uniform through a handle, without any lookup
+		 * @note The program must be bound
+		 */
+		void set(const Uniform<int> uniform, const int value) {
+			glUniform1i(uniform.location, value);
+		}
+		void set(const Uniform<bool> uniform, const bool value) {
+			glUniform1i(uniform.location, (int)value);
+		}
+		void set(const Uniform<float> uniform, const float value) {
+			glUniform1f(uniform.location, value);
+		}
+		void set(const Uniform<glm::vec3> uniform, const glm::vec3& value) {
+			glUniform3fv(uniform.location, 1, glm::value_ptr(value));
+		}
+		void set(const Uniform<glm::vec4> uniform, const glm::vec4& value) {
+			glUniform4fv(uniform.location, 1, glm::value_ptr(value));
+		}
+		void set(const Uniform<glm::mat3> uniform, const glm::mat3& value) {
+			glUniformMatrix3fv(uniform.location, 1, GL_FALSE, glm::value_ptr(value));
+		}
+		void set(const Uniform<glm::mat4> uniform, const glm::mat4& value) {
+			glUniformMatrix4fv(uniform.location, 1, GL_FALSE, glm::value_ptr(value));
 		}
 		/**
 		 * @brief Sets the object's position
@@ -274,6 +360,13 @@ class BaseShader {
 		GLuint getProgramID() {
 			return programID;
 		}
+		/**
+		 * @brief Gets the id of the last link, unique across every shader, so handles can tell when to resolve again
+		 * @return 0 if the program was never linked
+		*/
+		uint64_t getGeneration() const {
+			return generation;
+		}
 
 		/**
 		 *  @brief Prints the log for the given shader
@@ -308,10 +401,114 @@ class BaseShader {
 			delete[] infoLog;
 		}
     protected:
+		/**
+		 * @brief Builds the uniform table from the linked program's active uniforms, call after every link
+		 * @details Array uniforms are added once per element as "name[i]", with "name" aliasing the first element
+		 */
+		void introspectUniforms() {
+			static uint64_t nextGeneration = 1;
+			generation = nextGeneration++;
+			uniforms.clear();
+
+			GLint count = 0;
+			GLint maxLength = 0;
+			glGetProgramiv(programID, GL_ACTIVE_UNIFORMS, &count);
+			glGetProgramiv(programID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+			std::string name(std::max(maxLength, 1), '\0');
+			for(GLint i = 0; i < count; i++) {
+				GLsizei length = 0;
+				GLint size = 0;
+				GLenum type = 0;
+				glGetActiveUniform(programID, (GLuint)i, maxLength, &length, &size, &type, name.data());
+
+				std::string field = name.substr(0, length);
+				const GLint location = glGetUniformLocation(programID, field.c_str());
+				if(location < 0)
+					continue;	// Uniform block members have no location
+
+				// Arrays are reported as "name[0]". Only explicit locations are guaranteed consecutive, so each element is queried
+				const size_t bracket = field.rfind("[0]");
+				if(bracket != std::string::npos && bracket + 3 == field.size()){
+					field.resize(bracket);
+					for(GLint element = 0; element < size; element++) {
+						const std::string elementName = field + '[' + std::to_string(element) + ']';
+						const GLint elementLocation = (element == 0) ? location : glGetUniformLocation(programID, elementName.c_str());
+						if(elementLocation >= 0)
+							uniforms[elementName] = { elementLocation, type };
+					}
+				}
+				uniforms[field] = { location, type };
+			}
+
+			modelUniform = getUniform<glm::mat4>("model");
+			normalMatrixUniform = getUniform<glm::mat3>("normalMatrix");
+			viewUniform = getUniform<glm::mat4>("view");
+			projectionUniform = getUniform<glm::mat4>("projection");
+			instancedUniform = getUniform<bool>("instanced");
+			instanced = false;	// Uniforms are zeroed on link
+
+			bindCameraBlock();
+			if(!cameraBlock && (viewUniform.valid() || projectionUniform.valid()))
+				std::cerr << "BaseShader: Program " << programID << " has no Camera block, view and projection are only set by setCamera()\n";
+		}
+		/**
+		 * @brief Points the program's Camera block at CameraBuffer::BINDING, GL 4.1 has no binding layout qualifier
+		 */
+		void bindCameraBlock() {
+			const GLuint blockIndex = glGetUniformBlockIndex(programID, CameraBuffer::BLOCK_NAME);
+			cameraBlock = blockIndex != GL_INVALID_INDEX;
+			if(cameraBlock)
+				glUniformBlockBinding(programID, blockIndex, CameraBuffer::BINDING);
+		}
+		/**
+		 * @brief Gets a uniform's location from the table, -1 if the program doesn't use it
+		 */
+		GLint getLocation(const std::string_view field) const {
+			auto iter = uniforms.find(field);
+			return (iter != uniforms.end()) ? iter->second.location : -1;
+		}
+
 		GLuint programID;
         GLfloat rotationRad = 0.f;
 		
         glm::vec3 pos = glm::vec3(0.f, 0.f, 0.f);
 		glm::vec3 scale = glm::vec3(1.f, 1.f, 1.f);
 		glm::vec3 rotationAxis = glm::vec3(0.f, 0.f, 0.f);
+
+		// Transform uniforms, resolved at link time
+		Uniform<glm::mat4> modelUniform;
+		Uniform<glm::mat3> normalMatrixUniform;	// Inverse transpose of `model`, computed on the CPU
+		Uniform<glm::mat4> viewUniform;
+		Uniform<glm::mat4> projectionUniform;
+		Uniform<bool> instancedUniform;
+		bool instanced = false;	// Last value uploaded to `instancedUniform`
+		bool cameraBlock = false;	// If the program declares the Camera block
+	private:
+		struct UniformInfo {
+			GLint location;
+			GLenum type;
+		};
+
+		template<class T> static bool matchesType(const GLenum type) {
+			if constexpr(std::is_same_v<T, int>)
+				return type == GL_INT || (type >= GL_SAMPLER_1D && type <= GL_SAMPLER_2D_SHADOW) || type == GL_SAMPLER_CUBE_MAP_ARRAY || type == GL_SAMPLER_2D_ARRAY;
+			else if constexpr(std::is_same_v<T, bool>)
+				return type == GL_BOOL || type == GL_INT;
+			else if constexpr(std::is_same_v<T, float>)
+				return type == GL_FLOAT;
+			else if constexpr(std::is_same_v<T, glm::vec3>)
+				return type == GL_FLOAT_VEC3;
+			else if constexpr(std::is_same_v<T, glm::vec4>)
+				return type == GL_FLOAT_VEC4;
+			else if constexpr(std::is_same_v<T, glm::mat3>)
+				return type == GL_FLOAT_MAT3;
+			else if constexpr(std::is_same_v<T, glm::mat4>)
+				return type == GL_FLOAT_MAT4;
+			else
+				return true;
+		}
+
+		std::map<std::string, UniformInfo, std::less<>> uniforms;	// Name to location, transparent so lookups don't build strings
+		uint64_t generation = 0;	// Id of the last link, 0 before the first
 };
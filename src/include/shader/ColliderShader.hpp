@@ -16,16 +16,15 @@ class ColliderShader : public BaseShader {
 
 			// Vertex Shader
 			GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-			const GLchar* vertSrc[7] = {
+			const GLchar* vertSrc[6] = {
 				"#version 410 core\n", 
 				"layout (location = 0) in vec3 aPos;\n", 
 				"layout (location = 1) in vec3 aColor;\n", 
 				"out vec3 ourColor;\n", 
-				"uniform mat4 view;\n", 
-				"uniform mat4 projection;\n", 
-				"void main() { gl_Position = projection * view * vec4(aPos, 1.0); ourColor = aColor; }"
+				"layout (std140) uniform Camera { mat4 view; mat4 projection; mat4 viewProjection; vec4 cameraPos; vec4 viewport; };\n", 
+				"void main() { gl_Position = viewProjection * vec4(aPos, 1.0); ourColor = aColor; }"
 			};
-			glShaderSource(vertexShader, 7, vertSrc, NULL);
+			glShaderSource(vertexShader, 6, vertSrc, NULL);
 			glCompileShader(vertexShader);
 			
 			GLint status;
@@ -66,33 +65,8 @@ class ColliderShader : public BaseShader {
 			glDeleteShader(vertexShader);
 			glDeleteShader(fragmentShader);
 
-			// Prefetch uniform locations
-			glUseProgram(programID);
-			view = glGetUniformLocation(programID, "view");
-			projection = glGetUniformLocation(programID, "projection");
-			glUseProgram(0);
+			bindCameraBlock();	// The camera comes from CameraBuffer
 
 			return true;
 		}
-		void perspective(const glm::mat4& cameraView, const float& fov) {
-			glm::mat4 model = glm::mat4(1.f);
-			glm::mat4 view 	= glm::mat4(1.f);
-			glm::mat4 projection = glm::mat4(1.f);
-
-			model = glm::translate(model, pos);                     // Set position
-			model = glm::scale(model, scale);						// Set scale
-			model = glm::rotate(model, rotationRad, rotationAxis);	// Set rotation
-			projection = glm::perspective(glm::radians(fov), 640.f / 480.f, 0.1f, 1000.f);
-			view = cameraView;
-
-			glUniformMatrix4fv(this->view, 1, GL_FALSE, glm::value_ptr(view));
-			glUniformMatrix4fv(this->projection, 1, GL_FALSE, glm::value_ptr(projection));
-			GLenum err = glGetError();
-			if(err != GL_FALSE)
-				throw std::runtime_error("Unable to set uniforms, err: " + std::to_string(err));
-			glUseProgram(0);
-		}
-	protected:
-		GLint view;
-		GLint projection;
 };
\ No newline at end of file
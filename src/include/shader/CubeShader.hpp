@@ -32,13 +32,12 @@ class CubeShader {
 				"#version 330 core\n", 
 				"layout (location = 0) in vec3 aPos;\n", 
 				"uniform mat4 model;\n", 
-				"uniform mat4 view;\n", 
-				"uniform mat4 projection;\n", 
-				"void main() { gl_Position = projection * view * model * vec4(aPos, 1.0); }"
+				"layout (std140) uniform Camera { mat4 view; mat4 projection; mat4 viewProjection; vec4 cameraPos; vec4 viewport; };\n", 
+				"void main() { gl_Position = viewProjection * model * vec4(aPos, 1.0); }"
 			};
 
 			// Compile
-			glShaderSource(vertexShader, 6, vertexSource, NULL);
+			glShaderSource(vertexShader, 5, vertexSource, NULL);
 			glCompileShader(vertexShader);
 			
 			// Error check
@@ -104,6 +103,10 @@ class CubeShader {
 			glDeleteShader(vertexShader);
 			glDeleteShader(fragmentShader);
 
+			// The camera comes from CameraBuffer
+			const GLuint cameraBlock = glGetUniformBlockIndex(programID, CameraBuffer::BLOCK_NAME);
+			glUniformBlockBinding(programID, cameraBlock, CameraBuffer::BINDING);
+
 			GLfloat vertexData[] = {	// VBO data
 				 1.f,  1.f, -1.f, 	// Right top back
 				 1.f, -1.f, -1.f, 	// Right bottom back
@@ -145,7 +148,7 @@ class CubeShader {
 			glGenVertexArrays(1, &vao);	// Create VAO
 			glGenBuffers(1, &vbo);		// Create VBO
 			glGenBuffers(1, &ebo);		// Create VBO
-			glBindVertexArray(vao);		// Bind VAO to capture calls
+			GLState::bindVertexArray(vao);		// Bind VAO to capture calls
 
 			// VBO
 			glBindBuffer(GL_ARRAY_BUFFER, vbo);	// Use the vbo
@@ -163,61 +166,35 @@ class CubeShader {
 
 			// Prefetch uniform locations
 			model = glGetUniformLocation(programID, "model");
-			view = glGetUniformLocation(programID, "view");
-			projection = glGetUniformLocation(programID, "projection");
 			color = glGetUniformLocation(programID, "color");
 		}
 		~CubeShader() {
-			glDeleteVertexArrays(1, &vao);
+			GLState::deleteVertexArray(vao);
 			glDeleteBuffers(1, &vbo);
 			glDeleteBuffers(1, &ebo);
-			glDeleteProgram(programID);
+			GLState::deleteProgram(programID);
 		}
 		/**
 		 * @brief Binds the shader and loads the vao
-		 * @throws runtime_error on failure
+		 * @note Errors are reported by GLState's debug callback in debug builds
 		*/
 		void bind() {
-			glUseProgram(programID);
-			GLenum error = glGetError();
-			if(error != GL_NO_ERROR) {
-				std::string err = "Error binding shader: " + std::to_string(error) + '\n';
-				int infoLogLength = 0;
-				int maxLength = 0;
-				
-				glGetProgramiv(programID, GL_INFO_LOG_LENGTH, &maxLength);
-				char* infoLog = new char[maxLength];
-				
-				glGetProgramInfoLog(programID, maxLength, &infoLogLength, infoLog);
-				if(infoLogLength > 0) err += std::string(infoLog);
-				
-				delete[] infoLog;
-
-				throw std::runtime_error(err);
-			}
-
-			glBindVertexArray(vao);
+			GLState::useProgram(programID);
+			GLState::bindVertexArray(vao);
 		}
 		/**
-		 * @brief Applies the appropriate transforms to show perspective or not
-		 * @param cameraView The 4x4 matrix representing the camera's view
-		 * @param fov The camera's fov
+		 * @brief Draws the shape, view and projection come from the Camera block, see CameraBuffer
+		 * @param properties The shape's transform and color
 		 */
-		void draw(const glm::mat4& cameraView, const float& fov, const ShapeProperties properties) {
+		void draw(const ShapeProperties properties) {
 			// Vertex shader calculations
 			glm::mat4 model = glm::mat4(1.f);
-			glm::mat4 view 	= glm::mat4(1.f);
-			glm::mat4 projection = glm::mat4(1.f);
 
 			model = glm::translate(model, properties.pos);					// Set position
 			model = glm::scale(model, properties.scale);					// Set scale
 			model = glm::rotate(model, properties.angle, properties.axis);	// Set rotation
-			projection = glm::perspective(glm::radians(fov), 640.f / 480.f, 0.1f, 100.f);
-			view = cameraView;
 
 			glUniformMatrix4fv(this->model, 1, GL_FALSE, glm::value_ptr(model));
-			glUniformMatrix4fv(this->view, 1, GL_FALSE, glm::value_ptr(view));
-			glUniformMatrix4fv(this->projection, 1, GL_FALSE, glm::value_ptr(projection));
 
 			// Fragment shader
 			glUniform4f(this->color, properties.color.x, properties.color.y, properties.color.z, properties.alpha);
@@ -231,7 +208,5 @@ class CubeShader {
 		GLuint ebo = 0;
 
 		GLint model;
-		GLint view;
-		GLint projection;
 		GLint color;
 };
\ No newline at end of file
@@ -24,7 +24,7 @@ class SkyboxShader : public CubeShader {
 		*/
 		SkyboxShader(const std::vector<std::string> faces) : CubeShader() {
 			glGenTextures(1, &texture);
-			glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+			GLState::bindTexture(0, texture, GL_TEXTURE_CUBE_MAP);
 
 			// Load cubemap
 			int width;
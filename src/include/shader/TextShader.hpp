@@ -34,7 +34,7 @@ class TextShader : public BaseShader {
 		 * @brief Deletes the shader program
 		*/
 		void freeProgram() {
-			glDeleteProgram(programID);
+			GLState::deleteProgram(programID);
 		}
 		/**
 		 * @brief Loads the shader program
@@ -75,9 +75,12 @@ class TextShader : public BaseShader {
 			glDeleteShader(vertexShader);
 			glDeleteShader(fragmentShader);
 
+			introspectUniforms();
+			textColorUniform = getUniform<glm::vec3>("textColor");
+
 			glGenVertexArrays(1, &vao);
 			glGenBuffers(1, &vbo);
-			glBindVertexArray(vao);
+			GLState::bindVertexArray(vao);
 
 			glBindBuffer(GL_ARRAY_BUFFER, vbo);
 			glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 6 * 4, NULL, GL_DYNAMIC_DRAW);
@@ -87,7 +90,7 @@ class TextShader : public BaseShader {
 			
 			// Unbind
 			glBindBuffer(GL_ARRAY_BUFFER, 0);
-			glBindVertexArray(0);
+			GLState::bindVertexArray(0);
 			
 			return true;
 		}
@@ -116,7 +119,7 @@ class TextShader : public BaseShader {
 		 * @param color A vec3 with floats from 0-1, inclusive, representing the rgb components, respectively
 		*/
 		void setColor(const glm::vec3 color) {
-			glUniform3f(glGetUniformLocation(programID, "textColor"), color.x, color.y, color.z);
+			set(textColorUniform, color);
 		}
 		/**
 		 * @brief Sets the text's color
@@ -125,7 +128,7 @@ class TextShader : public BaseShader {
 		 * @param b A float 0-1, inclusive, representing the blue component
 		*/
 		void setColor(const float r, const float g, const float b) {
-			glUniform3f(glGetUniformLocation(programID, "textColor"), r, g, b);
+			set(textColorUniform, glm::vec3(r, g, b));
 		}
 		/**
 		 * @brief Sets the object's position
@@ -137,14 +140,7 @@ class TextShader : public BaseShader {
 		void setPos(const float x, const float y, const float z) {
 			pos = glm::vec3(x, y, z);
 
-			glUniformMatrix4fv(
-				glGetUniformLocation(programID, "projection"), 
-				1, 
-				GL_FALSE, 
-				glm::value_ptr(
-					glm::ortho(0.0f, pos.x, 0.0f, pos.y)
-				)
-			);
+			set(projectionUniform, glm::ortho(0.0f, pos.x, 0.0f, pos.y));
 		}
 		/**
 		 * @brief Sets the object's position
@@ -154,14 +150,7 @@ class TextShader : public BaseShader {
 		void setPos(const glm::vec3 pos) {
 			this->pos = pos;
 
-			glUniformMatrix4fv(
-				glGetUniformLocation(programID, "projection"), 
-				1, 
-				GL_FALSE, 
-				glm::value_ptr(
-					glm::ortho(0.0f, pos.x, 0.0f, pos.y)
-				)
-			);
+			set(projectionUniform, glm::ortho(0.0f, pos.x, 0.0f, pos.y));
 		}
 		/**
 		 * @brief Gets the position of the object
@@ -195,4 +184,6 @@ class TextShader : public BaseShader {
 		GLuint vao = 0;
 		GLuint vbo = 0;
 		GLuint ebo = 0;
+
+		Uniform<glm::vec3> textColorUniform;
 };
@@ -14,6 +14,9 @@
 #include <memory>
 
 #include "include/Heightmap.hpp"
+#include "include/CameraBuffer.hpp"
+#include "include/RenderQueue.hpp"
+#include "include/OcclusionCuller.hpp"
 #include "include/UI.hpp"
 #include "include/PhysicsEngine.hpp"
 #include "include/Window.hpp"
@@ -30,6 +33,10 @@ ComponentManager compManager;
 SystemManager sysManager;
 
 Camera camera;
+CameraBuffer cameraBuffer;  // The camera's matrices, computed once a frame
+RenderQueue renderQueue;
+OcclusionCuller occlusionCuller;    // Hides entities behind the terrain before they're queued
+GeometryPool geometryPool;  // Static meshes' shared buffers
 
 // Temporary variables for testing
 Heightmap* heightfield;
@@ -49,6 +56,7 @@ struct TimeData {
     Uint32 deltaT = 0;        // Time since last logic ticks (ms)
 
     Uint32 debugDrawTime = 0;
+    Uint32 renderStatsTime = 0; // Time the render stats were last printed (ms)
 };
 
 struct Flags {
@@ -57,6 +65,10 @@ struct Flags {
     bool zbuffer = false;       // Draw the zbuffer
     bool frameLimit = false;    // Limit the framerate with TimeData.minFrameTime
     bool showUI = false;
+    bool profile = false;       // Profile physics ticks, shown on the UI overlay
+    bool renderStats = false;   // Print the render queue's state changes once a second
+    bool geometryPool = true;   // Load static models into `geometryPool`
+    bool occlusion = true;      // Cull entities behind the terrain with `occlusionCuller`
 };
 
 struct EngineState {
@@ -64,6 +76,8 @@ struct EngineState {
     Flags flags;
 
     unsigned char vsync = 0;
+    std::string profileLog = "";    // Physics profile log, CSV or JSON(by extension)
+    BroadphaseSettings broadphase;
 } globalState;
 
 const Uint8* KEYBOARD = nullptr;
@@ -98,6 +112,26 @@ WindowCreationData parseCmdArgs(int& argc, char** argv) {
         windowData.height = std::stoi(option.data());
     }
 
+    // Broadphase, see physics_bench
+    option = cmdArgs.getOption("--broadphase");
+    if(option.compare("") != 0 && !parseBroadphaseType(std::string(option), globalState.broadphase.type)){
+        std::cerr << "Unknown broadphase \"" << option << "\", using dbvt\n";
+    }
+
+    // Physics profiling
+    globalState.flags.profile = cmdArgs.hasOption("--profile");
+    option = cmdArgs.getOption("--profile");
+    if(option.compare("") != 0 && option[0] != '-'){
+        globalState.profileLog = std::string(option);
+    }
+
+    // Render queue stats
+    globalState.flags.renderStats = cmdArgs.hasOption("--render-stats");
+    renderQueue.setInstancing(!cmdArgs.hasOption("--no-instancing"));
+    renderQueue.setCulling(!cmdArgs.hasOption("--no-culling"));
+    globalState.flags.geometryPool = !cmdArgs.hasOption("--no-geometry-pool");
+    globalState.flags.occlusion = !cmdArgs.hasOption("--no-occlusion");
+
     return windowData;
 }
 
@@ -162,6 +196,7 @@ int processEvents() {
                             break;
 
                         glm::vec2 windowDimensions = mainWindow->getDimensions();
+                        const CameraData& cameraData = cameraBuffer.getData();  // Last frame's, the camera can't move while paused
 
                         // Normalize mouse position to [-1, 1]
                         glm::vec3 rayNDS = glm::vec3(
@@ -171,15 +206,28 @@ int processEvents() {
                         );
 
                         glm::vec4 rayClip = glm::vec4(rayNDS.x, rayNDS.y, -1.f, 1.f);
-                        glm::vec4 rayEye = glm::inverse(glm::perspective(glm::radians(camera.getFOV()), (float)(windowDimensions.x / windowDimensions.y), 0.1f, 1000.f)) * rayClip;
+                        glm::vec4 rayEye = glm::inverse(cameraData.projection) * rayClip;
                         rayEye = glm::vec4(rayEye.x, rayEye.y, -1.f, 0.f);
 
-                        glm::vec3 rayWorld = glm::vec3(glm::inverse(camera.calcCameraView()) * rayEye);
+                        glm::vec3 rayWorld = glm::vec3(glm::inverse(cameraData.view) * rayEye);
                         rayWorld = glm::normalize(rayWorld);
 
-                        glm::vec3 rayOrigin = glm::vec3(glm::inverse(camera.calcCameraView()) * glm::vec4(0, 0, 0, 1));
-
-                        physicsEngine->castRay(rayOrigin, rayWorld, 100.f);
+                        glm::vec3 rayOrigin = glm::vec3(cameraData.position);
+
+                        // Static bodies like the terrain hide entities behind them. Slightly past the hit, as an entity's own static collider is hit at the same distance
+                        float maxDistance = 100.f;
+                        float staticDistance;
+                        const int staticMask = physicsEngine->getLayers().getQueryMask({ CollisionLayers::STATIC });
+                        if(physicsEngine->castRay(rayOrigin, rayWorld, maxDistance, staticDistance, staticMask))
+                            maxDistance = staticDistance + 0.05f;
+
+                        // Picks by the entities' triangles with the scene BVH, so entities without rigidbodies can be picked too
+                        float distance;
+                        const Entity picked = sysManager.getSystem<GraphicsSystem>()->pick(rayOrigin, rayWorld, maxDistance, distance);
+                        if(picked != EntityManager::INVALID) {
+                            const glm::vec3 hitPos = rayOrigin + rayWorld * distance;
+                            std::cout << "Picked entity " << picked << " at: " << hitPos.x << ", " << hitPos.y << ", " << hitPos.z << '\n';
+                        }
                     } case SDL_BUTTON(2): { // MMB
                         break;
                     } case SDL_BUTTON(3): { // RMB
@@ -233,7 +281,9 @@ int main(int argc, char** argv) {
         // Other OpenGL settings
         SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
         SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
-        SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_DEBUG_FLAG);
+        #ifdef DEBUG
+            SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_DEBUG_FLAG);  // For GLState's KHR_debug callback
+        #endif
 
         // Set mouse options
         SDL_SetRelativeMouseMode(SDL_FALSE);
@@ -248,12 +298,23 @@ int main(int argc, char** argv) {
         return 1;
 
     // Initialize PhysiceEngine
-    physicsEngine = std::make_unique<PhysicsEngine>();
+    physicsEngine = std::make_unique<PhysicsEngine>(globalState.broadphase);
     if(!physicsEngine->init()) {
         std::cerr << "Unable to initialize physics engine\n";
         return 1;
     }
 
+    // Physics profiling, summarized on the UI overlay
+    if(globalState.flags.profile) {
+        ui = std::make_unique<UI>();
+
+        PhysicsProfiler& profiler = physicsEngine->getProfiler();
+        profiler.setEnabled(true);
+        profiler.attachOverlay(*ui);
+        if(globalState.profileLog.compare("") != 0)
+            profiler.openLog(globalState.profileLog);
+    }
+
     // Initialize ECS
     {
         ComponentSet posID = compManager.registerComponent<PositionComponent>();
@@ -284,14 +345,22 @@ int main(int argc, char** argv) {
         compManager.addComponent(testModel, RenderComponent());
         sysManager.entityChanged(testModel, ComponentSet(posID | renID));
 
-        compManager.getComponent<RenderComponent>(testModel)->model.initialize("../assets/character/character.obj");
+        const std::string modelPath = "../assets/character/character.obj";
+        Model& model = compManager.getComponent<RenderComponent>(testModel)->model;
+        model.initialize(modelPath.c_str(), globalState.flags.geometryPool ? &geometryPool : nullptr);
+
+        // Static collider from the model, its cooked files are kept next to it
+        btCollisionShape* shape = physicsEngine->getShapeCache().getModel(model.getCollisionTriangles(), false, modelPath);
+        physicsEngine->addRigidBody(createRigidBody(shape, btTransform::getIdentity(), 0.f), CollisionLayers::STATIC);
         std::cout << "ECS System created and initialized\n";
     }
 
     // Test Objects
     {
         heightfield = new Heightmap("../assets/heightmap.png");
-        physicsEngine->addRigidBody(heightfield->getRigidBody());
+        for(HeightfieldTile& tile : heightfield->getTiles()) {
+            physicsEngine->addRigidBody(tile.rigidBody, CollisionLayers::STATIC);
+        }
 
         baseShader.loadProgram("../shaders/texture.vert", "../shaders/pureTexture.frag", "", "");
         heightmap.loadProgram("../shaders/heightmap.vert", "../shaders/heightmap.frag", "../shaders/heightmap.tesc", "../shaders/heightmap.tese");
@@ -331,28 +400,56 @@ int main(int argc, char** argv) {
                 globalState.time.deltaT
             );
             camera.updateCameraDirection();
+        }
 
+        // Camera matrices, shared by physics LOD and every program this frame
+        cameraBuffer.update(camera, mainWindow->getDimensions());
+
+        if(!globalState.flags.paused) {
+            physicsEngine->getLOD().setViewer(camera.getPos(), cameraBuffer.getData().viewProjection);
             physicsEngine->tick(globalState.time.deltaT / 1000.f);
         }
 
         // Render
         {
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-            heightfield->draw(heightmap, camera.calcCameraView(), camera.getFOV(), false);
-            sysManager.getSystem<GraphicsSystem>()->tick(baseShader, camera.calcCameraView(), camera.getFOV());
+            GLState::resetStats();
+
+            renderQueue.begin(cameraBuffer.getData().view, cameraBuffer.getData().projection, CameraBuffer::FAR_PLANE);
+            heightfield->submit(renderQueue, heightmap, false);
+            if(globalState.flags.occlusion) {
+                occlusionCuller.begin(cameraBuffer.getData().viewProjection);
+                heightfield->addOccluder(occlusionCuller);
+                sysManager.getSystem<GraphicsSystem>()->submit(renderQueue, baseShader, &occlusionCuller);
+            } else {
+                sysManager.getSystem<GraphicsSystem>()->submit(renderQueue, baseShader);
+            }
+            renderQueue.flush();
 
             if(globalState.flags.debugDraw) {
                 Uint32 currentTime = SDL_GetTicks();
-                physicsEngine->debugDraw(camera.calcCameraView(), camera.getFOV(), btIDebugDraw::DBG_DrawWireframe);
+                physicsEngine->debugDraw(cameraBuffer.getData(), btIDebugDraw::DBG_DrawWireframe);
                 globalState.time.debugDrawTime = SDL_GetTicks() - currentTime;
             }
 
-            if(globalState.flags.showUI) {
-                //ui->drawTextElements(textShader);
+            if(ui && (globalState.flags.showUI || globalState.flags.profile)) {
+                ui->drawTextElements(textShader);
+            }
+
+            if(globalState.flags.renderStats && SDL_GetTicks() - globalState.time.renderStatsTime >= 1000) {
+                const RenderStats& stats = renderQueue.getStats();
+                std::cout << "Render: " << stats.items << " items(" << stats.culled << " culled), " << stats.drawCalls << " draws(" << stats.instancedDraws << " instanced, " << stats.instances << " instances, " << stats.pooledBatches << " pooled batches of " << stats.pooledCommands << "), "
+                    << "shader/material/vao changes " << stats.shaderChanges << "/" << stats.materialChanges << "/" << stats.vaoChanges
+                    << " (unsorted " << stats.unsortedShaderChanges << "/" << stats.unsortedMaterialChanges << "/" << stats.unsortedVaoChanges << "), "
+                    << "GL state calls " << GLState::getStats().issued << " issued, " << GLState::getStats().skipped << " skipped";
+                if(globalState.flags.occlusion) {
+                    const OcclusionStats& occlusion = occlusionCuller.getStats();
+                    std::cout << ", occlusion " << occlusion.occluded << "/" << occlusion.tested << " hidden by " << occlusion.rasterizedTriangles << "/" << occlusion.occluderTriangles << " triangles";
+                }
+                std::cout << "\n";
+                globalState.time.renderStatsTime = SDL_GetTicks();
             }
 
-            glUseProgram(0);
             SDL_GL_SwapWindow(mainWindow->getSDLWindow());
         }
 